@@ -0,0 +1,117 @@
+#include "BlockDevice.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+// Cuenta las reservas de memoria de las lecturas sin copias (readBlock con buffer,
+// viewBlock y read con buffer): con la cache caliente no tienen que tocar el heap.
+//
+// Uso: SimuladorDeBloques_AndreaQuin_alloc [--image ruta]
+
+namespace {
+std::atomic<size_t> allocations{0};
+}
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { std::free(ptr); }
+
+namespace {
+const size_t ROUNDS = 1000;
+
+struct Case
+{
+    const char *name;
+    BackendType backend;
+};
+
+// Reservas hechas por fn en ROUNDS vueltas, despues de una vuelta para calentar la cache
+template <typename Fn>
+size_t countAllocations(Fn fn) {
+    if (!fn()) return static_cast<size_t>(-1);
+    size_t before = allocations.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < ROUNDS; i++) {
+        if (!fn()) return static_cast<size_t>(-1);
+    }
+    return allocations.load(std::memory_order_relaxed) - before;
+}
+
+bool runCase(const std::string &image, const Case &test) {
+    const size_t blockSize = 4096;
+    BlockDevice device;
+    std::remove(image.c_str());
+    if (!device.create(image, blockSize, 8192, test.backend) || !device.open(image, test.backend)) {
+        std::cerr << "Error: No se pudo armar la imagen " << image << ".\n";
+        return false;
+    }
+
+    // Un archivo de varios tramos y uno que entra en el inodo
+    std::string data(10 * blockSize + 123, 'x');
+    if (!device.write("grande", data) || !device.write("chico", "hola") || !device.sync()) return false;
+
+    std::vector<char> buffer(data.size());
+    size_t bytesRead = 0;
+    size_t firstData = 4096; // En el area de datos de una imagen de 8192 bloques
+    std::vector<char> rawBlock(blockSize, 'r');
+    if (!device.writeBlock(firstData, rawBlock)) return false;
+
+    struct Result
+    {
+        const char *call;
+        size_t count;
+    };
+    std::vector<Result> results = {
+        {"readBlock", countAllocations([&] { return device.readBlock(firstData, buffer.data(), blockSize); })},
+        {"viewBlock", countAllocations([&] { return static_cast<bool>(device.viewBlock(firstData)); })},
+        {"read grande", countAllocations([&] {
+             return device.read("grande", buffer.data(), buffer.size(), bytesRead) && bytesRead == data.size();
+         })},
+        {"read chico", countAllocations([&] {
+             return device.read("chico", buffer.data(), buffer.size(), bytesRead) && bytesRead == 4;
+         })},
+    };
+    device.close();
+    std::remove(image.c_str());
+    std::remove((image + ".dedup").c_str());
+
+    bool ok = true;
+    for (const Result &result : results) {
+        bool failed = result.count == static_cast<size_t>(-1);
+        std::cout << test.name << " " << result.call << ": "
+                  << (failed ? std::string("la lectura fallo") : std::to_string(result.count) + " reservas en " +
+                                                                     std::to_string(ROUNDS) + " llamadas")
+                  << "\n";
+        ok = ok && result.count == 0;
+    }
+    return ok;
+}
+}
+
+int main(int argc, char **argv) {
+    std::string image = "alloc.img";
+    if (argc == 3 && std::string(argv[1]) == "--image") {
+        image = argv[2];
+    } else if (argc != 1) {
+        std::cerr << "Uso: " << argv[0] << " [--image ruta]\n";
+        return 1;
+    }
+
+    bool ok = true;
+    for (const Case &test : {Case{"pread", BackendType::PREAD}, Case{"mmap", BackendType::MMAP}}) {
+        ok = runCase(image, test) && ok;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,308 @@
+#include "AsyncIO.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+// Transfiere todo el rango con pread/pwrite; devuelve los bytes o -errno
+int64_t transfer(bool write, int fd, char *buffer, size_t length, uint64_t offset) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = write ? pwrite(fd, buffer + done, length - done, offset + done)
+                          : pread(fd, buffer + done, length - done, offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -errno;
+        if (n == 0) break;
+        done += n;
+    }
+    return done;
+}
+}
+
+void AsyncEngine::complete(AsyncRequest *request, int64_t result) {
+    request->result = result;
+
+    // Despues de esto el dueño del lote puede liberar la peticion
+    request->batch->remaining.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+bool AsyncEngine::wait(AsyncRequest *requests, size_t count, AsyncBatch &batch) {
+    waitBatch(batch);
+
+    bool ok = true;
+    for (size_t i = 0; i < count; i++) {
+        AsyncRequest &request = requests[i];
+        if (request.result < 0) {
+            ok = false;
+            continue;
+        }
+
+        // Una transferencia corta se termina aqui mismo
+        size_t done = request.result;
+        if (done < request.length) {
+            int64_t rest = transfer(request.write, request.fd, request.buffer + done, request.length - done,
+                                    request.offset + done);
+            if (rest < 0 || static_cast<size_t>(rest) != request.length - done) ok = false;
+        }
+    }
+    return ok;
+}
+
+bool AsyncEngine::run(AsyncRequest *requests, size_t count) {
+    if (count == 0) return true;
+
+    AsyncBatch batch;
+    if (!submit(requests, count, batch)) return false;
+    return wait(requests, count, batch);
+}
+
+UringEngine::~UringEngine() {
+    if (sqes) munmap(sqes, sqesSize);
+    if (cqRing && cqRing != sqRing) munmap(cqRing, cqRingSize);
+    if (sqRing) munmap(sqRing, sqRingSize);
+    if (ringFd != -1) close(ringFd);
+}
+
+bool UringEngine::setup(unsigned entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    ringFd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ringFd < 0) {
+        ringFd = -1;
+        return false;
+    }
+
+    // IORING_OP_READ/WRITE llegaron en el mismo kernel que esta bandera
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) return false;
+
+    this->entries = params.sq_entries;
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+    void *addr = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (addr == MAP_FAILED) return false;
+    sqRing = addr;
+
+    if (single) {
+        cqRing = sqRing;
+    } else {
+        addr = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if (addr == MAP_FAILED) return false;
+        cqRing = addr;
+    }
+
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    addr = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (addr == MAP_FAILED) return false;
+    sqes = static_cast<io_uring_sqe *>(addr);
+
+    char *sq = static_cast<char *>(sqRing);
+    sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+
+    char *cq = static_cast<char *>(cqRing);
+    cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+int UringEngine::enter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0);
+}
+
+bool UringEngine::submit(AsyncRequest *requests, size_t count, AsyncBatch &batch) {
+    batch.remaining.fetch_add(count, std::memory_order_relaxed);
+
+    // En vuelo nunca hay mas que entradas en la cola, asi la de respuestas no se desborda
+    for (size_t next = 0; next < count;) {
+        reapUntil([&]() { return inflight.load(std::memory_order_acquire) < entries; });
+
+        std::unique_lock<std::mutex> lock(submitMutex);
+        unsigned busy = inflight.load(std::memory_order_acquire);
+        if (busy >= entries) continue;
+
+        unsigned tail = *sqTail;
+        size_t take = std::min<size_t>(entries - busy, count - next);
+        for (size_t i = 0; i < take; i++) {
+            AsyncRequest &request = requests[next + i];
+            request.batch = &batch;
+            request.result = 0;
+
+            unsigned slot = tail & *sqMask;
+            io_uring_sqe &sqe = sqes[slot];
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = request.write ? IORING_OP_WRITE : IORING_OP_READ;
+            sqe.fd = request.fd;
+            sqe.off = request.offset;
+            sqe.addr = reinterpret_cast<uint64_t>(request.buffer);
+            sqe.len = static_cast<uint32_t>(request.length);
+            sqe.user_data = reinterpret_cast<uint64_t>(&request);
+
+            sqArray[slot] = slot;
+            tail++;
+        }
+
+        inflight.fetch_add(take, std::memory_order_acq_rel);
+        __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+        if (!flushSubmissions()) {
+            // Sin enter nadie toma entradas de la cola, y con el candado solo las nuestras siguen en
+            // ella: se retiran. Lo que el kernel ya tomo sigue en vuelo y escribe en las peticiones
+            // y sus buffers, asi que se espera antes de devolverlas al llamador
+            unsigned retracted = tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+            __atomic_store_n(sqTail, tail - retracted, __ATOMIC_RELEASE);
+            inflight.fetch_sub(retracted, std::memory_order_acq_rel);
+            lock.unlock();
+
+            for (size_t i = next + take - retracted; i < count; i++) requests[i].result = -EIO;
+            batch.remaining.fetch_sub(retracted + (count - next - take), std::memory_order_acq_rel);
+            waitBatch(batch);
+            return false;
+        }
+
+        next += take;
+    }
+    return true;
+}
+
+// Entrega al kernel todo lo que quedo en la cola de envio
+bool UringEngine::flushSubmissions() {
+    while (true) {
+        unsigned pending = *sqTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        if (pending == 0) return true;
+
+        if (enter(pending, 0, 0) >= 0 || errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EBUSY) return false;
+
+        // El kernel pide que se vacie la cola de respuestas antes de aceptar mas
+        std::unique_lock<std::mutex> lock(reapMutex);
+        if (!reaping) {
+            reaping = true;
+            lock.unlock();
+            drain();
+            lock.lock();
+            reaping = false;
+            reaped.notify_all();
+        } else {
+            lock.unlock();
+            std::this_thread::yield();
+        }
+    }
+}
+
+void UringEngine::drain() {
+    unsigned head = *cqHead;
+    unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; head++) {
+        const io_uring_cqe &cqe = cqes[head & *cqMask];
+        inflight.fetch_sub(1, std::memory_order_acq_rel);
+        complete(reinterpret_cast<AsyncRequest *>(cqe.user_data), cqe.res);
+    }
+
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+}
+
+template <typename Pred>
+void UringEngine::reapUntil(Pred done) {
+    std::unique_lock<std::mutex> lock(reapMutex);
+
+    while (!done()) {
+        if (reaping) {
+            reaped.wait(lock);
+            continue;
+        }
+
+        // Este hilo cosecha por todos; los demas esperan su aviso
+        reaping = true;
+        lock.unlock();
+
+        drain();
+        if (!done()) {
+            enter(0, 1, IORING_ENTER_GETEVENTS);
+            drain();
+        }
+
+        lock.lock();
+        reaping = false;
+        reaped.notify_all();
+    }
+}
+
+void UringEngine::waitBatch(AsyncBatch &batch) {
+    reapUntil([&]() { return batch.remaining.load(std::memory_order_acquire) == 0; });
+}
+
+ThreadPoolEngine::ThreadPoolEngine(unsigned threads) {
+    for (unsigned i = 0; i < std::max(threads, 1u); i++) {
+        workers.emplace_back([this]() { worker(); });
+    }
+}
+
+ThreadPoolEngine::~ThreadPoolEngine() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work.notify_all();
+    for (std::thread &thread : workers) thread.join();
+}
+
+bool ThreadPoolEngine::submit(AsyncRequest *requests, size_t count, AsyncBatch &batch) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch.remaining.fetch_add(count, std::memory_order_relaxed);
+
+        for (size_t i = 0; i < count; i++) {
+            requests[i].batch = &batch;
+            requests[i].result = 0;
+            queue.push_back(&requests[i]);
+        }
+    }
+    work.notify_all();
+    return true;
+}
+
+void ThreadPoolEngine::waitBatch(AsyncBatch &batch) {
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&]() { return batch.remaining.load(std::memory_order_acquire) == 0; });
+}
+
+void ThreadPoolEngine::worker() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        work.wait(lock, [this]() { return stopping || !queue.empty(); });
+        if (queue.empty()) return;
+
+        AsyncRequest *request = queue.front();
+        queue.pop_front();
+        lock.unlock();
+
+        int64_t result = transfer(request->write, request->fd, request->buffer, request->length, request->offset);
+
+        lock.lock();
+        complete(request, result);
+        done.notify_all();
+    }
+}
+
+std::unique_ptr<AsyncEngine> makeAsyncEngine(unsigned depth) {
+    auto uring = std::make_unique<UringEngine>();
+    if (uring->setup(depth)) return uring;
+
+    return std::make_unique<ThreadPoolEngine>(std::min(depth, 16u));
+}
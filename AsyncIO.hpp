@@ -0,0 +1,130 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// Grupo de peticiones que se envian y se esperan juntas
+struct AsyncBatch
+{
+    std::atomic<size_t> remaining{0};
+};
+
+// Una lectura o escritura por offset absoluto sobre un descriptor
+struct AsyncRequest
+{
+    bool write = false;
+    int fd = -1;
+    uint64_t offset = 0;
+    char *buffer = nullptr;
+    size_t length = 0;
+    int64_t result = 0; // Bytes transferidos o -errno al terminar
+    AsyncBatch *batch = nullptr;
+};
+
+// Motor de E/S asincrona: un lote entero se encola de una vez y se espera al final,
+// asi la cola del dispositivo se mantiene llena. Se puede usar desde varios hilos.
+class AsyncEngine
+{
+public:
+    virtual ~AsyncEngine() = default;
+
+    // Encola el lote sin esperar a que termine; las peticiones deben vivir hasta wait()
+    virtual bool submit(AsyncRequest *requests, size_t count, AsyncBatch &batch) = 0;
+    // Espera el lote y completa de forma sincronica las transferencias cortas
+    bool wait(AsyncRequest *requests, size_t count, AsyncBatch &batch);
+    bool run(AsyncRequest *requests, size_t count);
+
+    virtual const char *name() const = 0;
+    virtual unsigned depth() const = 0;
+
+protected:
+    virtual void waitBatch(AsyncBatch &batch) = 0;
+    static void complete(AsyncRequest *request, int64_t result);
+};
+
+// io_uring con syscalls directas (sin liburing): los anillos se proyectan con mmap
+class UringEngine : public AsyncEngine
+{
+public:
+    ~UringEngine() override;
+
+    // false si el kernel no tiene io_uring o esta deshabilitado
+    bool setup(unsigned entries);
+
+    bool submit(AsyncRequest *requests, size_t count, AsyncBatch &batch) override;
+    const char *name() const override { return "io_uring"; }
+    unsigned depth() const override { return entries; }
+
+protected:
+    void waitBatch(AsyncBatch &batch) override;
+
+private:
+    int ringFd = -1;
+    unsigned entries = 0;
+
+    void *sqRing = nullptr;
+    void *cqRing = nullptr;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    struct io_uring_sqe *sqes = nullptr;
+    size_t sqesSize = 0;
+
+    unsigned *sqHead = nullptr;
+    unsigned *sqTail = nullptr;
+    unsigned *sqMask = nullptr;
+    unsigned *sqArray = nullptr;
+    unsigned *cqHead = nullptr;
+    unsigned *cqTail = nullptr;
+    unsigned *cqMask = nullptr;
+    struct io_uring_cqe *cqes = nullptr;
+
+    // La cola de envio la toca un hilo a la vez; la de respuestas, solo el que cosecha
+    std::mutex submitMutex;
+    std::atomic<unsigned> inflight{0};
+
+    std::mutex reapMutex;
+    std::condition_variable reaped;
+    bool reaping = false;
+
+    int enter(unsigned toSubmit, unsigned minComplete, unsigned flags);
+    bool flushSubmissions();
+    void drain();
+    // Espera completions hasta que done() sea verdadero; un solo hilo bloquea en el kernel
+    template <typename Pred>
+    void reapUntil(Pred done);
+};
+
+// Respaldo portable: un grupo de hilos que hace pread/pwrite
+class ThreadPoolEngine : public AsyncEngine
+{
+public:
+    explicit ThreadPoolEngine(unsigned threads);
+    ~ThreadPoolEngine() override;
+
+    bool submit(AsyncRequest *requests, size_t count, AsyncBatch &batch) override;
+    const char *name() const override { return "thread pool"; }
+    unsigned depth() const override { return static_cast<unsigned>(workers.size()); }
+
+protected:
+    void waitBatch(AsyncBatch &batch) override;
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<AsyncRequest *> queue;
+    std::mutex mutex;
+    std::condition_variable work;
+    std::condition_variable done;
+    bool stopping = false;
+
+    void worker();
+};
+
+// io_uring si el kernel lo permite; si no, el grupo de hilos
+std::unique_ptr<AsyncEngine> makeAsyncEngine(unsigned depth);
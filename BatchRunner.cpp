@@ -0,0 +1,128 @@
+#include "BatchRunner.hpp"
+
+BatchRunner::BatchRunner(Executor execute, Classifier classify, size_t jobs)
+    : execute(std::move(execute)), classify(std::move(classify)) {
+    if (jobs <= 1) return;
+
+    for (size_t i = 0; i < jobs; i++) {
+        workers.push_back(std::make_unique<Worker>());
+        Worker *worker = workers.back().get();
+        worker->thread = std::thread([this, worker]() { workerLoop(*worker); });
+    }
+}
+
+BatchRunner::~BatchRunner() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    for (auto &worker : workers) worker->work.notify_all();
+    for (auto &worker : workers) worker->thread.join();
+}
+
+size_t BatchRunner::run(std::istream &in, std::ostream &out, std::ostream &err) {
+    std::string line;
+    size_t commands = 0;
+
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        size_t first = line.find_first_not_of(" \t");
+        if (first == std::string::npos || line[first] == '#') continue;
+        commands++;
+
+        auto task = std::make_unique<Task>();
+        task->line = line;
+        if (!workers.empty() && classify(line, task->keys)) {
+            dispatch(std::move(task), out, err);
+            continue;
+        }
+
+        // Todo lo anterior termina y se imprime antes
+        drain(out, err, 0);
+        if (!execute(line, out, err)) break;
+    }
+
+    drain(out, err, 0);
+    return commands;
+}
+
+void BatchRunner::dispatch(std::unique_ptr<Task> task, std::ostream &out, std::ostream &err) {
+    // Si algun archivo ya tiene tareas, la nueva va detras de ellas en el mismo hilo
+    size_t owner = workers.size();
+    bool conflict = false;
+    for (const std::string &key : task->keys) {
+        auto it = owners.find(key);
+        if (it == owners.end()) continue;
+        if (owner == workers.size()) owner = it->second.first;
+        else if (owner != it->second.first) conflict = true;
+    }
+
+    // Archivos repartidos en dos hilos: se espera a que terminen
+    if (conflict) {
+        drain(out, err, 0);
+        owner = workers.size();
+    }
+    if (owner == workers.size()) owner = nextWorker++ % workers.size();
+
+    for (const std::string &key : task->keys) {
+        auto &entry = owners[key];
+        entry.first = owner;
+        entry.second++;
+    }
+
+    Task *raw = task.get();
+    pending.push_back(std::move(task));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        workers[owner]->queue.push_back(raw);
+    }
+    workers[owner]->work.notify_one();
+
+    drain(out, err, MAX_PENDING_PER_WORKER * workers.size());
+}
+
+void BatchRunner::drain(std::ostream &out, std::ostream &err, size_t keep) {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (!pending.empty()) {
+        Task &task = *pending.front();
+        if (!task.done) {
+            if (pending.size() <= keep) return;
+            finished.wait(lock, [&task]() { return task.done; });
+        }
+        lock.unlock();
+
+        std::string text = task.out.str();
+        if (!text.empty()) out << text;
+        text = task.err.str();
+        if (!text.empty()) err << text;
+
+        for (const std::string &key : task.keys) {
+            auto it = owners.find(key);
+            if (--it->second.second == 0) owners.erase(it);
+        }
+        pending.pop_front();
+
+        lock.lock();
+    }
+}
+
+void BatchRunner::workerLoop(Worker &worker) {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        worker.work.wait(lock, [&]() { return stopping || !worker.queue.empty(); });
+        if (worker.queue.empty()) return;
+
+        Task *task = worker.queue.front();
+        worker.queue.pop_front();
+        lock.unlock();
+
+        // Un comando adelantado nunca termina el script: el resultado no importa
+        execute(task->line, task->out, task->err);
+
+        lock.lock();
+        task->done = true;
+        finished.notify_all();
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Ejecuta un script de comandos (uno por linea; las vacias y las que empiezan con '#' se
+// saltean) en un solo proceso. Con varios hilos se adelantan los comandos que solo tocan
+// los archivos que nombran: los que comparten un archivo van al mismo hilo y en orden, y
+// cualquier otro comando espera a que termine todo lo anterior. La salida de cada comando
+// se junta y se imprime en el orden del script
+class BatchRunner
+{
+public:
+    // Ejecuta una linea; false si el script pide terminar
+    using Executor = std::function<bool(const std::string &line, std::ostream &out, std::ostream &err)>;
+    // Archivos que toca la linea; false si no se puede adelantar
+    using Classifier = std::function<bool(const std::string &line, std::vector<std::string> &keys)>;
+
+    // jobs <= 1: todo en el hilo que llama a run, sin buffers intermedios
+    BatchRunner(Executor execute, Classifier classify, size_t jobs);
+    ~BatchRunner();
+
+    // Procesa el script entero; devuelve la cantidad de comandos ejecutados
+    size_t run(std::istream &in, std::ostream &out, std::ostream &err);
+
+private:
+    struct Task
+    {
+        std::string line;
+        std::vector<std::string> keys;
+        std::ostringstream out;
+        std::ostringstream err;
+        bool done = false;
+    };
+
+    struct Worker
+    {
+        std::thread thread;
+        std::deque<Task *> queue;
+        std::condition_variable work;
+    };
+
+    // Tareas adelantadas que puede haber por hilo antes de esperar a la mas vieja
+    static constexpr size_t MAX_PENDING_PER_WORKER = 256;
+
+    Executor execute;
+    Classifier classify;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex mutex;
+    std::condition_variable finished;
+    bool stopping = false;
+
+    // Solo los usa el hilo de run: tareas en el orden del script hasta imprimirlas, y
+    // archivo -> (hilo que tiene tareas sobre el, cuantas)
+    std::deque<std::unique_ptr<Task>> pending;
+    std::unordered_map<std::string, std::pair<size_t, size_t>> owners;
+    size_t nextWorker = 0;
+
+    void workerLoop(Worker &worker);
+    void dispatch(std::unique_ptr<Task> task, std::ostream &out, std::ostream &err);
+    // Imprime las tareas terminadas del frente; espera mientras queden mas de keep
+    void drain(std::ostream &out, std::ostream &err, size_t keep);
+};
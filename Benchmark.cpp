@@ -0,0 +1,374 @@
+#include "BlockDevice.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Benchmarks del device: cada caso mide la latencia de cada operacion y reporta
+// ops/s, MB/s, p50 y p99. Recorre varios tamaños y cantidades de bloques.
+//
+// Uso: SimuladorDeBloques_AndreaQuin_bench [--ops N] [--sizes 512,4096] [--counts 8192,32768]
+//                                         [--files N] [--backend fstream|mmap|pread] [--cache N]
+//                                         [--image ruta] [--compress] [--dedup] [--data random|log] [filtro]
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+    size_t ops = 20000;
+    size_t files = 2000;
+    size_t cacheBlocks = 256;
+    std::vector<size_t> sizes = {512, 4096};
+    std::vector<size_t> counts = {8192, 32768};
+    BackendType backend = BackendType::PREAD;
+    std::string image = "bench.img";
+    std::string filter;
+    bool compress = false;
+    bool dedup = false;
+    // Contenido del archivo de copy_in: aleatorio (no comprime) o lineas de log
+    bool logData = false;
+};
+
+struct Result
+{
+    std::string name;
+    size_t ops = 0;
+    uint64_t bytes = 0;
+    double seconds = 0;
+    double p50 = 0; // microsegundos
+    double p99 = 0;
+};
+
+// Generador de cargas: la secuencia de bloques que visita un caso
+enum class Pattern
+{
+    SEQUENTIAL,
+    RANDOM
+};
+
+std::vector<size_t> makeWorkload(Pattern pattern, size_t first, size_t count, size_t ops, uint64_t seed) {
+    std::vector<size_t> blocks(ops);
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<size_t> pick(0, count - 1);
+
+    for (size_t i = 0; i < ops; i++) {
+        blocks[i] = first + (pattern == Pattern::SEQUENTIAL ? i % count : pick(rng));
+    }
+    return blocks;
+}
+
+double percentile(std::vector<double> &samples, double p) {
+    if (samples.empty()) return 0;
+    size_t k = std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+    return samples[k];
+}
+
+// Corre op(i) ops veces; finish (si hay) entra en el tiempo total pero no en las latencias
+Result measure(const std::string &name, size_t ops, uint64_t bytesPerOp, const std::function<bool(size_t)> &op,
+               const std::function<void()> &finish = nullptr) {
+    Result result;
+    result.name = name;
+    std::vector<double> latencies;
+    latencies.reserve(ops);
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < ops; i++) {
+        auto before = Clock::now();
+        bool ok = op(i);
+        auto after = Clock::now();
+
+        if (!ok) {
+            std::cerr << "Error: " << name << " fallo en la operacion " << i << ".\n";
+            break;
+        }
+        latencies.push_back(std::chrono::duration<double, std::micro>(after - before).count());
+        result.ops++;
+    }
+    if (finish) finish();
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    result.bytes = bytesPerOp * result.ops;
+    result.p50 = percentile(latencies, 0.50);
+    result.p99 = percentile(latencies, 0.99);
+    return result;
+}
+
+void printHeader() {
+    std::cout << std::left << std::setw(44) << "Benchmark" << std::right << std::setw(12) << "ops" << std::setw(14)
+              << "ops/s" << std::setw(12) << "MB/s" << std::setw(12) << "p50(us)" << std::setw(12) << "p99(us)" << "\n";
+    std::cout << std::string(106, '-') << "\n";
+}
+
+void printResult(const Result &r) {
+    double opsPerSecond = r.seconds > 0 ? r.ops / r.seconds : 0;
+    double mbPerSecond = r.seconds > 0 ? r.bytes / r.seconds / (1024.0 * 1024.0) : 0;
+
+    std::cout << std::left << std::setw(44) << r.name << std::right << std::setw(12) << r.ops << std::fixed
+              << std::setprecision(0) << std::setw(14) << opsPerSecond << std::setprecision(2) << std::setw(12)
+              << mbPerSecond << std::setw(12) << r.p50 << std::setw(12) << r.p99 << "\n";
+    std::cout.unsetf(std::ios::fixed);
+}
+
+std::vector<size_t> parseList(const std::string &text) {
+    std::vector<size_t> values;
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) values.push_back(std::stoull(item));
+    }
+    return values;
+}
+
+bool parseOptions(int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--ops" && hasValue) {
+            options.ops = std::stoull(argv[++i]);
+        } else if (arg == "--files" && hasValue) {
+            options.files = std::stoull(argv[++i]);
+        } else if (arg == "--cache" && hasValue) {
+            options.cacheBlocks = std::stoull(argv[++i]);
+        } else if (arg == "--sizes" && hasValue) {
+            options.sizes = parseList(argv[++i]);
+        } else if (arg == "--counts" && hasValue) {
+            options.counts = parseList(argv[++i]);
+        } else if (arg == "--image" && hasValue) {
+            options.image = argv[++i];
+        } else if (arg == "--backend" && hasValue) {
+            std::string backend = argv[++i];
+            if (backend == "fstream") {
+                options.backend = BackendType::FSTREAM;
+            } else if (backend == "mmap") {
+                options.backend = BackendType::MMAP;
+            } else if (backend == "pread") {
+                options.backend = BackendType::PREAD;
+            } else {
+                std::cerr << "Error: Backend desconocido: " << backend << "\n";
+                return false;
+            }
+        } else if (arg == "--compress") {
+            options.compress = true;
+        } else if (arg == "--dedup") {
+            options.dedup = true;
+        } else if (arg == "--data" && hasValue) {
+            std::string data = argv[++i];
+            if (data != "random" && data != "log") {
+                std::cerr << "Error: Datos desconocidos: " << data << "\n";
+                return false;
+            }
+            options.logData = data == "log";
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "Error: Opcion desconocida: " << arg << "\n";
+            return false;
+        } else {
+            options.filter = arg;
+        }
+    }
+    return !options.sizes.empty() && !options.counts.empty();
+}
+
+class Suite
+{
+public:
+    Suite(const Options &options, size_t blockSize, size_t blockCount)
+        : options(options), blockSize(blockSize), blockCount(blockCount) {
+        suffix = "/" + std::to_string(blockSize) + "/" + std::to_string(blockCount);
+    }
+
+    bool run() {
+        if (!prepare()) return false;
+
+        blockBenchmarks();
+        fileBenchmarks();
+        copyBenchmarks();
+
+        device.close();
+        std::remove(options.image.c_str());
+        return true;
+    }
+
+private:
+    const Options &options;
+    size_t blockSize;
+    size_t blockCount;
+    std::string suffix;
+    BlockDevice device;
+
+    bool selected(const std::string &name) const {
+        return options.filter.empty() || (name + suffix).find(options.filter) != std::string::npos;
+    }
+
+    void report(Result result) {
+        result.name += suffix;
+        printResult(result);
+    }
+
+    bool prepare() {
+        // Mensajes del device (formateo, journal) fuera de la tabla
+        std::ostringstream sink;
+        std::streambuf *old = std::cout.rdbuf(sink.rdbuf());
+
+        bool ok = device.create(options.image, blockSize, blockCount);
+        device.setCacheOptions(options.cacheBlocks, EvictionPolicy::LRU);
+        device.setCompression(options.compress);
+        device.setDeduplication(options.dedup);
+        ok = ok && device.open(options.image, options.backend) && device.format();
+
+        std::cout.rdbuf(old);
+        if (!ok) std::cerr << "Error: No se pudo preparar " << options.image << suffix << "\n";
+        return ok;
+    }
+
+    void blockBenchmarks() {
+        // La mitad alta del device queda lejos de los metadatos
+        size_t first = blockCount / 2;
+        size_t count = blockCount - first;
+        std::vector<char> data(blockSize, 'b');
+        std::vector<char> buffer(blockSize);
+
+        auto sequential = makeWorkload(Pattern::SEQUENTIAL, first, count, options.ops, 1);
+        auto random = makeWorkload(Pattern::RANDOM, first, count, options.ops, 2);
+        auto sync = [this]() { device.sync(); };
+
+        if (selected("BM_WriteBlock/seq")) {
+            report(measure("BM_WriteBlock/seq", options.ops, blockSize,
+                           [&](size_t i) { return device.writeBlock(sequential[i], data); }, sync));
+        }
+        if (selected("BM_WriteBlock/rand")) {
+            report(measure("BM_WriteBlock/rand", options.ops, blockSize,
+                           [&](size_t i) { return device.writeBlock(random[i], data); }, sync));
+        }
+        if (selected("BM_ReadBlock/seq")) {
+            report(measure("BM_ReadBlock/seq", options.ops, blockSize, [&](size_t i) {
+                return device.readBlock(sequential[i], buffer.data(), blockSize);
+            }));
+        }
+        if (selected("BM_ReadBlock/rand")) {
+            report(measure("BM_ReadBlock/rand", options.ops, blockSize, [&](size_t i) {
+                return device.readBlock(random[i], buffer.data(), blockSize);
+            }));
+        }
+    }
+
+    void fileBenchmarks() {
+        size_t files = options.files;
+        std::string text(100, 'm');
+        auto name = [](size_t i) { return "bench_" + std::to_string(i); };
+        auto sync = [this]() { device.sync(); };
+
+        // Los casos de archivos dependen del primero; se crean aunque el filtro no lo pida
+        Result created = measure("BM_CreateFile", files, text.size(),
+                                 [&](size_t i) { return device.write(name(i), text); }, sync);
+        if (selected("BM_CreateFile")) report(created);
+        files = created.ops;
+
+        std::mt19937_64 rng(3);
+        std::uniform_int_distribution<size_t> pick(0, std::max<size_t>(files, 1) - 1);
+        std::vector<size_t> lookups(options.ops);
+        for (size_t &i : lookups) i = pick(rng);
+
+        if (selected("BM_Lookup") && files > 0) {
+            report(measure("BM_Lookup", options.ops, 0,
+                           [&](size_t i) { return device.fileSize(name(lookups[i])) >= 0; }));
+        }
+        if (selected("BM_OverwriteFile") && files > 0) {
+            report(measure("BM_OverwriteFile", std::min(options.ops, files), text.size(),
+                           [&](size_t i) { return device.write(name(lookups[i]), text); }, sync));
+        }
+        if (selected("BM_ListFiles")) {
+            std::ostringstream sink;
+            std::streambuf *old = std::cout.rdbuf(sink.rdbuf());
+            Result listed = measure("BM_ListFiles", 20, 0, [&](size_t) {
+                device.listFiles();
+                sink.str("");
+                return true;
+            });
+            std::cout.rdbuf(old);
+            report(listed);
+        }
+
+        Result removed = measure("BM_RemoveFile", files, 0,
+                                 [&](size_t i) { return device.remove(name(i)); }, sync);
+        if (selected("BM_RemoveFile")) report(removed);
+    }
+
+    void copyBenchmarks() {
+        if (!selected("BM_CopyIn") && !selected("BM_CopyOut")) return;
+
+        // Un archivo de un octavo del device (la mitad alta la ocupan los bloques), hasta 64 MiB
+        uint64_t size = std::min<uint64_t>(static_cast<uint64_t>(blockSize) * blockCount / 8, 64ull << 20);
+        std::string hostIn = options.image + ".in";
+        std::string hostOut = options.image + ".out";
+        {
+            std::ofstream out(hostIn, std::ios::binary);
+            std::vector<char> chunk(1 << 20);
+            std::mt19937_64 rng(4);
+            if (options.logData) {
+                static const char *levels[] = {"INFO", "WARN", "DEBUG", "ERROR"};
+                std::string text;
+                for (size_t line = 0; text.size() < chunk.size(); line++) {
+                    text += "2024-05-0" + std::to_string(1 + rng() % 9) + " 12:" + std::to_string(10 + rng() % 50) +
+                            " [" + levels[rng() % 4] + "] worker-" + std::to_string(rng() % 16) +
+                            " request " + std::to_string(rng() % 100000) + " served in " +
+                            std::to_string(rng() % 900) + " ms\n";
+                }
+                std::copy(text.begin(), text.begin() + chunk.size(), chunk.begin());
+            }
+            // Los datos aleatorios cambian en cada MiB: con --dedup solo se repiten entre rondas
+            for (uint64_t done = 0; done < size; done += chunk.size()) {
+                if (!options.logData) {
+                    for (char &c : chunk) c = static_cast<char>(rng());
+                }
+                out.write(chunk.data(), std::min<uint64_t>(chunk.size(), size - done));
+            }
+        }
+
+        const size_t rounds = 5;
+        Result copiedIn = measure("BM_CopyIn", rounds, size,
+                                  [&](size_t) { return device.copyIn(hostIn, "bench_big"); },
+                                  [this]() { device.sync(); });
+        if (selected("BM_CopyIn")) report(copiedIn);
+
+        if (selected("BM_CopyOut") && copiedIn.ops > 0) {
+            report(measure("BM_CopyOut", rounds, size, [&](size_t) { return device.copyOut("bench_big", hostOut); }));
+        }
+
+        device.remove("bench_big");
+        std::remove(hostIn.c_str());
+        std::remove(hostOut.c_str());
+    }
+};
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Uso: " << argv[0]
+                  << " [--ops N] [--sizes 512,4096] [--counts 8192,32768] [--files N]"
+                     " [--backend fstream|mmap|pread] [--cache N] [--image ruta] [--compress]"
+                     " [--dedup] [--data random|log] [filtro]\n";
+        return 1;
+    }
+
+    printHeader();
+    bool ok = true;
+    for (size_t blockSize : options.sizes) {
+        for (size_t blockCount : options.counts) {
+            Suite suite(options, blockSize, blockCount);
+            ok = suite.run() && ok;
+        }
+    }
+    return ok ? 0 : 1;
+}
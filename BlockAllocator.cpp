@@ -0,0 +1,295 @@
+#include "BlockAllocator.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+constexpr uint64_t ALL_USED = ~0ull;
+
+// Mascara con los bits [from, 64) encendidos
+inline uint64_t maskFrom(size_t from) { return from >= 64 ? 0 : ALL_USED << from; }
+}
+
+void BlockAllocator::reset(size_t blockCount, size_t bytesPerChunk) {
+    this->blockCount = blockCount;
+    this->bytesPerChunk = bytesPerChunk;
+
+    size_t wordCount = (blockCount + 63) / 64;
+    words.assign(wordCount, 0);
+
+    summaryCount = (wordCount + 63) / 64;
+    fullWords.reset(new std::atomic<uint64_t>[summaryCount]);
+    for (size_t i = 0; i < summaryCount; i++) fullWords[i].store(0, std::memory_order_relaxed);
+
+    wordsPerStripe = std::max<size_t>(bytesPerChunk / sizeof(uint64_t), 1);
+    stripeCount = (wordCount + wordsPerStripe - 1) / wordsPerStripe;
+    stripes.reset(new Stripe[stripeCount]);
+
+    freeCount = wordCount * 64;
+    cursor = 0;
+
+    // Los bits sobrantes de la ultima palabra quedan siempre ocupados
+    if (blockCount % 64 != 0) {
+        updateWord(wordCount - 1, maskFrom(blockCount % 64));
+    }
+}
+
+size_t BlockAllocator::stripeEnd(size_t stripe) const {
+    return std::min((stripe + 1) * wordsPerStripe * 64, blockCount);
+}
+
+void BlockAllocator::lockStripes(size_t first, size_t last) const {
+    for (size_t s = first; s <= last; s++) stripes[s].mutex.lock();
+}
+
+void BlockAllocator::unlockStripes(size_t first, size_t last) const {
+    for (size_t s = last + 1; s > first; s--) stripes[s - 1].mutex.unlock();
+}
+
+bool BlockAllocator::isFree(size_t block) const {
+    if (block >= blockCount) return false;
+
+    std::lock_guard<std::mutex> lock(stripes[stripeOf(block)].mutex);
+    return (words[block / 64] & (1ull << (block % 64))) == 0;
+}
+
+void BlockAllocator::markUsed(size_t first, size_t count) {
+    size_t end = std::min(first + count, blockCount);
+    if (first >= end) return;
+
+    lockStripes(stripeOf(first), stripeOf(end - 1));
+    setRange(first, end, true);
+    unlockStripes(stripeOf(first), stripeOf(end - 1));
+}
+
+void BlockAllocator::markFree(size_t first, size_t count) {
+    size_t end = std::min(first + count, blockCount);
+    if (first >= end) return;
+
+    lockStripes(stripeOf(first), stripeOf(end - 1));
+    setRange(first, end, false);
+    unlockStripes(stripeOf(first), stripeOf(end - 1));
+}
+
+void BlockAllocator::setRange(size_t first, size_t end, bool used) {
+    for (size_t b = first; b < end;) {
+        size_t bit = b % 64;
+        size_t n = std::min<size_t>(64 - bit, end - b);
+        uint64_t mask = (n == 64 ? ALL_USED : ((1ull << n) - 1)) << bit;
+        updateWord(b / 64, used ? (words[b / 64] | mask) : (words[b / 64] & ~mask));
+        b += n;
+    }
+}
+
+int64_t BlockAllocator::allocate() {
+    if (getFreeCount() == 0) return NONE;
+
+    size_t from = cursor.load(std::memory_order_relaxed);
+    if (from >= blockCount) from = 0;
+    size_t first = stripeOf(from);
+
+    // Se recorren las franjas desde la del cursor; la ultima vuelta revisa el inicio de esa misma
+    for (size_t i = 0; i <= stripeCount; i++) {
+        size_t s = (first + i) % stripeCount;
+        size_t begin = (i == 0) ? from : s * wordsPerStripe * 64;
+
+        std::lock_guard<std::mutex> lock(stripes[s].mutex);
+        int64_t block = findFree(begin, stripeEnd(s));
+        if (block == NONE) continue;
+
+        setRange(block, block + 1, true);
+        cursor.store(block + 1, std::memory_order_relaxed);
+        noteSearch(i + 1);
+        return block;
+    }
+    noteSearch(stripeCount + 1);
+    return NONE;
+}
+
+int64_t BlockAllocator::allocateContiguous(size_t count) {
+    if (count == 0 || count > getFreeCount()) return NONE;
+
+    // Los pasos son los huecos revisados
+    uint64_t steps = 0;
+
+    // Primero dentro de una sola franja, que solo bloquea esa franja
+    if (count <= wordsPerStripe * 64) {
+        for (size_t s = 0; s < stripeCount; s++) {
+            std::lock_guard<std::mutex> lock(stripes[s].mutex);
+
+            size_t end = stripeEnd(s);
+            int64_t start = findFree(s * wordsPerStripe * 64, end);
+            while (start != NONE) {
+                steps++;
+                size_t used = findUsed(start, end);
+                if (used - start >= count) {
+                    setRange(start, start + count, true);
+                    cursor.store(start + count, std::memory_order_relaxed);
+                    noteSearch(steps);
+                    return start;
+                }
+                start = findFree(used, end);
+            }
+        }
+    }
+
+    // Un hueco que cruza franjas necesita el mapa entero
+    int64_t result = NONE;
+    lockStripes(0, stripeCount - 1);
+
+    int64_t start = findFree(0, blockCount);
+    while (start != NONE) {
+        steps++;
+        size_t used = findUsed(start, blockCount);
+        if (used - start >= count) {
+            setRange(start, start + count, true);
+            cursor.store(start + count, std::memory_order_relaxed);
+            result = start;
+            break;
+        }
+        start = findFree(used, blockCount);
+    }
+
+    unlockStripes(0, stripeCount - 1);
+    noteSearch(steps);
+    return result;
+}
+
+size_t BlockAllocator::allocateExtent(size_t maxCount, int64_t &start) {
+    start = NONE;
+    if (maxCount == 0 || getFreeCount() == 0) return 0;
+
+    size_t from = cursor.load(std::memory_order_relaxed);
+    if (from >= blockCount) from = 0;
+    size_t first = stripeOf(from);
+
+    for (size_t i = 0; i <= stripeCount; i++) {
+        size_t s = (first + i) % stripeCount;
+        size_t begin = (i == 0) ? from : s * wordsPerStripe * 64;
+        size_t end = stripeEnd(s);
+
+        std::lock_guard<std::mutex> lock(stripes[s].mutex);
+        start = findFree(begin, end);
+        if (start == NONE) continue;
+
+        size_t length = std::min(findUsed(start, end) - start, maxCount);
+        setRange(start, start + length, true);
+        cursor.store(start + length, std::memory_order_relaxed);
+        noteSearch(i + 1);
+        return length;
+    }
+    noteSearch(stripeCount + 1);
+    return 0;
+}
+
+int64_t BlockAllocator::findFree(size_t from, size_t end) const {
+    if (from >= end) return NONE;
+
+    size_t word = from / 64;
+    uint64_t bits = ~words[word] & maskFrom(from % 64);
+    if (bits) {
+        size_t block = word * 64 + __builtin_ctzll(bits);
+        return block < end ? static_cast<int64_t>(block) : NONE;
+    }
+
+    // Se recorre el resumen para saltar 64 palabras llenas de una vez
+    size_t lastWord = (end + 63) / 64;
+    for (size_t w = word + 1; w < lastWord;) {
+        size_t s = w / 64;
+        uint64_t candidates = ~fullWords[s].load(std::memory_order_relaxed) & maskFrom(w % 64);
+        if (candidates) {
+            size_t found = s * 64 + __builtin_ctzll(candidates);
+            if (found >= lastWord) return NONE;
+
+            size_t block = found * 64 + __builtin_ctzll(~words[found]);
+            return block < end ? static_cast<int64_t>(block) : NONE;
+        }
+        w = (s + 1) * 64;
+    }
+    return NONE;
+}
+
+size_t BlockAllocator::findUsed(size_t from, size_t end) const {
+    if (from >= end) return end;
+
+    size_t word = from / 64;
+    uint64_t bits = words[word] & maskFrom(from % 64);
+    while (!bits) {
+        if (++word * 64 >= end) return end;
+        bits = words[word];
+    }
+    return std::min(word * 64 + __builtin_ctzll(bits), end);
+}
+
+void BlockAllocator::updateWord(size_t word, uint64_t value) {
+    uint64_t old = words[word];
+    if (old == value) return;
+
+    freeCount.fetch_add(__builtin_popcountll(old), std::memory_order_relaxed);
+    freeCount.fetch_sub(__builtin_popcountll(value), std::memory_order_relaxed);
+    words[word] = value;
+
+    // Varias franjas comparten una palabra del resumen, por eso se actualiza atomicamente
+    uint64_t fullBit = 1ull << (word % 64);
+    if (value == ALL_USED) fullWords[word / 64].fetch_or(fullBit, std::memory_order_relaxed);
+    else fullWords[word / 64].fetch_and(~fullBit, std::memory_order_relaxed);
+
+    stripes[word / wordsPerStripe].dirty = true;
+}
+
+size_t BlockAllocator::chunkBytes(size_t chunk) const {
+    return std::min(bytesPerChunk, words.size() * sizeof(uint64_t) - chunk * bytesPerChunk);
+}
+
+void BlockAllocator::resetSearchStats() {
+    searches.store(0, std::memory_order_relaxed);
+    searchSteps.store(0, std::memory_order_relaxed);
+}
+
+bool BlockAllocator::isChunkDirty(size_t chunk) const {
+    std::lock_guard<std::mutex> lock(stripes[chunk].mutex);
+    return stripes[chunk].dirty;
+}
+
+void BlockAllocator::getChunk(size_t chunk, char *dst) const {
+    std::lock_guard<std::mutex> lock(stripes[chunk].mutex);
+
+    size_t len = chunkBytes(chunk);
+    std::memcpy(dst, reinterpret_cast<const char *>(words.data()) + chunk * bytesPerChunk, len);
+    std::memset(dst + len, 0, bytesPerChunk - len);
+}
+
+bool BlockAllocator::takeChunk(size_t chunk, char *dst) {
+    std::lock_guard<std::mutex> lock(stripes[chunk].mutex);
+    if (!stripes[chunk].dirty) return false;
+
+    size_t len = chunkBytes(chunk);
+    std::memcpy(dst, reinterpret_cast<const char *>(words.data()) + chunk * bytesPerChunk, len);
+    std::memset(dst + len, 0, bytesPerChunk - len);
+    stripes[chunk].dirty = false;
+    return true;
+}
+
+void BlockAllocator::setChunk(size_t chunk, const char *src) {
+    std::lock_guard<std::mutex> lock(stripes[chunk].mutex);
+
+    size_t len = chunkBytes(chunk);
+    size_t firstWord = chunk * bytesPerChunk / sizeof(uint64_t);
+    for (size_t i = 0; i < len / sizeof(uint64_t); i++) {
+        uint64_t value;
+        std::memcpy(&value, src + i * sizeof(uint64_t), sizeof(uint64_t));
+        updateWord(firstWord + i, value);
+    }
+
+    size_t last = words.size() - 1;
+    if (blockCount % 64 != 0 && last / wordsPerStripe == chunk) {
+        updateWord(last, words[last] | maskFrom(blockCount % 64));
+    }
+}
+
+void BlockAllocator::clearDirty() {
+    for (size_t s = 0; s < stripeCount; s++) {
+        std::lock_guard<std::mutex> lock(stripes[s].mutex);
+        stripes[s].dirty = false;
+    }
+}
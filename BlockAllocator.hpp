@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+// Mapa de bloques libres empaquetado en palabras de 64 bits (bit en 1 = ocupado).
+// Un segundo nivel marca las palabras llenas para saltarlas sin leerlas, asi que
+// buscar un bloque libre no se degrada cuando el device se va llenando.
+// El mapa se divide en franjas (una por trozo persistido) con su propio mutex:
+// los hilos que asignan en franjas distintas no se bloquean entre si.
+class BlockAllocator
+{
+public:
+    static constexpr int64_t NONE = -1;
+
+    // bytesPerChunk: tamaño de los trozos que se persisten (un bloque del device)
+    void reset(size_t blockCount, size_t bytesPerChunk);
+
+    bool isFree(size_t block) const;
+    size_t getFreeCount() const { return freeCount.load(std::memory_order_relaxed); }
+    size_t getBlockCount() const { return blockCount; }
+
+    void markUsed(size_t first, size_t count);
+    void markFree(size_t first, size_t count);
+
+    // Siguiente bloque libre a partir del ultimo asignado (next-fit)
+    int64_t allocate();
+    // Primer hueco de exactamente count bloques contiguos (first-fit)
+    int64_t allocateContiguous(size_t count);
+    // Asigna el primer hueco libre desde el cursor, hasta maxCount bloques; devuelve el largo.
+    // El hueco no cruza el limite de una franja
+    size_t allocateExtent(size_t maxCount, int64_t &start);
+
+    // Persistencia: el mapa se guarda como bytes de las palabras, por trozos
+    size_t getChunkCount() const { return stripeCount; }
+    bool isChunkDirty(size_t chunk) const;
+    void getChunk(size_t chunk, char *dst) const;
+    void setChunk(size_t chunk, const char *src);
+    // Copia el trozo y lo marca limpio en un solo paso; false si no estaba sucio
+    bool takeChunk(size_t chunk, char *dst);
+    void clearDirty();
+
+    // Para estadisticas: busquedas de espacio y franjas (o huecos) revisados en ellas
+    uint64_t getSearches() const { return searches.load(std::memory_order_relaxed); }
+    uint64_t getSearchSteps() const { return searchSteps.load(std::memory_order_relaxed); }
+    void resetSearchStats();
+
+private:
+    struct Stripe
+    {
+        mutable std::mutex mutex;
+        bool dirty = true;
+    };
+
+    std::vector<uint64_t> words;
+    std::unique_ptr<std::atomic<uint64_t>[]> fullWords; // bit en 1 = la palabra correspondiente esta llena
+    size_t summaryCount = 0;
+    std::unique_ptr<Stripe[]> stripes;
+    size_t stripeCount = 0;
+    size_t wordsPerStripe = 0;
+    size_t blockCount = 0;
+    size_t bytesPerChunk = 0;
+    std::atomic<size_t> freeCount{0};
+    std::atomic<size_t> cursor{0};
+    std::atomic<uint64_t> searches{0};
+    std::atomic<uint64_t> searchSteps{0};
+
+    void noteSearch(uint64_t steps) {
+        searches.fetch_add(1, std::memory_order_relaxed);
+        searchSteps.fetch_add(steps, std::memory_order_relaxed);
+    }
+
+    size_t stripeOf(size_t block) const { return block / 64 / wordsPerStripe; }
+    size_t stripeEnd(size_t stripe) const;
+
+    // Bloquea las franjas [first, last] en orden creciente para no interbloquearse
+    void lockStripes(size_t first, size_t last) const;
+    void unlockStripes(size_t first, size_t last) const;
+
+    int64_t findFree(size_t from, size_t end) const;
+    size_t findUsed(size_t from, size_t end) const;
+    void updateWord(size_t word, uint64_t value);
+    void setRange(size_t first, size_t end, bool used);
+    size_t chunkBytes(size_t chunk) const;
+};
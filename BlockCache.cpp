@@ -0,0 +1,462 @@
+#include "BlockCache.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+BlockRef &BlockRef::operator=(BlockRef &&other) noexcept {
+    if (this != &other) {
+        release();
+        cache = other.cache;
+        block = other.block;
+        ptr = other.ptr;
+        len = other.len;
+        other.cache = nullptr;
+        other.ptr = nullptr;
+        other.len = 0;
+    }
+    return *this;
+}
+
+void BlockRef::release() {
+    if (cache) cache->unpin(block);
+    cache = nullptr;
+    ptr = nullptr;
+    len = 0;
+}
+
+void BlockCache::configure(size_t blockSize, size_t capacity, EvictionPolicy policy, Loader loader, Writer writer,
+                           size_t shards) {
+    this->blockSize = blockSize;
+    this->policy = policy;
+    this->loader = std::move(loader);
+    this->writer = std::move(writer);
+
+    shardCount = std::max<size_t>(shards, 1);
+    this->shards.reset(new Shard[shardCount]);
+
+    // Algunas operaciones fijan varios bloques a la vez; cada shard debe tener espacio para cargar otro
+    size_t perShard = std::max(MIN_CAPACITY, (capacity + shardCount - 1) / shardCount);
+    for (size_t i = 0; i < shardCount; i++) {
+        this->shards[i].owner = this;
+        this->shards[i].configure(perShard);
+    }
+}
+
+bool BlockCache::read(size_t blockNumber, char *dst) {
+    Shard &shard = shardFor(blockNumber);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    size_t frame = shard.getFrame(blockNumber, true);
+    if (frame == NONE) return false;
+
+    std::memcpy(dst, shard.frameData(frame), blockSize);
+    return true;
+}
+
+bool BlockCache::peek(size_t blockNumber, char *dst) {
+    Shard &shard = shardFor(blockNumber);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    size_t frame = shard.lookup(blockNumber);
+    if (frame == NONE) {
+        shard.misses++;
+        return false;
+    }
+
+    shard.hits++;
+    shard.touch(frame);
+    std::memcpy(dst, shard.frameData(frame), blockSize);
+    return true;
+}
+
+bool BlockCache::write(size_t blockNumber, const char *src, size_t len, size_t offset) {
+    if (offset + len > blockSize) return false;
+
+    Shard &shard = shardFor(blockNumber);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // Una escritura parcial necesita el contenido actual del bloque
+    size_t frame = shard.getFrame(blockNumber, len < blockSize);
+    if (frame == NONE) return false;
+
+    std::memcpy(shard.frameData(frame) + offset, src, len);
+    if (!shard.frames[frame].dirty) {
+        shard.frames[frame].dirty = true;
+        shard.dirtyCount++;
+    }
+    return true;
+}
+
+BlockRef BlockCache::pin(size_t blockNumber) {
+    Shard &shard = shardFor(blockNumber);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    size_t frame = shard.getFrame(blockNumber, true);
+    if (frame == NONE) return BlockRef();
+
+    shard.frames[frame].pins++;
+    return BlockRef(this, blockNumber, shard.frameData(frame), blockSize);
+}
+
+BlockRef BlockCache::pinIfPresent(size_t blockNumber) {
+    Shard &shard = shardFor(blockNumber);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    size_t frame = shard.lookup(blockNumber);
+    if (frame == NONE) {
+        shard.misses++;
+        return BlockRef();
+    }
+
+    shard.hits++;
+    shard.touch(frame);
+    shard.frames[frame].pins++;
+    return BlockRef(this, blockNumber, shard.frameData(frame), blockSize);
+}
+
+void BlockCache::unpin(size_t blockNumber) {
+    Shard &shard = shardFor(blockNumber);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    size_t frame = shard.lookup(blockNumber);
+    if (frame != NONE && shard.frames[frame].pins > 0) shard.frames[frame].pins--;
+}
+
+template <typename Fn>
+void BlockCache::forEachCached(size_t index, size_t first, size_t count, Fn fn) {
+    Shard &shard = shards[index];
+    if (shard.used == 0) return;
+
+    // Primer bloque del rango que cae en este shard, y cuantos le tocan
+    size_t end = first + count;
+    size_t start = first + (index + shardCount - first % shardCount) % shardCount;
+    size_t owned = start < end ? (end - start + shardCount - 1) / shardCount : 0;
+
+    // Se recorre lo que sea mas corto: el rango o la cache
+    if (owned <= shard.used) {
+        for (size_t b = start; b < end; b += shardCount) {
+            size_t frame = shard.lookup(b);
+            if (frame != NONE) fn(frame, b);
+        }
+    } else {
+        for (size_t i = 0; i < shard.frames.size(); i++) {
+            size_t b = shard.frames[i].block;
+            if (b != NONE && b >= first && b < end) fn(i, b);
+        }
+    }
+}
+
+void BlockCache::overlay(size_t first, size_t count, char *dst, std::vector<bool> *covered) {
+    for (size_t s = 0; s < shardCount; s++) {
+        Shard &shard = shards[s];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        forEachCached(s, first, count, [&](size_t frame, size_t b) {
+            std::memcpy(dst + (b - first) * blockSize, shard.frameData(frame), blockSize);
+            if (covered) (*covered)[b - first] = true;
+        });
+    }
+}
+
+void BlockCache::discard(size_t first, size_t count, const char *src) {
+    for (size_t s = 0; s < shardCount; s++) {
+        Shard &shard = shards[s];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        // Un bloque fijado no se suelta: se le copia el contenido nuevo para que la vista siga valida
+        forEachCached(s, first, count, [&](size_t frame, size_t b) {
+            if (shard.frames[frame].pins == 0) {
+                shard.dropFrame(frame);
+                return;
+            }
+            if (src) std::memcpy(shard.frameData(frame), src + (b - first) * blockSize, blockSize);
+            else std::memset(shard.frameData(frame), 0, blockSize);
+            if (shard.frames[frame].dirty) {
+                shard.frames[frame].dirty = false;
+                shard.dirtyCount--;
+            }
+        });
+    }
+}
+
+bool BlockCache::sync() {
+    bool ok = true;
+    for (size_t s = 0; s < shardCount; s++) {
+        Shard &shard = shards[s];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        for (size_t i = 0; i < shard.frames.size() && shard.dirtyCount > 0; i++) {
+            if (shard.frames[i].block != NONE && shard.frames[i].dirty) {
+                ok = shard.flushFrame(i) && ok;
+            }
+        }
+    }
+    return ok;
+}
+
+void BlockCache::collectDirty(std::vector<uint64_t> &blocks, std::vector<char> &images) {
+    for (size_t s = 0; s < shardCount; s++) {
+        Shard &shard = shards[s];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        for (size_t i = 0; i < shard.frames.size() && shard.dirtyCount > 0; i++) {
+            if (shard.frames[i].block == NONE || !shard.frames[i].dirty) continue;
+
+            blocks.push_back(shard.frames[i].block);
+            const char *data = shard.frameData(i);
+            images.insert(images.end(), data, data + blockSize);
+        }
+    }
+}
+
+void BlockCache::markClean() {
+    for (size_t s = 0; s < shardCount; s++) {
+        Shard &shard = shards[s];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        for (size_t i = 0; i < shard.frames.size() && shard.dirtyCount > 0; i++) {
+            if (shard.frames[i].dirty) {
+                shard.frames[i].dirty = false;
+                shard.dirtyCount--;
+            }
+        }
+    }
+}
+
+void BlockCache::invalidate() {
+    for (size_t s = 0; s < shardCount; s++) {
+        std::lock_guard<std::mutex> lock(shards[s].mutex);
+        shards[s].invalidate();
+    }
+}
+
+size_t BlockCache::getCapacity() const {
+    size_t total = 0;
+    for (size_t s = 0; s < shardCount; s++) total += shards[s].frames.size();
+    return total;
+}
+
+size_t BlockCache::getDirtyCount() const {
+    size_t total = 0;
+    for (size_t s = 0; s < shardCount; s++) {
+        std::lock_guard<std::mutex> lock(shards[s].mutex);
+        total += shards[s].dirtyCount;
+    }
+    return total;
+}
+
+void BlockCache::resetCounters() {
+    for (size_t s = 0; s < shardCount; s++) {
+        std::lock_guard<std::mutex> lock(shards[s].mutex);
+        shards[s].hits = 0;
+        shards[s].misses = 0;
+    }
+}
+
+uint64_t BlockCache::getHits() const {
+    uint64_t total = 0;
+    for (size_t s = 0; s < shardCount; s++) {
+        std::lock_guard<std::mutex> lock(shards[s].mutex);
+        total += shards[s].hits;
+    }
+    return total;
+}
+
+uint64_t BlockCache::getMisses() const {
+    uint64_t total = 0;
+    for (size_t s = 0; s < shardCount; s++) {
+        std::lock_guard<std::mutex> lock(shards[s].mutex);
+        total += shards[s].misses;
+    }
+    return total;
+}
+
+void BlockCache::Shard::configure(size_t capacity) {
+    frames.assign(capacity, Frame());
+    buffer.assign(capacity * owner->blockSize, 0);
+
+    size_t tableSize = 1;
+    while (tableSize < capacity * 2) tableSize *= 2;
+    table.assign(tableSize, NONE);
+
+    freeFrames.reserve(capacity);
+    invalidate();
+    hits = misses = 0;
+}
+
+void BlockCache::Shard::invalidate() {
+    for (size_t i = 0; i < frames.size(); i++) {
+        frames[i] = Frame();
+    }
+    std::fill(table.begin(), table.end(), NONE);
+
+    freeFrames.clear();
+    for (size_t i = frames.size(); i > 0; i--) {
+        freeFrames.push_back(i - 1);
+    }
+
+    used = 0;
+    lruHead = lruTail = NONE;
+    clockHand = 0;
+    dirtyCount = 0;
+}
+
+void BlockCache::Shard::dropFrame(size_t frame) {
+    if (frames[frame].dirty) dirtyCount--;
+    tableErase(frames[frame].block);
+    if (owner->policy == EvictionPolicy::LRU) unlink(frame);
+    frames[frame] = Frame();
+    freeFrames.push_back(frame);
+    used--;
+}
+
+size_t BlockCache::Shard::slotOf(size_t blockNumber) const {
+    return (blockNumber * 0x9E3779B97F4A7C15ull >> 17) & (table.size() - 1);
+}
+
+size_t BlockCache::Shard::lookup(size_t blockNumber) const {
+    if (table.empty()) return NONE;
+
+    size_t mask = table.size() - 1;
+    for (size_t i = slotOf(blockNumber); table[i] != NONE; i = (i + 1) & mask) {
+        if (frames[table[i]].block == blockNumber) return table[i];
+    }
+    return NONE;
+}
+
+void BlockCache::Shard::tableInsert(size_t blockNumber, size_t frame) {
+    size_t mask = table.size() - 1;
+    size_t i = slotOf(blockNumber);
+    while (table[i] != NONE) i = (i + 1) & mask;
+    table[i] = frame;
+}
+
+void BlockCache::Shard::tableErase(size_t blockNumber) {
+    size_t mask = table.size() - 1;
+    size_t i = slotOf(blockNumber);
+    while (table[i] != NONE && frames[table[i]].block != blockNumber) i = (i + 1) & mask;
+    if (table[i] == NONE) return;
+
+    // Se corren hacia atras las entradas siguientes para no dejar huecos en su cadena
+    table[i] = NONE;
+    for (size_t j = (i + 1) & mask; table[j] != NONE; j = (j + 1) & mask) {
+        size_t home = slotOf(frames[table[j]].block);
+        bool movable = (i <= j) ? (home <= i || home > j) : (home <= i && home > j);
+        if (movable) {
+            table[i] = table[j];
+            table[j] = NONE;
+            i = j;
+        }
+    }
+}
+
+size_t BlockCache::Shard::getFrame(size_t blockNumber, bool load) {
+    if (frames.empty()) return NONE;
+
+    size_t found = lookup(blockNumber);
+    if (found != NONE) {
+        hits++;
+        touch(found);
+        return found;
+    }
+
+    misses++;
+
+    size_t frame;
+    if (!freeFrames.empty()) {
+        frame = freeFrames.back();
+        freeFrames.pop_back();
+    } else {
+        frame = chooseVictim();
+        if (frame == NONE) return NONE;
+        if (frames[frame].dirty && !flushFrame(frame)) return NONE;
+
+        tableErase(frames[frame].block);
+        if (owner->policy == EvictionPolicy::LRU) unlink(frame);
+        frames[frame] = Frame();
+        used--;
+    }
+
+    if (load) {
+        if (!owner->loader(blockNumber, frameData(frame))) {
+            freeFrames.push_back(frame);
+            return NONE;
+        }
+    } else {
+        std::memset(frameData(frame), 0, owner->blockSize);
+    }
+
+    frames[frame].block = blockNumber;
+    tableInsert(blockNumber, frame);
+    used++;
+
+    if (owner->policy == EvictionPolicy::LRU) {
+        pushFront(frame);
+    } else {
+        frames[frame].referenced = true;
+    }
+
+    return frame;
+}
+
+size_t BlockCache::Shard::chooseVictim() {
+    if (owner->policy == EvictionPolicy::LRU) {
+        size_t frame = lruTail;
+        while (frame != NONE && frames[frame].pins > 0) frame = frames[frame].prev;
+        return frame;
+    }
+
+    // CLOCK: la manecilla da una segunda oportunidad a los bloques referenciados;
+    // dos vueltas completas sin exito significan que todo esta fijado
+    for (size_t steps = 0; steps < frames.size() * 2; steps++) {
+        Frame &f = frames[clockHand];
+        size_t current = clockHand;
+        clockHand = (clockHand + 1) % frames.size();
+
+        if (f.pins > 0) continue;
+        if (!f.referenced) return current;
+        f.referenced = false;
+    }
+    return NONE;
+}
+
+bool BlockCache::Shard::flushFrame(size_t frame) {
+    if (!owner->writer(frames[frame].block, frameData(frame))) return false;
+
+    frames[frame].dirty = false;
+    dirtyCount--;
+    return true;
+}
+
+void BlockCache::Shard::touch(size_t frame) {
+    if (owner->policy == EvictionPolicy::LRU) {
+        if (lruHead == frame) return;
+        unlink(frame);
+        pushFront(frame);
+    } else {
+        frames[frame].referenced = true;
+    }
+}
+
+void BlockCache::Shard::unlink(size_t frame) {
+    Frame &f = frames[frame];
+
+    if (f.prev != NONE) frames[f.prev].next = f.next;
+    else lruHead = f.next;
+
+    if (f.next != NONE) frames[f.next].prev = f.prev;
+    else lruTail = f.prev;
+
+    f.prev = f.next = NONE;
+}
+
+void BlockCache::Shard::pushFront(size_t frame) {
+    Frame &f = frames[frame];
+    f.prev = NONE;
+    f.next = lruHead;
+
+    if (lruHead != NONE) frames[lruHead].prev = frame;
+    lruHead = frame;
+
+    if (lruTail == NONE) lruTail = frame;
+}
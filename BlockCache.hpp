@@ -0,0 +1,161 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+enum class EvictionPolicy
+{
+    LRU,
+    CLOCK
+};
+
+class BlockCache;
+
+// Vista de solo lectura sobre un bloque. Si viene de la cache, el bloque queda
+// fijado (no se desaloja) hasta que la vista se destruye.
+class BlockRef
+{
+public:
+    BlockRef() = default;
+    BlockRef(BlockCache *cache, size_t block, const char *data, size_t size)
+        : cache(cache), block(block), ptr(data), len(size) {}
+    BlockRef(const BlockRef &) = delete;
+    BlockRef &operator=(const BlockRef &) = delete;
+    BlockRef(BlockRef &&other) noexcept { *this = std::move(other); }
+    BlockRef &operator=(BlockRef &&other) noexcept;
+    ~BlockRef() { release(); }
+
+    const char *data() const { return ptr; }
+    size_t size() const { return len; }
+    explicit operator bool() const { return ptr != nullptr; }
+
+    void release();
+
+private:
+    BlockCache *cache = nullptr;
+    size_t block = 0;
+    const char *ptr = nullptr;
+    size_t len = 0;
+};
+
+// Cache de bloques de capacidad fija con write-back.
+// Los bloques sucios solo llegan al disco al ser desalojados o en sync().
+// Toda la memoria se reserva en configure(): leer no hace asignaciones.
+// Se reparte en shards (bloque % shards) con un mutex cada uno, para que los
+// hilos que tocan bloques distintos no compitan por el mismo candado.
+class BlockCache
+{
+public:
+    static constexpr size_t MIN_CAPACITY = 8;
+
+    using Loader = std::function<bool(size_t, char *)>;
+    using Writer = std::function<bool(size_t, const char *)>;
+
+    void configure(size_t blockSize, size_t capacity, EvictionPolicy policy, Loader loader, Writer writer,
+                   size_t shards = 1);
+
+    bool read(size_t blockNumber, char *dst);
+    // Copia el bloque solo si ya esta en cache; no carga ni desaloja nada
+    bool peek(size_t blockNumber, char *dst);
+    // Escribe len bytes a partir de offset dentro del bloque
+    bool write(size_t blockNumber, const char *src, size_t len, size_t offset = 0);
+
+    // Vistas fijadas; pinIfPresent no carga el bloque si no esta en cache
+    BlockRef pin(size_t blockNumber);
+    BlockRef pinIfPresent(size_t blockNumber);
+    void unpin(size_t blockNumber);
+
+    // Para E/S directa de tramos: copia sobre dst los bloques del rango que esten
+    // en cache (marcandolos en covered si se pasa), y descarta los que ya se escribieron
+    // en el disco con el contenido src (sin src, el rango quedo en ceros)
+    void overlay(size_t first, size_t count, char *dst, std::vector<bool> *covered = nullptr);
+    void discard(size_t first, size_t count, const char *src);
+
+    bool sync();
+    void invalidate();
+
+    // Para el journal: copia los bloques sucios (destino e imagen) sin limpiarlos,
+    // y los marca limpios una vez que la transaccion ya esta en su lugar
+    void collectDirty(std::vector<uint64_t> &blocks, std::vector<char> &images);
+    void markClean();
+
+    size_t getCapacity() const;
+    size_t getShardCount() const { return shardCount; }
+    size_t getDirtyCount() const;
+    uint64_t getHits() const;
+    uint64_t getMisses() const;
+    void resetCounters();
+    EvictionPolicy getPolicy() const { return policy; }
+
+private:
+    static constexpr size_t NONE = static_cast<size_t>(-1);
+
+    struct Frame
+    {
+        size_t block = NONE;
+        bool dirty = false;
+        bool referenced = false;
+        uint32_t pins = 0;
+        size_t prev = NONE; // Lista LRU: hacia el mas reciente
+        size_t next = NONE; // Lista LRU: hacia el menos reciente
+    };
+
+    // Cada shard es una cache completa; sus miembros solo se tocan con su mutex tomado
+    struct Shard
+    {
+        mutable std::mutex mutex;
+        const BlockCache *owner = nullptr;
+
+        std::vector<Frame> frames;
+        std::vector<char> buffer;
+        std::vector<size_t> freeFrames;
+        size_t used = 0;
+
+        // Tabla bloque -> frame con sondeo lineal y borrado por desplazamiento
+        std::vector<size_t> table;
+
+        size_t lruHead = NONE; // Mas reciente
+        size_t lruTail = NONE; // Menos reciente
+        size_t clockHand = 0;
+        size_t dirtyCount = 0;
+
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+
+        void configure(size_t capacity);
+        void invalidate();
+
+        char *frameData(size_t frame) { return buffer.data() + frame * owner->blockSize; }
+
+        size_t slotOf(size_t blockNumber) const;
+        size_t lookup(size_t blockNumber) const;
+        void tableInsert(size_t blockNumber, size_t frame);
+        void tableErase(size_t blockNumber);
+
+        size_t getFrame(size_t blockNumber, bool load);
+        size_t chooseVictim();
+        bool flushFrame(size_t frame);
+        void dropFrame(size_t frame);
+        void touch(size_t frame);
+        void unlink(size_t frame);
+        void pushFront(size_t frame);
+    };
+
+    size_t blockSize = 0;
+    EvictionPolicy policy = EvictionPolicy::LRU;
+    Loader loader;
+    Writer writer;
+
+    std::unique_ptr<Shard[]> shards;
+    size_t shardCount = 0;
+
+    Shard &shardFor(size_t blockNumber) { return shards[blockNumber % shardCount]; }
+
+    // Aplica fn(frame, bloque) a los bloques del rango que esten en el shard index
+    template <typename Fn>
+    void forEachCached(size_t index, size_t first, size_t count, Fn fn);
+};
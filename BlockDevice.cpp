@@ -1,397 +1,3629 @@
 #include "BlockDevice.hpp"
+#include "Compression.hpp"
+#include "Console.hpp"
+#include <cstdio>
+#include <thread>
 
 
 int64_t BlockDevice::buscarInodo(const std::string &filename) {
-    for (size_t block = superblock.inodesInitialBlockPos; block < superblock.inodesInitialBlockPos + getBlockCount(); block++) {
-        std::vector<char> rawData = readBlock(block);
-        if (rawData.empty()) continue;
+    size_t probes = 0;
+    int64_t offset = InodeIndex::ROOT;
 
-        size_t inodesPerBlock = getBlockSize() / sizeof(Inodo);
-
-        for (size_t i = 0; i < inodesPerBlock; i++) {
-            Inodo inode;
-            std::memcpy(&inode, &rawData[i * sizeof(Inodo)], sizeof(Inodo));
+    // Un nombre sin barras esta en la raiz: no hace falta partirlo
+    if (filename.find('/') == std::string::npos && filename[0] != '@') {
+        offset = index.find(InodeIndex::ROOT, filename, &probes);
+    } else {
+        std::vector<std::string> parts;
+        if (!splitPath(filename, parts) || parts.empty()) return -1;
 
-            if (!inode.free && filename == inode.name) {
-                return block * getBlockSize() + i * sizeof(Inodo);
-            }
+        for (size_t i = 0; i < parts.size(); i++) {
+            if (i == 0 && parts[0][0] == '@') offset = index.find(InodeIndex::SNAPSHOTS, parts[0].substr(1), &probes);
+            else offset = index.find(offset, parts[i], &probes);
+            if (offset == -1) break;
         }
     }
 
-    return -1;
+    stats.add(StatCounter::INODE_LOOKUPS);
+    stats.add(StatCounter::INODE_PROBES, probes);
+    return offset;
 }
 
-Inodo BlockDevice::readInode(int64_t offset) {
-    Inodo inode;
-    file.seekg(offset, std::ios::beg);
-    file.read(reinterpret_cast<char *>(&inode), sizeof(Inodo));
-    return inode;
+int64_t BlockDevice::lookupShared(const std::string &filename, std::shared_lock<std::shared_mutex> &inodeGuard) {
+    std::shared_lock<std::shared_mutex> names(namespaceMutex);
+
+    int64_t offset = buscarInodo(filename);
+    if (offset == -1) return -1;
+
+    // El inodo se lee con su lock tomado: un escritor puede estar reescribiendolo
+    inodeGuard = std::shared_lock<std::shared_mutex>(inodeLock(offset));
+    if (readInode(offset).isDirectory()) {
+        inodeGuard = std::shared_lock<std::shared_mutex>();
+        return -1;
+    }
+    return offset;
 }
 
+// Deshace la reserva de un archivo nuevo cuya escritura fallo
+void BlockDevice::dropReservation(const std::string &filename, int64_t offset) {
+    std::unique_lock<std::shared_mutex> names(namespaceMutex);
+    std::string leaf;
+    int64_t parent = resolveParent(filename, leaf);
+    if (parent == -1 || index.find(parent, leaf) != offset) return;
 
-void BlockDevice::writeInode(int64_t offset, const Inodo &inode) {
-    file.seekp(offset, std::ios::beg);
-    file.write(reinterpret_cast<const char *>(&inode), sizeof(Inodo));
+    std::unique_lock<std::shared_mutex> guard(inodeLock(offset));
+
+    // Si otro hilo ya escribio el archivo mientras tanto, se respeta su contenido
+    Inodo inode = readInode(offset);
+    if (inode.size != 0 || inode.extents[0].start != -1) return;
+
+    inode.free = true;
+    writeInode(offset, inode);
+    removeEntry(parent, leaf);
+    releaseInode(offset);
 }
 
-size_t BlockDevice::buscarInodoLibre() {
-    size_t inodesPerBlock = getBlockSize() / sizeof(Inodo);
-    for (size_t block = superblock.inodesInitialBlockPos; block < getBlockCount(); ++block) {
-        std::vector<Inodo> inodes(inodesPerBlock);
-        auto rawData = readBlock(block);
+void BlockDevice::rebuildIndex() {
+    index.clear();
 
-        std::memcpy(inodes.data(), rawData.data(), rawData.size());
+    // Se recorren los arboles desde la raiz: solo se leen los directorios y sus entradas
+    std::vector<int64_t> pending{InodeIndex::ROOT, InodeIndex::SNAPSHOTS};
+    while (!pending.empty()) {
+        int64_t dir = pending.back();
+        pending.pop_back();
 
-        for (size_t i = 0; i < inodesPerBlock; ++i) {
-            if (inodes[i].free) return block * getBlockSize() + i * sizeof(Inodo);
+        int64_t root = directoryRoot(dir);
+        if (root == -1) continue;
+
+        directories.scan(root, "", [&](const char *name, int64_t offset) {
+            index.insert(dir, name, offset);
+            if (readInode(offset).isDirectory()) pending.push_back(offset);
+            return true;
+        });
+    }
+}
+
+bool BlockDevice::splitPath(const std::string &path, std::vector<std::string> &parts) {
+    parts.clear();
+
+    size_t pos = 0;
+    while (pos < path.size()) {
+        size_t end = path.find('/', pos);
+        if (end == std::string::npos) end = path.size();
+
+        // Se ignoran las barras repetidas; . y .. no se usan como nombres
+        if (end > pos) {
+            parts.push_back(path.substr(pos, end - pos));
+            if (parts.back() == "." || parts.back() == "..") return false;
         }
+        pos = end + 1;
     }
-    return -1;
+    return true;
 }
 
-void BlockDevice::initializeSuperblock(size_t blockSize, size_t blockCount)
-{
-    superblock.initialBlock = blockCount;
-    superblock.byteMapPos = 1;
-    superblock.inodesInitialBlockPos = 2;
-    superblock.inodesPerBlock = blockSize / sizeof(Inodo);
+bool BlockDevice::isSnapshotPath(const std::string &path) {
+    size_t first = path.find_first_not_of('/');
+    if (first == std::string::npos || path[first] != '@') return false;
 
-    this->blockSize = blockSize;
+    consoleErr() << "Error: Las instantaneas son de solo lectura.\n";
+    return true;
 }
 
-bool BlockDevice::create(const std::string &filename, size_t blockSize, size_t blockCount) {
-    file.open(filename, std::ios::out | std::ios::binary);
-    if (!file.is_open()) return false;
+int64_t BlockDevice::resolveParent(const std::string &path, std::string &leaf) {
+    std::vector<std::string> parts;
+    if (!splitPath(path, parts) || parts.empty() || parts[0][0] == '@') return -1;
 
-    initializeSuperblock(blockSize, blockCount);
+    leaf = parts.back();
+    int64_t dir = InodeIndex::ROOT;
+    for (size_t i = 0; i + 1 < parts.size(); i++) {
+        dir = index.find(dir, parts[i]);
+        if (dir == -1 || !readInode(dir).isDirectory()) return -1;
+    }
+    return dir;
+}
 
-    file.write(reinterpret_cast<const char *>(&superblock), sizeof(Superblock));
+int64_t BlockDevice::directoryRoot(int64_t dir) {
+    if (dir == InodeIndex::ROOT) return superblock.rootDirBlock != 0 ? superblock.rootDirBlock : -1;
+    if (dir == InodeIndex::SNAPSHOTS) return superblock.snapshotDirBlock != 0 ? superblock.snapshotDirBlock : -1;
 
-    freeBlockMap.resize(blockCount, true);
+    Inodo inode = readInode(dir);
+    return !inode.free && inode.isDirectory() ? inode.extents[0].start : -1;
+}
 
-    std::vector<char> emptyBlock(blockSize, 0);
-    for (size_t i = 0; i < blockCount; i++) {
-        file.write(emptyBlock.data(), emptyBlock.size());
+bool BlockDevice::addEntry(int64_t dir, const std::string &name, int64_t offset) {
+    int64_t root = directoryRoot(dir);
+    bool ok = root != -1 && directories.insert(root, name, offset);
+    // El arbol pudo tomar bloques al partirse, aunque la insercion fallara despues
+    saveBitmap();
+    if (!ok) return false;
+
+    if (dir != InodeIndex::ROOT && dir != InodeIndex::SNAPSHOTS) {
+        Inodo parent = readInode(dir);
+        parent.size++;
+        writeInode(dir, parent);
     }
-
-    file.close();
+    index.insert(dir, name, offset);
     return true;
 }
 
-bool BlockDevice::open(const std::string &filename) {
-    file.open(filename, std::ios::in | std::ios::out | std::ios::binary);
-    if (!file.is_open()) return false;
+void BlockDevice::removeEntry(int64_t dir, const std::string &name) {
+    int64_t root = directoryRoot(dir);
+    if (root != -1 && directories.erase(root, name) && dir != InodeIndex::ROOT && dir != InodeIndex::SNAPSHOTS) {
+        Inodo parent = readInode(dir);
+        if (parent.size > 0) parent.size--;
+        writeInode(dir, parent);
+    }
+    index.erase(dir, name);
+}
 
-    file.seekg(0, std::ios::beg);
-    file.read(reinterpret_cast<char *>(&superblock), sizeof(Superblock));
+bool BlockDevice::createRootDirectory() {
+    int64_t root = freeBlockMap.allocate();
+    if (root == BlockAllocator::NONE) return false;
 
-    freeBlockMap.resize(getBlockCount(), true);
+    std::vector<char> node(getBlockSize());
+    DirectoryTree::initNode(node.data(), getBlockSize());
+    cache.write(root, node.data(), node.size());
+    superblock.rootDirBlock = root;
 
-    return true;
-}
+    // Antes de los directorios todos los archivos estaban en la raiz
+    for (size_t block = superblock.inodesInitialBlockPos; block < inodeBlocksEnd(); block++) {
+        if (!inodeBlockUsed(block)) continue;
 
-bool BlockDevice::close() {
-    if (file.is_open()) {
-        file.close();
-        return true;
+        for (size_t i = 0; i < superblock.inodesPerBlock; i++) {
+            int64_t offset = block * getBlockSize() + i * sizeof(Inodo);
+            Inodo inode = readInode(offset);
+            if (inode.free || inode.name[0] == '\0') continue;
+
+            if (!directories.insert(root, inode.name, offset)) {
+                consoleErr() << "Aviso: No se pudo agregar " << inode.name << " al directorio raiz.\n";
+            }
+        }
     }
-    return false;
+
+    saveBitmap();
+    writeSuperblock();
+    return commitLocked();
 }
 
-bool BlockDevice::writeBlock(size_t blockNumber, const std::vector<char> &data) {
-    if (blockNumber >= getBlockCount() || data.size() > getBlockSize()) return false;
+Inodo BlockDevice::readInode(int64_t offset) {
+    Inodo inode;
+    BlockRef rawData = pinBlock(offset / getBlockSize());
+    if (!rawData) return inode;
 
-    file.seekp(blockNumber * getBlockSize(), std::ios::beg);
-    file.write(data.data(), data.size());
+    std::memcpy(&inode, rawData.data() + offset % getBlockSize(), sizeof(Inodo));
+    return inode;
+}
 
-    freeBlockMap[blockNumber] = false;
-    return true;
+
+void BlockDevice::writeInode(int64_t offset, const Inodo &inode) {
+    cache.write(offset / getBlockSize(), reinterpret_cast<const char *>(&inode), sizeof(Inodo), offset % getBlockSize());
 }
 
-std::vector<char> BlockDevice::read(const std::string &filename)
-{
-    if (!file.is_open()) {
-        std::cerr << "Error: File not open.\n";
-        return std::vector<char>();
+size_t BlockDevice::buscarInodoLibre() {
+    stats.add(StatCounter::INODE_ALLOCS);
+
+    // El mapa da el inodo sin recorrer la tabla; si cae en un bloque todavia sin
+    // inicializar, la tabla crece hasta cubrirlo
+    int64_t slot = inodeMap.allocate();
+    if (slot == BlockAllocator::NONE) return -1;
+
+    int64_t offset = inodeOffsetOf(slot);
+    size_t block = offset / getBlockSize();
+    while (inodeBlocksEnd() <= block) {
+        if (!growInodeTable()) {
+            inodeMap.markFree(slot, 1);
+            return -1;
+        }
     }
 
-    int64_t offset = buscarInodo(filename);
-    if (offset == -1) {
-        std::cerr << "Error: No inode found for file " << filename << ".\n";
-        return std::vector<char>();
-    }
+    saveInodeMap();
+    return offset;
+}
+
+size_t BlockDevice::getInodeSlots() const {
+    return (superblock.initialBlock - superblock.inodesInitialBlockPos) * superblock.inodesPerBlock;
+}
 
-    file.flush();
-    std::vector<char> text;
+int64_t BlockDevice::inodeOffsetOf(size_t slot) {
+    size_t block = superblock.inodesInitialBlockPos + slot / superblock.inodesPerBlock;
+    return block * getBlockSize() + slot % superblock.inodesPerBlock * sizeof(Inodo);
+}
 
-    Inodo inode;
-    file.seekg(offset, std::ios::beg);
-    file.read(reinterpret_cast<char*>(&inode), sizeof(Inodo));
+size_t BlockDevice::inodeSlotOf(int64_t offset) {
+    size_t block = offset / getBlockSize() - superblock.inodesInitialBlockPos;
+    return block * superblock.inodesPerBlock + offset % getBlockSize() / sizeof(Inodo);
+}
 
-    if (file.fail()) {
-        std::cerr << "Error: Failed to read inode at offset " << offset << ".\n";
-        return std::vector<char>();
+bool BlockDevice::inodeBlockUsed(size_t block) {
+    size_t first = (block - superblock.inodesInitialBlockPos) * superblock.inodesPerBlock;
+    for (size_t i = 0; i < superblock.inodesPerBlock; i++) {
+        if (!inodeMap.isFree(first + i)) return true;
     }
+    return false;
+}
+
+void BlockDevice::releaseInode(int64_t offset) {
+    inodeMap.markFree(inodeSlotOf(offset), 1);
+    saveInodeMap();
+}
 
-    int64_t size = inode.size;
-    size_t block = getBlockSize();
-    int i = 0;
+bool BlockDevice::loadInodeMap() {
+    inodeMap.reset(getInodeSlots(), getBitmapChunkSize());
 
-    while (size > 0) {
-        std::vector<char> line;
-        if (size > block) {
-            line = std::vector<char>(block);
-            file.seekg(inode.offset[i] * block, std::ios::beg);  
-            file.read(line.data(), block);
-            size -= block;
-        } else {
-            line = std::vector<char>(size);
-            file.seekg(inode.offset[i] * block, std::ios::beg);
-            file.read(line.data(), size);
-            size = 0;
+    if (superblock.inodeMapBlocks != 0) {
+        for (size_t i = 0; i < inodeMap.getChunkCount(); i++) {
+            BlockRef rawData = pinBlock(superblock.inodeMapPos + i);
+            if (!rawData) return false;
+            inodeMap.setChunk(i, rawData.data());
         }
+        inodeMap.clearDirty();
+        return true;
+    }
 
-        if (file.fail()) {
-            std::cerr << "Error: Failed to read block data.\n";
-            return std::vector<char>();
-        }
+    // Imagen sin mapa en disco: se arma recorriendo la parte inicializada de la tabla
+    for (size_t block = superblock.inodesInitialBlockPos; block < inodeBlocksEnd(); block++) {
+        BlockRef rawData = pinBlock(block);
+        if (!rawData) return false;
 
-        text.insert(text.end(), line.begin(), line.end());
-        i++;
+        for (size_t i = 0; i < superblock.inodesPerBlock; i++) {
+            Inodo inode;
+            std::memcpy(&inode, rawData.data() + i * sizeof(Inodo), sizeof(Inodo));
+            if (!inode.free) inodeMap.markUsed(inodeSlotOf(block * getBlockSize() + i * sizeof(Inodo)), 1);
+        }
     }
 
-    return text;
+    // Los bloques sin inicializar quedan libres en el mapa; la tabla crece al asignarlos
+    inodeMap.clearDirty();
+    return true;
 }
 
-std::vector<char> BlockDevice::readBlock(size_t blockNumber) {
-    std::vector<char> data(getBlockSize());
-    if (blockNumber >= getBlockCount()) return {};
+void BlockDevice::saveInodeMap() {
+    if (superblock.inodeMapBlocks == 0) return;
 
-    file.seekg(blockNumber * getBlockSize(), std::ios::beg);
-    file.read(data.data(), data.size());
+    std::vector<char> rawData(getBlockSize(), 0);
+    for (size_t i = 0; i < inodeMap.getChunkCount(); i++) {
+        if (inodeMap.takeChunk(i, rawData.data())) {
+            cache.write(superblock.inodeMapPos + i, rawData.data(), rawData.size());
+        }
+    }
+}
 
-    return data;
+size_t BlockDevice::inodeBlocksEnd() const {
+    size_t tableBlocks = superblock.inodeTableBlocks != 0 ? superblock.inodeTableBlocks
+                                                         : superblock.initialBlock - superblock.inodesInitialBlockPos;
+    size_t ready = superblock.inodeBlocksReady == 0 ? tableBlocks : std::min<size_t>(superblock.inodeBlocksReady, tableBlocks);
+    return superblock.inodesInitialBlockPos + ready;
 }
 
-void BlockDevice::info() {
-    if (file.is_open()) {
-        std::cout << "Info:\n";
-        std::cout << "  Initial Block: " << superblock.initialBlock << "\n";
-        std::cout << "  Inodes Per Block: " << superblock.inodesPerBlock << "\n";
-    } else {
-        std::cerr << "Error: No block device is open.\n";
+std::vector<char> BlockDevice::emptyInodeBlock() {
+    std::vector<char> rawData(getBlockSize(), 0);
+    Inodo empty;
+    for (size_t i = 0; i < getBlockSize() / sizeof(Inodo); i++) {
+        std::memcpy(rawData.data() + i * sizeof(Inodo), &empty, sizeof(Inodo));
     }
+    return rawData;
 }
 
-bool BlockDevice::format() {
-    if (!file.is_open()) {
-        std::cerr << "Error: No block device is open.\n";
-        return false;
-    }
+bool BlockDevice::growInodeTable() {
+    size_t block = inodeBlocksEnd();
+    if (block >= superblock.initialBlock) return false;
 
-    initializeSuperblock(getBlockSize(), getBlockCount());
+    // El bloque nuevo y el superbloque que lo cuenta van en la misma transaccion
+    std::vector<char> rawData = emptyInodeBlock();
+    if (!cache.write(block, rawData.data(), rawData.size())) return false;
+
+    superblock.inodeBlocksReady = block - superblock.inodesInitialBlockPos + 1;
+    writeSuperblock();
+    return true;
+}
+
+void BlockDevice::writeSuperblock() {
+    cache.write(0, reinterpret_cast<const char *>(&superblock), sizeof(Superblock));
+}
 
-    file.seekp(0, std::ios::beg);
-    file.write(reinterpret_cast<const char *>(&superblock), sizeof(Superblock));
+size_t BlockDevice::getSizeMapBlocks(size_t blockCount) {
+    size_t bytes = (blockCount + 63) / 64 * sizeof(uint64_t);
+    size_t chunk = getBitmapChunkSize();
+    return (bytes + chunk - 1) / chunk;
+}
 
-    freeBlockMap.assign(getBlockCount(), true);
+size_t BlockDevice::getChecksumBlocks(size_t blockCount) {
+    size_t bytes = blockCount * sizeof(uint32_t);
+    return (bytes + getBlockSize() - 1) / getBlockSize();
+}
 
-    std::vector<char> emptyBlock(getBlockSize(), 0);
+size_t BlockDevice::getJournalBlocks(size_t blockCount) {
+    return std::clamp<size_t>(blockCount / 32, 16, 2048);
+}
 
-    for (size_t i = 0; i < getBlockCount(); i++) {
-        file.seekp(i * getBlockSize()); 
-        file.write(emptyBlock.data(), emptyBlock.size()); 
-    }
+size_t BlockDevice::minBlockSize() {
+    size_t size = 1;
+    while (size < sizeof(Inodo) || size < sizeof(Superblock)) size *= 2;
+    return size;
+}
 
-    size_t inodesPerBlock = getBlockSize() / sizeof(Inodo);
-    size_t inodeBlockCount = (getBlockCount() + inodesPerBlock - 1) / inodesPerBlock;
+bool BlockDevice::isValidBlockSize(size_t blockSize) {
+    return blockSize >= minBlockSize() && (blockSize & (blockSize - 1)) == 0;
+}
 
+bool BlockDevice::validateSuperblock(uint64_t imageSize) {
+    const Superblock &sb = superblock;
 
-    for (size_t block = superblock.inodesInitialBlockPos; block < getBlockCount(); ++block) {
-        std::vector<Inodo> inodes(inodesPerBlock);
+    if (sb.hasMagic() && sb.version > Superblock::VERSION) {
+        consoleErr() << "Error: La imagen es de una version mas nueva (" << sb.version << ").\n";
+        return false;
+    }
+    if (!sb.hasMagic() && sb.blockSize == 0) {
+        consoleErr() << "Error: La imagen no es un device o no guarda su tamaño de bloque.\n";
+        return false;
+    }
 
-        for (size_t i = 0; i < inodesPerBlock; ++i) {
-            inodes[i].free = true;
-            inodes[i].name[0] = '\0';
-            inodes[i].size = 0;
-        }
+    uint64_t bs = sb.blockSize;
+    if (!isValidBlockSize(bs)) {
+        consoleErr() << "Error: Tamaño de bloque invalido en el superbloque: " << bs << ".\n";
+        return false;
+    }
 
-        file.seekp(block * getBlockSize());
-        file.write(reinterpret_cast<const char *>(inodes.data()), inodes.size() * sizeof(Inodo));
+    // Antes de la version 1 la cantidad de bloques salia del tamaño del archivo
+    uint64_t count = sb.hasMagic() ? sb.blockCount : imageSize / bs;
+    if (count == 0 || count > imageSize / bs) {
+        consoleErr() << "Error: La imagen es mas chica que lo que dice su superbloque.\n";
+        return false;
     }
 
+    bool layoutOk = sb.byteMapPos >= 1 && sb.inodesPerBlock == bs / sizeof(Inodo) &&
+                    sb.inodesInitialBlockPos < sb.initialBlock && sb.initialBlock < count &&
+                    (sb.journalBlocks == 0 || (sb.journalStart > sb.byteMapPos &&
+                                               sb.journalStart + sb.journalBlocks <= sb.inodesInitialBlockPos));
+    if (layoutOk && sb.hasMagic()) {
+        layoutOk = sb.inodeTableBlocks == sb.initialBlock - sb.inodesInitialBlockPos &&
+                   sb.inodeBlocksReady <= sb.inodeTableBlocks;
+    }
+    if (layoutOk && sb.hasMagic() && sb.version >= 2) layoutOk = sb.inodeMapBlocks != 0;
+    if (layoutOk && sb.inodeMapBlocks != 0) {
+        layoutOk = sb.inodeMapPos >= sb.journalStart + sb.journalBlocks &&
+                   sb.inodeMapPos + sb.inodeMapBlocks <= sb.inodesInitialBlockPos;
+    }
+    if (layoutOk && sb.hasMagic() && sb.version >= 5) {
+        layoutOk = sb.checksumBlocks == (count * sizeof(uint32_t) + bs - 1) / bs &&
+                   sb.checksumPos >= sb.inodeMapPos + sb.inodeMapBlocks &&
+                   sb.checksumPos + sb.checksumBlocks <= sb.inodesInitialBlockPos &&
+                   (sb.rootDirBlock < sb.checksumPos || sb.rootDirBlock >= sb.checksumPos + sb.checksumBlocks);
+    }
+    if (layoutOk && sb.hasMagic() && sb.version >= 3) layoutOk = sb.rootDirBlock != 0;
+    if (layoutOk && sb.rootDirBlock != 0) {
+        // Junto a los mapas en las imagenes nuevas; en el area de datos si se armo al abrir una vieja
+        layoutOk = sb.rootDirBlock >= std::max(sb.journalStart + sb.journalBlocks, sb.inodeMapPos + sb.inodeMapBlocks) &&
+                   sb.rootDirBlock > sb.byteMapPos && sb.rootDirBlock < count &&
+                   (sb.rootDirBlock < sb.inodesInitialBlockPos || sb.rootDirBlock >= sb.initialBlock);
+    }
+    // El arbol de instantaneas se crea con la primera, en el area de datos
+    if (layoutOk && sb.snapshotDirBlock != 0) {
+        layoutOk = sb.snapshotDirBlock >= sb.initialBlock && sb.snapshotDirBlock < count;
+    }
+    if (!layoutOk) {
+        consoleErr() << "Error: El superbloque esta dañado.\n";
+        return false;
+    }
     return true;
 }
 
-
-void BlockDevice::listFiles()
+void BlockDevice::initializeSuperblock(size_t blockSize, size_t blockCount)
 {
-    if (!file.is_open()) {
-        std::cerr << "The file is not open.\n";
-        return;
+    this->blockSize = blockSize;
+
+    size_t inodesPerBlock = blockSize / sizeof(Inodo);
+    size_t inodeCount = std::max<size_t>(1, blockCount / BLOCKS_PER_INODE);
+
+    superblock.byteMapPos = 1;
+    superblock.journalStart = superblock.byteMapPos + getSizeMapBlocks(blockCount);
+    superblock.journalBlocks = getJournalBlocks(blockCount);
+    superblock.inodeTableBlocks = (inodeCount + inodesPerBlock - 1) / inodesPerBlock;
+    superblock.inodeMapPos = superblock.journalStart + superblock.journalBlocks;
+    superblock.inodeMapBlocks = getSizeMapBlocks(superblock.inodeTableBlocks * inodesPerBlock);
+    superblock.checksumPos = superblock.inodeMapPos + superblock.inodeMapBlocks;
+    superblock.checksumBlocks = getChecksumBlocks(blockCount);
+    superblock.rootDirBlock = superblock.checksumPos + superblock.checksumBlocks;
+    superblock.inodesInitialBlockPos = superblock.rootDirBlock + 1;
+    superblock.inodesPerBlock = inodesPerBlock;
+    superblock.blockSize = blockSize;
+    superblock.inodeBlocksReady = 1;
+    superblock.blockCount = blockCount;
+    std::memcpy(superblock.magic, Superblock::MAGIC, sizeof(superblock.magic));
+    superblock.version = Superblock::VERSION;
+    superblock.features = 0;
+    superblock.snapshotDirBlock = 0;
+    superblock.initialBlock = superblock.inodesInitialBlockPos + superblock.inodeTableBlocks;
+}
+
+bool BlockDevice::create(const std::string &filename, size_t blockSize, size_t blockCount, BackendType backend) {
+    std::unique_lock<std::shared_mutex> device(deviceMutex);
+    if (isOpen()) return false;
+
+    // Antes de abrir el archivo, que se trunca: una imagen que open no acepta no sirve
+    if (!isValidBlockSize(blockSize)) {
+        consoleErr() << "Error: Tamaño de bloque invalido: " << blockSize << " (tiene que ser una potencia de dos de al menos "
+                  << minBlockSize() << " bytes).\n";
+        return false;
+    }
+    if (DirectoryTree::fanout(blockSize) < DirectoryTree::MIN_FANOUT) {
+        consoleErr() << "Error: El tamaño de bloque es muy chico para los directorios.\n";
+        return false;
     }
 
-    size_t block_size = getBlockSize();
-    bool foundFile = false;
+    storage = backendFactory ? backendFactory(backend) : makeBackend(backend);
+    if (!storage->open(filename, true)) return false;
+
+    initializeSuperblock(blockSize, blockCount);
+    if (superblock.initialBlock >= blockCount) {
+        consoleErr() << "Error: El device no tiene espacio para los metadatos.\n";
+        storage->close();
+        return false;
+    }
 
-    for (size_t block = superblock.inodesInitialBlockPos; block < getBlockCount(); ++block) {
-        std::vector<char> rawData = readBlock(block);
+    // El archivo queda disperso: solo ocupan disco los bloques que se escriben
+    if (!storage->resize(static_cast<uint64_t>(blockCount) * blockSize)) {
+        consoleErr() << "Error: No se pudo dimensionar el device.\n";
+        storage->close();
+        return false;
+    }
 
-        size_t inodesPerBlock = block_size / sizeof(Inodo);
+    // Solo se registran en la tabla las sumas de los bloques escritos aca, directo en el archivo:
+    // el resto de la tabla queda en un agujero, que se lee como "sin registrar"
+    checksums.configure(blockCount, blockSize, superblock.checksumPos, superblock.checksumBlocks, false, nullptr,
+                        [this, blockSize](size_t block, const char *src, size_t len, size_t offset) {
+                            return storage->writeAt(block * blockSize + offset, src, len);
+                        });
+    std::vector<char> rawData(blockSize, 0);
+    std::memcpy(rawData.data(), &superblock, sizeof(Superblock));
+    storage->writeAt(0, rawData.data(), sizeof(Superblock));
+    bool ok = checksums.update(0, rawData.data());
+
+    // Solo el primer bloque de inodos; los demas se inicializan al necesitarlos
+    std::vector<char> emptyBlock = emptyInodeBlock();
+    storage->writeAt(superblock.inodesInitialBlockPos * blockSize, emptyBlock.data(), emptyBlock.size());
+    ok = checksums.update(superblock.inodesInitialBlockPos, emptyBlock.data()) && ok;
+
+    DirectoryTree::initNode(emptyBlock.data(), blockSize);
+    storage->writeAt(superblock.rootDirBlock * blockSize, emptyBlock.data(), emptyBlock.size());
+    ok = checksums.update(superblock.rootDirBlock, emptyBlock.data()) && ok;
+
+    // Los bloques de metadatos quedan ocupados desde el inicio en el mapa persistido
+    freeBlockMap.reset(blockCount, getBitmapChunkSize());
+    freeBlockMap.markUsed(0, superblock.initialBlock);
+    for (size_t i = 0; i < freeBlockMap.getChunkCount(); i++) {
+        freeBlockMap.getChunk(i, emptyBlock.data());
+        storage->writeAt((superblock.byteMapPos + i) * blockSize, emptyBlock.data(), getBitmapChunkSize());
+        ok = checksums.update(superblock.byteMapPos + i, emptyBlock.data()) && ok;
+    }
 
-        for (size_t i = 0; i < inodesPerBlock; ++i) {
-            Inodo inode;
-            std::memcpy(&inode, &rawData[i * sizeof(Inodo)], sizeof(Inodo));
+    checksums.disable();
+    storage->close();
+    return ok;
+}
 
-            if (!inode.free && inode.name[0] != '\0' && inode.size > 0) {
-                if (!foundFile) {
-                    std::cout << "Archivos disponibles en el sistema:\n";
-                    foundFile = true;
-                }
-                std::cout << "- Archivo: " << inode.name << " (Tamaño: " << inode.size << " bytes)\n";
-            }
+bool BlockDevice::open(const std::string &filename, BackendType backend) {
+    std::unique_lock<std::shared_mutex> device(deviceMutex);
+    if (isOpen()) return false;
+
+    storage = backendFactory ? backendFactory(backend) : makeBackend(backend);
+    if (!storage->open(filename, false)) return false;
+
+    superblock = Superblock();
+    uint64_t imageSize = storage->size();
+    if (!storage->readAt(0, reinterpret_cast<char *>(&superblock), sizeof(Superblock)) ||
+        !validateSuperblock(imageSize)) {
+        storage->close();
+        return false;
+    }
+
+    blockSize = superblock.blockSize;
+    deviceBlocks = superblock.blockCount != 0 ? superblock.blockCount : imageSize / blockSize;
+
+    // Lo que quedo confirmado en el journal se aplica antes de leer cualquier metadato
+    journal.attach(storage.get(), getBlockSize(), superblock.journalStart, superblock.journalBlocks);
+    size_t recovered = 0;
+    if (!journal.replay(recovered)) {
+        consoleErr() << "Error: No se pudo aplicar el journal.\n";
+        journal.detach();
+        storage->close();
+        return false;
+    }
+    if (recovered > 0) {
+        consoleOut() << "Journal: " << recovered << " bloques recuperados.\n";
+
+        // El journal pudo traer un superbloque mas nuevo (la tabla de inodos crece en transacciones)
+        if (!storage->readAt(0, reinterpret_cast<char *>(&superblock), sizeof(Superblock)) ||
+            !validateSuperblock(imageSize)) {
+            journal.detach();
+            storage->close();
+            return false;
         }
     }
 
-    if (!foundFile) {
-        std::cout << "Ningun archivo disponible.\n";
+    configureCache();
+    // Las sumas primero: los mapas ya se leen verificados
+    configureChecksums();
+    if (!loadBitmap() || !loadInodeMap()) {
+        consoleErr() << "Error: No se pudieron leer los mapas de bloques e inodos.\n";
+        cache.invalidate();
+        journal.detach();
+        storage->close();
+        return false;
+    }
+    if (superblock.rootDirBlock == 0 && !createRootDirectory()) {
+        consoleErr() << "Error: No se pudo crear el directorio raiz.\n";
+        cache.invalidate();
+        journal.detach();
+        storage->close();
+        return false;
     }
-}
 
+    if (asyncIO) {
+        if (storage->handle() != -1) engine = makeAsyncEngine(ASYNC_DEPTH);
+        else consoleErr() << "Aviso: la E/S asincrona necesita el backend pread; se usa E/S sincronica.\n";
+    }
 
-void BlockDevice::cat(const std::string &file)
-{
-    int64_t inodeOffset = buscarInodo(file);
-    if (inodeOffset == -1)
-    {
-        std::cerr << "File not found.\n";
-        return;
+    imagePath = filename;
+
+    // El indice persistido solo vale si el cierre anterior fue limpio: se borra
+    // al cargarlo y se vuelve a escribir en close()
+    std::string indexPath = imagePath + ".idx";
+    if (!persistIndex || !index.load(indexPath, storage->size())) {
+        rebuildIndex();
     }
+    std::remove(indexPath.c_str());
 
-    Inodo inode = readInode(inodeOffset);
-    size_t blockCount = inode.size / getBlockSize() + 1;
-    for (size_t i = 0; i < blockCount; ++i)
-    {
-        auto data = readBlock(inode.offset[i]);
-        std::cout.write(data.data(), data.size());
+    // Lo mismo con las huellas y referencias. Sin ellas se pierden las huellas, pero si
+    // la imagen puede tener bloques compartidos las referencias se cuentan de nuevo
+    std::string dedupPath = imagePath + ".dedup";
+    if (!dedupIndex.load(dedupPath, storage->size()) && (superblock.features & Superblock::SHARED_BLOCKS)) {
+        rebuildReferences();
     }
+    std::remove(dedupPath.c_str());
+
+    return true;
 }
 
-void BlockDevice::hexdump(const std::string &file) {
-    std::vector<char> text = read(file);
-    if (text.empty()) {
-        std::cout << "No contiene texto.\n";
-        return;
+bool BlockDevice::close() {
+    std::unique_lock<std::shared_mutex> device(deviceMutex);
+
+    if (isOpen()) {
+        commitLocked();
+        flush();
+        if (unsynced.exchange(false)) storage->fsync();
+        cache.invalidate();
+        checksumCache.invalidate();
+        journal.detach();
+
+        if (persistIndex) index.save(imagePath + ".idx", storage->size());
+        index.clear();
+        if (!dedupIndex.empty()) dedupIndex.save(imagePath + ".dedup", storage->size());
+        dedupIndex.clear();
+        checksums.disable();
+        engine.reset();
+
+        storage->close();
+        return true;
     }
+    return false;
+}
 
-    for (size_t i = 0; i < text.size(); i++) {
-        unsigned int num = static_cast<unsigned char>(text[i]);
-        std::cout << std::hex << std::setw(2) << std::setfill('0') << num << " ";
-        if ((i + 1) % 16 == 0) {
-            std::cout << std::endl;
-        }
+bool BlockDevice::sync() {
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+    if (!isOpen()) return false;
+
+    bool ok = commitJournal();
+    ok = flush() && ok;
+    // Lo confirmado sin esperar al disco baja con un solo fsync
+    if (unsynced.exchange(false)) ok = storage->fsync() && ok;
+    return ok;
+}
+
+bool BlockDevice::flush() {
+    if (!isOpen()) return false;
+
+    bool ok = cache.sync();
+    if (checksums.isEnabled()) ok = checksumCache.sync() && ok;
+    return storage->sync() && ok;
+}
+
+void BlockDevice::setCacheOptions(size_t capacity, EvictionPolicy policy, size_t shards) {
+    std::unique_lock<std::shared_mutex> device(deviceMutex);
+
+    cacheCapacity = capacity;
+    cachePolicy = policy;
+    cacheShards = shards;
+
+    // Si el device ya esta abierto, se vacia la cache actual antes de reconfigurarla
+    if (isOpen()) {
+        cache.sync();
+        configureCache();
     }
+}
 
-    std::cout << std::dec << "\n\n";
+void BlockDevice::configureCache() {
+    cache.configure(getBlockSize(), cacheCapacity, cachePolicy,
+                    [this](size_t block, char *dst) { return loadBlock(block, dst); },
+                    [this](size_t block, const char *src) { return storeBlock(block, src); },
+                    cacheShards);
+
+    directories.configure(getBlockSize(),
+                          [this](size_t block) { return pinBlock(block); },
+                          [this](size_t block, const char *src) { return cache.write(block, src, getBlockSize()); },
+                          [this]() { return freeBlockMap.allocate(); },
+                          [this](size_t block) { freeBlockMap.markFree(block, 1); });
 }
 
-bool BlockDevice::write(const std::string &file, const std::string &text)
-{
-    int64_t inodeOffset = buscarInodo(file);
-    if (inodeOffset == -1)
+bool BlockDevice::loadBlock(size_t blockNumber, char *dst) {
+    if (journal.lookupStaged(blockNumber, dst)) return true;
+
+    stats.noteRead(blockNumber * getBlockSize(), getBlockSize(), getBlockSize());
+    return storage->readAt(blockNumber * getBlockSize(), dst, getBlockSize()) && verifyBlocks(blockNumber, 1, dst);
+}
+
+bool BlockDevice::storeBlock(size_t blockNumber, const char *src) {
+    // Un bloque sin confirmar no puede ir a su lugar: se guarda hasta el commit
+    if (journal.isEnabled() && !checkpointing.load(std::memory_order_acquire)) {
+        journal.stage(blockNumber, src);
+        return true;
+    }
+
+    stats.noteWrite(blockNumber * getBlockSize(), getBlockSize(), getBlockSize());
+    return storage->writeAt(blockNumber * getBlockSize(), src, getBlockSize());
+}
+
+bool BlockDevice::writeBlock(size_t blockNumber, const std::vector<char> &data) {
+    ScopedLatency timer(stats, StatOp::WRITE_BLOCK);
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+    if (!isOpen() || blockNumber >= getBlockCount() || data.size() > getBlockSize()) return false;
+    // El superbloque, los mapas, el journal, las sumas y la tabla de inodos solo los escribe el device
+    if (blockNumber < superblock.initialBlock) {
+        consoleErr() << "Error: El bloque " << blockNumber << " es de metadatos; los datos empiezan en el "
+                  << superblock.initialBlock << ".\n";
+        return false;
+    }
+
     {
-        size_t freeInodeOffset = buscarInodoLibre();
-        if (freeInodeOffset == -1)
-        {
-            std::cerr << "NO hay ninguna inodo disponible.\n";
+        std::shared_lock<std::shared_mutex> txn(commitMutex);
+        // Un bloque con varias referencias lo ven varios archivos o instantaneas: se cambia
+        // reescribiendo cada archivo, que va a bloques nuevos
+        if (dedupIndex.refCount(blockNumber) > 1) {
+            consoleErr() << "Error: El bloque " << blockNumber << " esta compartido.\n";
             return false;
         }
-        
-        Inodo newInode;
-        std::strncpy(newInode.name, file.c_str(), sizeof(newInode.name) - 1);
-        newInode.size = text.size();
-        newInode.free = false;
-        writeInode(freeInodeOffset, newInode);
-        inodeOffset = freeInodeOffset;
-    }
+        if (!cache.write(blockNumber, data.data(), data.size())) return false;
+        dedupIndex.forget(blockNumber);
 
-    Inodo inode = readInode(inodeOffset);
-    size_t blockCount = (inode.size + getBlockSize() - 1) / getBlockSize();
-    for (size_t i = 0; i < blockCount; ++i)
-    {
-        std::vector<char> data(getBlockSize(), 0);
-        size_t chunkSize = std::min(inode.size - i * getBlockSize(), getBlockSize());
-        std::memcpy(data.data(), text.data() + i * getBlockSize(), chunkSize);
-        writeBlock(inode.offset[i], data);
+        if (freeBlockMap.isFree(blockNumber)) {
+            freeBlockMap.markUsed(blockNumber, 1);
+            saveBitmap();
+        }
     }
 
+    endOperation();
     return true;
 }
 
-bool BlockDevice::copyOut(const std::string &file1, const std::string &file2)
-{
-    int64_t inodeOffset = buscarInodo(file1);
-    if (inodeOffset == -1)
-    {
-        std::cerr << "File not found.\n";
-        return false;
+void BlockDevice::endOperation() {
+    if (!journal.isEnabled()) return;
+
+    size_t ops = opsSinceCommit.fetch_add(1, std::memory_order_relaxed) + 1;
+    // Tambien se confirma si lo liberado en espera ya es tanto como lo que queda libre
+    // (con el device lleno y nada en espera no hay nada que ganar)
+    size_t pending = pendingFreeBlocks.load(std::memory_order_relaxed);
+    if ((ops >= JOURNAL_GROUP_OPS && !syncAtEnd.load(std::memory_order_relaxed)) ||
+        cache.getDirtyCount() + journal.getStagedCount() >= journal.getCapacity() / 2 ||
+        (pending > 0 && pending >= freeBlockMap.getFreeCount())) {
+        commitJournal();
     }
+}
 
-    Inodo inode = readInode(inodeOffset);
-    std::ofstream out(file2, std::ios::binary);
-    if (!out.is_open())
+bool BlockDevice::commitJournal() {
+    // Espera a que terminen las operaciones en curso y frena las nuevas hasta confirmar
+    std::unique_lock<std::shared_mutex> txn(commitMutex);
+    return commitLocked();
+}
+
+bool BlockDevice::commitLocked() {
+    if (!journal.isEnabled()) return true;
+
+    // Los bloques liberados por el grupo quedan libres en la misma transaccion que los libera
+    std::vector<Extent> frees;
     {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        frees.swap(pendingFrees);
+        pendingFreeBlocks = 0;
+    }
+    for (const Extent &extent : frees) freeBlockMap.markFree(extent.start, extent.length);
+    saveBitmap();
+    // Si la transaccion no se confirma, el disco todavia los referencia: vuelven a quedar en uso
+    // y esperando al proximo commit, para que nadie los pise antes
+    auto keepFrees = [&]() {
+        for (const Extent &extent : frees) freeBlockMap.markUsed(extent.start, extent.length);
+        saveBitmap();
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        pendingFrees.insert(pendingFrees.end(), frees.begin(), frees.end());
+        for (const Extent &extent : frees) pendingFreeBlocks += extent.length;
+    };
+
+    // Lo desalojado va primero: si un bloque esta en ambos, la copia de la cache es la mas nueva
+    commitTargets.clear();
+    commitImages.clear();
+    journal.copyStaged(commitTargets, commitImages);
+    cache.collectDirty(commitTargets, commitImages);
+    if (checksums.isEnabled()) stageChecksums(frees);
+    opsSinceCommit = 0;
+    if (commitTargets.empty()) return true;
+
+    size_t bs = getBlockSize();
+    bool durable = !syncAtEnd.load(std::memory_order_relaxed);
+    if (!durable) unsynced = true;
+
+    // Una transaccion mas grande que el journal se desborda a bloques libres: nunca se parte
+    std::vector<SpillRun> spill;
+    if (commitTargets.size() > journal.getCapacity() &&
+        !reserveSpill(frees, journal.spillBlocks(commitTargets.size()), spill)) {
+        consoleErr() << "Error: No hay espacio libre para confirmar una transaccion de "
+                  << commitTargets.size() << " bloques.\n";
+        keepFrees();
         return false;
     }
 
-    size_t blockCount = inode.size / getBlockSize() + 1;
-    for (size_t i = 0; i < blockCount; ++i)
-    {
-        auto data = readBlock(inode.offset[i]);
-        out.write(data.data(), data.size());
+    bool ok = journal.commit(commitTargets.data(), commitTargets.size(), commitImages.data(), durable, spill);
+    if (ok) {
+        // Ya es durable: desde aqui los bloques pueden ir a su lugar
+        checkpointing = true;
+        for (size_t i = 0; i < commitTargets.size(); i++) {
+            stats.noteWrite(commitTargets[i] * bs, bs, bs);
+            ok = storage->writeAt(commitTargets[i] * bs, &commitImages[i * bs], bs) && ok;
+        }
+        if (durable) ok = storage->fsync() && ok;
     }
 
-    return true;
-}
+    if (ok) {
+        cache.markClean();
+        if (checksums.isEnabled()) checksumCache.markClean();
+        journal.clearStaged();
+        journal.clear();
+    } else {
+        consoleErr() << "Error: No se pudo confirmar el journal.\n";
+        keepFrees();
+    }
 
-bool BlockDevice::copyIn(const std::string &file1, const std::string &file2)
-{
-    std::ifstream in(file1, std::ios::binary);
-    if (!in.is_open())
-    {
-        return false;
+    // El desborde vuelve a quedar libre. Si se reutiliza antes de que la cabecera vacia
+    // llegue al disco, el checksum ya no coincide y replay no aplica nada
+    for (const SpillRun &run : spill) {
+        freeBlockMap.markFree(run.start, run.length);
+        if (!ok || !holePunching.load(std::memory_order_relaxed)) continue;
+        if (checksums.isEnabled()) checksums.clear(run.start, run.length);
+        frees.push_back({static_cast<int64_t>(run.start), run.length});
     }
+    // Ya estan libres en el disco, y la barrera sigue tomada: nadie los reutiliza todavia
+    if (ok && holePunching.load(std::memory_order_relaxed)) punchExtents(std::move(frees));
 
-    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
-    return write(file2, text);
+    checkpointing = false;
+    return ok;
 }
 
-bool BlockDevice::remove(const std::string &file)
-{
-    int64_t inodeOffset = buscarInodo(file);
-    
-    if (inodeOffset == -1)
-    {
-        std::cerr << "Archivo no encontrado.\n";
-        return false;
+bool BlockDevice::reserveSpill(const std::vector<Extent> &released, size_t blocks, std::vector<SpillRun> &spill) {
+    // Lo que libera esta misma transaccion sigue en uso en el disco hasta confirmarla
+    for (const Extent &extent : released) freeBlockMap.markUsed(extent.start, extent.length);
+
+    size_t reserved = 0;
+    while (reserved < blocks && spill.size() < journal.getSpillCapacity()) {
+        int64_t start;
+        size_t length = freeBlockMap.allocateExtent(blocks - reserved, start);
+        if (length == 0) break;
+        spill.push_back({static_cast<uint64_t>(start), length});
+        reserved += length;
     }
 
-    Inodo inode = readInode(inodeOffset);
+    for (const Extent &extent : released) freeBlockMap.markFree(extent.start, extent.length);
+    if (reserved == blocks) return true;
 
-    inode.free = true;
+    for (const SpillRun &run : spill) freeBlockMap.markFree(run.start, run.length);
+    spill.clear();
+    return false;
+}
 
-    writeInode(inodeOffset, inode);
+size_t BlockDevice::punchExtents(std::vector<Extent> extents) {
+    if (extents.empty() || !punchSupported.load(std::memory_order_relaxed)) return 0;
 
-    return true;
+    std::sort(extents.begin(), extents.end(),
+              [](const Extent &a, const Extent &b) { return a.start < b.start; });
+
+    size_t bs = getBlockSize();
+    size_t runs = 0;
+    for (size_t i = 0; i < extents.size();) {
+        int64_t start = extents[i].start;
+        int64_t end = start + static_cast<int64_t>(extents[i].length);
+        for (i++; i < extents.size() && extents[i].start <= end; i++) {
+            end = std::max(end, extents[i].start + static_cast<int64_t>(extents[i].length));
+        }
+
+        if (end == start) continue;
+        if (!storage->punchHole(static_cast<uint64_t>(start) * bs, static_cast<uint64_t>(end - start) * bs)) {
+            // Los bloques quedan libres igual; solo no se devuelve el espacio
+            if (punchSupported.exchange(false)) {
+                consoleErr() << "Aviso: El sistema de archivos no permite liberar el espacio de la imagen.\n";
+            }
+            return runs;
+        }
+        // La cache no puede seguir devolviendo lo que habia antes del agujero
+        cache.discard(static_cast<size_t>(start), static_cast<size_t>(end - start), nullptr);
+        runs++;
+        holesPunched++;
+        punchedBlocks += static_cast<uint64_t>(end - start);
+    }
+    return runs;
 }
 
-size_t BlockDevice::getBlockCount() {
-    file.seekg(0, std::ios::end);
-    return file.tellg() / getBlockSize();
+void BlockDevice::configureChecksums() {
+    // Las imagenes anteriores a la version 5 no tienen tabla: se usan sin verificar
+    if (!superblock.hasMagic() || superblock.version < 5) {
+        checksums.disable();
+        return;
+    }
+
+    // Los trozos se cargan y se desalojan como cualquier metadato: los bloques de la tabla no se verifican
+    checksumCache.configure(getBlockSize(), CHECKSUM_CACHE_BLOCKS, EvictionPolicy::LRU,
+                            [this](size_t block, char *dst) { return loadBlock(block, dst); },
+                            [this](size_t block, const char *src) { return storeBlock(block, src); },
+                            cacheShards);
+    checksums.configure(getBlockCount(), getBlockSize(), superblock.checksumPos, superblock.checksumBlocks,
+                        storage->type() == BackendType::MMAP,
+                        [this](size_t block) { return checksumCache.pin(block); },
+                        [this](size_t block, const char *src, size_t len, size_t offset) {
+                            return checksumCache.write(block, src, len, offset);
+                        });
 }
 
-int BlockDevice::getEstado(size_t index) {
-    if (index >= freeBlockMap.size()) return -1;
-    return freeBlockMap[index];
+void BlockDevice::stageChecksums(const std::vector<Extent> &released) {
+    size_t bs = getBlockSize();
+    size_t collected = commitTargets.size();
+    for (size_t i = 0; i < collected; i++) checksums.update(commitTargets[i], &commitImages[i * bs]);
+    // Despues van a ser un agujero: se leen en ceros y no hay suma que verificar
+    if (holePunching.load(std::memory_order_relaxed)) {
+        for (const Extent &extent : released) checksums.clear(extent.start, extent.length);
+    }
+
+    // Los trozos de la tabla van al final de la misma transaccion: los que su cache desalojo
+    // mientras tanto quedaron en el journal, y los sucios son mas nuevos que esos
+    std::vector<uint64_t> chunks;
+    std::vector<char> images;
+    journal.copyStaged(chunks, images, superblock.checksumPos, superblock.checksumBlocks);
+    checksumCache.collectDirty(chunks, images);
+
+    // Un trozo que ya estaba en la transaccion se reemplaza por su version nueva
+    std::unordered_map<uint64_t, size_t> position;
+    for (size_t i = 0; i < collected; i++) {
+        if (checksums.inTable(commitTargets[i])) position[commitTargets[i]] = i;
+    }
+    for (size_t i = 0; i < chunks.size(); i++) {
+        auto found = position.find(chunks[i]);
+        if (found != position.end()) {
+            std::memcpy(&commitImages[found->second * bs], &images[i * bs], bs);
+            continue;
+        }
+        position[chunks[i]] = commitTargets.size();
+        commitTargets.push_back(chunks[i]);
+        commitImages.insert(commitImages.end(), images.begin() + i * bs, images.begin() + (i + 1) * bs);
+    }
 }
 
+bool BlockDevice::clearChecksumTable() {
+    uint64_t bs = getBlockSize();
+    uint64_t start = superblock.checksumPos * bs;
+    uint64_t len = superblock.checksumBlocks * bs;
+    if (storage->punchHole(start, len)) return true;
+
+    std::vector<char> &buffer = getStreamBuffer();
+    std::fill(buffer.begin(), buffer.end(), 0);
+    for (uint64_t offset = 0; offset < len; offset += buffer.size()) {
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(buffer.size(), len - offset));
+        if (!storage->writeAt(start + offset, buffer.data(), chunk)) return false;
+    }
+    return true;
+}
+
+bool BlockDevice::verifyBlocks(size_t firstBlock, size_t blockCount, const char *data, bool cached) {
+    if (!checksums.isEnabled()) return true;
+
+    bool ok = true;
+    for (size_t i = 0; i < blockCount; i++) {
+        size_t block = firstBlock + i;
+        if (checksums.verify(block, data + i * getBlockSize())) continue;
+        // La suma ya describe la version de la cache o del journal, que no llego al disco
+        if (cached && (cache.pinIfPresent(block) || journal.isStaged(block))) continue;
+
+        checksumErrors++;
+        consoleErr() << "Error: Suma de verificacion incorrecta en el bloque " << block << ".\n";
+        ok = false;
+    }
+    return ok;
+}
+
+void BlockDevice::updateBlocks(size_t firstBlock, size_t blockCount, const char *data) {
+    if (!checksums.isEnabled()) return;
+    for (size_t i = 0; i < blockCount; i++) checksums.update(firstBlock + i, data + i * getBlockSize());
+}
+
+bool BlockDevice::loadBitmap() {
+    freeBlockMap.reset(getBlockCount(), getBitmapChunkSize());
+
+    for (size_t i = 0; i < freeBlockMap.getChunkCount(); i++) {
+        BlockRef rawData = pinBlock(superblock.byteMapPos + i);
+        if (!rawData) return false;
+        freeBlockMap.setChunk(i, rawData.data());
+    }
+
+    freeBlockMap.clearDirty();
+    return true;
+}
+
+void BlockDevice::saveBitmap() {
+    std::lock_guard<std::mutex> lock(bitmapMutex);
+    std::vector<char> rawData(getBlockSize(), 0);
+
+    // takeChunk copia y limpia a la vez: lo que otro hilo marque despues queda para la siguiente
+    for (size_t i = 0; i < freeBlockMap.getChunkCount(); i++) {
+        if (freeBlockMap.takeChunk(i, rawData.data())) {
+            cache.write(superblock.byteMapPos + i, rawData.data(), rawData.size());
+        }
+    }
+}
+
+bool BlockDevice::releaseBlocks(const Inodo &inode, bool deferred) {
+    // Un archivo en linea no tiene bloques: sus campos de punteros son datos
+    if (inode.isInline()) return true;
+
+    // Con la lista a medias se liberarian algunos y otros no: quedan todos en uso hasta fsck liberar
+    std::vector<Extent> extents;
+    if (!readExtents(inode, extents)) {
+        consoleErr() << "Error: No se pudieron leer los tramos de " << inode.name
+                  << "; sus bloques quedan en uso (fsck liberar los recupera).\n";
+        return false;
+    }
+
+    if (inode.doubleIndirect != -1) {
+        BlockRef rawData = pinBlock(inode.doubleIndirect);
+        size_t pointers = rawData.size() / sizeof(int64_t);
+
+        for (size_t i = 0; i < pointers; i++) {
+            int64_t block;
+            std::memcpy(&block, rawData.data() + i * sizeof(int64_t), sizeof(int64_t));
+            if (block == -1) break;
+            extents.push_back({block, 1});
+        }
+        extents.push_back({inode.doubleIndirect, 1});
+    }
+
+    if (inode.indirect != -1) extents.push_back({inode.indirect, 1});
+
+    releaseExtents(extents, deferred);
+    return true;
+}
+
+void BlockDevice::releaseExtents(const std::vector<Extent> &extents, bool deferred) {
+    // Un bloque compartido solo pierde una referencia; se libera con la ultima
+    const std::vector<Extent> *release = &extents;
+    std::vector<Extent> unshared;
+    if (!dedupIndex.empty()) {
+        DedupIndex::Runs freed;
+        for (const Extent &extent : extents) dedupIndex.release(extent.start, extent.length, freed);
+        for (const auto &[first, count] : freed) unshared.push_back({static_cast<int64_t>(first), count});
+        release = &unshared;
+    }
+
+    // Si otro archivo los reutilizara antes del commit, un corte dejaria sus datos
+    // dentro del archivo que el disco todavia referencia
+    if (deferred && journal.isEnabled()) {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        pendingFrees.insert(pendingFrees.end(), release->begin(), release->end());
+        for (const Extent &extent : *release) pendingFreeBlocks += extent.length;
+        return;
+    }
+
+    // Antes de marcarlos libres: despues otro hilo ya los podria estar escribiendo
+    if (holePunching.load(std::memory_order_relaxed)) {
+        for (const Extent &extent : *release) checksums.clear(extent.start, extent.length);
+        punchExtents(*release);
+    }
+    for (const Extent &extent : *release) {
+        freeBlockMap.markFree(extent.start, extent.length);
+    }
+}
+
+bool BlockDevice::allocateExtents(size_t blockCount, std::vector<Extent> &extents) {
+    extents.clear();
+    if (blockCount == 0) return true;
+
+    // Primero se busca un unico tramo; si no existe, se junta lo que haya desde el cursor
+    int64_t start = freeBlockMap.allocateContiguous(blockCount);
+    if (start != BlockAllocator::NONE) {
+        extents.push_back({start, blockCount});
+        return true;
+    }
+
+    size_t remaining = blockCount;
+    while (remaining > 0) {
+        size_t length = freeBlockMap.allocateExtent(remaining, start);
+        if (length == 0) {
+            for (const Extent &extent : extents) freeBlockMap.markFree(extent.start, extent.length);
+            extents.clear();
+            return false;
+        }
+
+        extents.push_back({start, length});
+        remaining -= length;
+    }
+    return true;
+}
+
+bool BlockDevice::readExtents(const Inodo &inode, std::vector<Extent> &extents) {
+    extents.clear();
+    if (inode.isInline()) return true;
+
+    for (int i = 0; i < Inodo::DIRECT_EXTENTS; i++) {
+        if (inode.extents[i].start == -1) return true;
+        extents.push_back(inode.extents[i]);
+    }
+
+    bool more = true;
+    if (inode.indirect == -1) return true;
+    if (!readExtentBlock(inode.indirect, extents, more)) return false;
+    if (!more) return true;
+
+    if (inode.doubleIndirect == -1) return true;
+
+    BlockRef rawData = pinBlock(inode.doubleIndirect);
+    if (!rawData) return false;
+
+    size_t pointers = rawData.size() / sizeof(int64_t);
+    for (size_t i = 0; i < pointers; i++) {
+        int64_t block;
+        std::memcpy(&block, rawData.data() + i * sizeof(int64_t), sizeof(int64_t));
+        if (block == -1) break;
+        if (!readExtentBlock(block, extents, more)) return false;
+        if (!more) break;
+    }
+    return true;
+}
+
+// Agrega los Extents del bloque; more queda en false si encontro el final de la lista.
+// Devuelve false si el bloque no se pudo leer
+bool BlockDevice::readExtentBlock(int64_t block, std::vector<Extent> &extents, bool &more) {
+    BlockRef rawData = pinBlock(block);
+    if (!rawData) return false;
+
+    size_t perBlock = rawData.size() / sizeof(Extent);
+    for (size_t i = 0; i < perBlock; i++) {
+        Extent extent;
+        std::memcpy(&extent, rawData.data() + i * sizeof(Extent), sizeof(Extent));
+        if (extent.start == -1) {
+            more = false;
+            return true;
+        }
+        extents.push_back(extent);
+    }
+    more = true;
+    return true;
+}
+
+// Escribe Extents a partir de first en el bloque; devuelve el siguiente sin escribir
+size_t BlockDevice::writeExtentBlock(int64_t block, const std::vector<Extent> &extents, size_t first) {
+    std::vector<char> rawData(getBlockSize(), 0);
+    size_t perBlock = getBlockSize() / sizeof(Extent);
+
+    size_t i = 0;
+    for (; i < perBlock && first + i < extents.size(); i++) {
+        std::memcpy(&rawData[i * sizeof(Extent)], &extents[first + i], sizeof(Extent));
+    }
+    if (i < perBlock) {
+        Extent end{-1, 0};
+        std::memcpy(&rawData[i * sizeof(Extent)], &end, sizeof(Extent));
+    }
+
+    cache.write(block, rawData.data(), rawData.size());
+    return first + i;
+}
+
+bool BlockDevice::writeExtents(Inodo &inode, const std::vector<Extent> &extents) {
+    size_t perBlock = getBlockSize() / sizeof(Extent);
+    size_t pointers = getBlockSize() / sizeof(int64_t);
+    if (extents.size() > Inodo::DIRECT_EXTENTS + perBlock + pointers * perBlock) return false;
+
+    size_t next = 0;
+    for (; next < Inodo::DIRECT_EXTENTS && next < extents.size(); next++) {
+        inode.extents[next] = extents[next];
+    }
+    if (next == extents.size()) return true;
+
+    // Los bloques de metadatos se piden de uno en uno y se devuelven si algo falla
+    std::vector<int64_t> allocated;
+    auto allocateMeta = [&]() {
+        int64_t block = freeBlockMap.allocate();
+        if (block != BlockAllocator::NONE) allocated.push_back(block);
+        return block;
+    };
+    // El inodo queda sin tramos: quien llama devuelve los suyos una sola vez
+    auto rollback = [&]() {
+        for (int64_t block : allocated) freeBlockMap.markFree(block, 1);
+        for (Extent &extent : inode.extents) extent = {-1, 0};
+        inode.indirect = inode.doubleIndirect = -1;
+        return false;
+    };
+
+    inode.indirect = allocateMeta();
+    if (inode.indirect == -1) return rollback();
+    next = writeExtentBlock(inode.indirect, extents, next);
+    if (next == extents.size()) return true;
+
+    inode.doubleIndirect = allocateMeta();
+    if (inode.doubleIndirect == -1) return rollback();
+
+    std::vector<int64_t> blocks(pointers, -1);
+    for (size_t p = 0; p < pointers && next < extents.size(); p++) {
+        blocks[p] = allocateMeta();
+        if (blocks[p] == -1) return rollback();
+        next = writeExtentBlock(blocks[p], extents, next);
+    }
+
+    std::vector<char> rawData(getBlockSize(), 0);
+    std::memcpy(rawData.data(), blocks.data(), pointers * sizeof(int64_t));
+    cache.write(inode.doubleIndirect, rawData.data(), rawData.size());
+    return true;
+}
+
+bool BlockDevice::readRun(size_t firstBlock, size_t blockCount, char *dst) {
+    if (firstBlock + blockCount > getBlockCount()) return false;
+
+    stats.noteRead(firstBlock * getBlockSize(), blockCount * getBlockSize(), getBlockSize());
+    if (!storage->readAt(firstBlock * getBlockSize(), dst, blockCount * getBlockSize())) return false;
+    bool ok = verifyBlocks(firstBlock, blockCount, dst, true);
+
+    // Lo que este en cache (o esperando el commit) puede ser mas nuevo que el disco
+    overlayNewer(firstBlock, blockCount, dst);
+    return ok;
+}
+
+void BlockDevice::overlayNewer(size_t firstBlock, size_t blockCount, char *dst) {
+    // Primero la cache: un bloque que se desaloje mientras tanto ya quedo en el journal
+    cache.overlay(firstBlock, blockCount, dst);
+    if (journal.getStagedCount() == 0) return;
+
+    // La copia del journal puede ser mas vieja que la de la cache, asi que solo
+    // se aplica a los bloques que la cache no tiene
+    std::vector<bool> covered(blockCount, false);
+    cache.overlay(firstBlock, blockCount, dst, &covered);
+    journal.overlayStaged(firstBlock, blockCount, dst, &covered);
+}
+
+bool BlockDevice::writeRun(size_t firstBlock, const char *src, size_t len) {
+    size_t blockCount = (len + getBlockSize() - 1) / getBlockSize();
+    if (firstBlock + blockCount > getBlockCount()) return false;
+
+    size_t whole = len / getBlockSize();
+    stats.noteWrite(firstBlock * getBlockSize(), blockCount * getBlockSize(), getBlockSize());
+    bool ok = storage->writeAt(firstBlock * getBlockSize(), src, whole * getBlockSize());
+    cache.discard(firstBlock, whole, src);
+    updateBlocks(firstBlock, whole, src);
+
+    // El ultimo bloque parcial se completa con ceros
+    if (whole < blockCount) {
+        std::vector<char> tail(getBlockSize(), 0);
+        std::memcpy(tail.data(), src + whole * getBlockSize(), len - whole * getBlockSize());
+        ok = storage->writeAt((firstBlock + whole) * getBlockSize(), tail.data(), tail.size()) && ok;
+        cache.discard(firstBlock + whole, 1, tail.data());
+        updateBlocks(firstBlock + whole, 1, tail.data());
+    }
+
+    return ok;
+}
+
+bool BlockDevice::readRuns(const std::vector<RunIO> &runs) {
+    if (!engine) {
+        for (const RunIO &run : runs) {
+            if (!readRun(run.firstBlock, run.blockCount, run.data)) return false;
+        }
+        return true;
+    }
+
+    if (!submitRuns(runs, false)) return false;
+
+    bool ok = true;
+    for (const RunIO &run : runs) {
+        ok = verifyBlocks(run.firstBlock, run.blockCount, run.data, true) && ok;
+        overlayNewer(run.firstBlock, run.blockCount, run.data);
+    }
+    return ok;
+}
+
+bool BlockDevice::writeRuns(const std::vector<RunIO> &runs) {
+    if (!engine) {
+        for (const RunIO &run : runs) {
+            if (!writeRun(run.firstBlock, run.data, run.blockCount * getBlockSize())) return false;
+        }
+        return true;
+    }
+
+    bool ok = submitRuns(runs, true);
+
+    for (const RunIO &run : runs) {
+        cache.discard(run.firstBlock, run.blockCount, run.data);
+        updateBlocks(run.firstBlock, run.blockCount, run.data);
+    }
+    return ok;
+}
+
+bool BlockDevice::submitRuns(const std::vector<RunIO> &runs, bool write) {
+    static thread_local std::vector<AsyncRequest> requests;
+    requests.clear();
+
+    size_t bs = getBlockSize();
+    size_t perRequest = std::max<size_t>(1, ASYNC_REQUEST_BYTES / bs);
+
+    for (const RunIO &run : runs) {
+        if (run.firstBlock + run.blockCount > getBlockCount()) return false;
+
+        for (size_t b = 0; b < run.blockCount; b += perRequest) {
+            AsyncRequest request;
+            request.write = write;
+            request.fd = storage->handle();
+            request.offset = (run.firstBlock + b) * bs;
+            request.buffer = run.data + b * bs;
+            request.length = std::min(perRequest, run.blockCount - b) * bs;
+            requests.push_back(request);
+
+            if (write) stats.noteWrite(request.offset, request.length, bs);
+            else stats.noteRead(request.offset, request.length, bs);
+        }
+    }
+
+    return engine->run(requests.data(), requests.size());
+}
+
+std::vector<char> BlockDevice::read(const std::string &filename)
+{
+    ScopedLatency timer(stats, StatOp::READ);
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+    if (!isOpen()) {
+        consoleErr() << "Error: File not open.\n";
+        return std::vector<char>();
+    }
+
+    std::shared_lock<std::shared_mutex> guard;
+    int64_t offset = lookupShared(filename, guard);
+    if (offset == -1) {
+        consoleErr() << "Error: No inode found for file " << filename << ".\n";
+        return std::vector<char>();
+    }
+
+    Inodo inode = readInode(offset);
+    std::vector<char> text(inode.size);
+    size_t bytesRead = 0;
+    if (!readData(inode, text.data(), text.size(), bytesRead)) return std::vector<char>();
+
+    text.resize(bytesRead);
+    return text;
+}
+
+int64_t BlockDevice::fileSize(const std::string &filename) {
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+    if (!isOpen()) return -1;
+
+    std::shared_lock<std::shared_mutex> guard;
+    int64_t offset = lookupShared(filename, guard);
+    if (offset == -1) return -1;
+    return readInode(offset).size;
+}
+
+bool BlockDevice::read(const std::string &filename, char *dst, size_t len, size_t &bytesRead)
+{
+    ScopedLatency timer(stats, StatOp::READ);
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+
+    bytesRead = 0;
+    if (!isOpen()) {
+        consoleErr() << "Error: File not open.\n";
+        return false;
+    }
+
+    std::shared_lock<std::shared_mutex> guard;
+    int64_t offset = lookupShared(filename, guard);
+    if (offset == -1) {
+        consoleErr() << "Error: No inode found for file " << filename << ".\n";
+        return false;
+    }
+
+    return readData(readInode(offset), dst, len, bytesRead);
+}
+
+bool BlockDevice::readData(const Inodo &inode, char *dst, size_t len, size_t &bytesRead)
+{
+    bytesRead = 0;
+
+    // Los datos en linea ya vinieron con el inodo
+    if (inode.isInline()) {
+        bytesRead = std::min<size_t>({len, inode.size, Inodo::INLINE_BYTES});
+        std::memcpy(dst, inode.inlineData(), bytesRead);
+        return true;
+    }
+    if (inode.isCompressed()) {
+        size_t total = std::min<size_t>(len, inode.size);
+        return readCompressed(inode, total, [&](const char *data, size_t n) {
+            std::memcpy(dst + bytesRead, data, n);
+            bytesRead += n;
+            return true;
+        });
+    }
+
+    // Sobrevive entre llamadas para no reservar en cada lectura; uno por hilo
+    static thread_local std::vector<Extent> extentScratch;
+    if (!readExtents(inode, extentScratch)) {
+        consoleErr() << "Error: Failed to read extents.\n";
+        return false;
+    }
+
+    // Los bloques completos van directo al buffer del llamador; solo el ultimo
+    // bloque parcial pasa por el buffer interno. Todo se lee en un solo lote
+    size_t total = std::min<size_t>(len, inode.size);
+    size_t bs = getBlockSize();
+
+    static thread_local std::vector<RunIO> runs;
+    runs.clear();
+
+    size_t planned = 0, tailBytes = 0;
+    char *tail = getStreamBuffer().data();
+
+    for (const Extent &extent : extentScratch) {
+        if (planned == total) break;
+
+        size_t wanted = std::min<size_t>(extent.length * bs, total - planned);
+        size_t whole = wanted / bs;
+
+        if (whole > 0) runs.push_back({static_cast<size_t>(extent.start), whole, dst + planned});
+        planned += whole * bs;
+
+        if (whole * bs < wanted) {
+            runs.push_back({static_cast<size_t>(extent.start) + whole, 1, tail});
+            tailBytes = wanted - whole * bs;
+            planned = total;
+        }
+    }
+    // Como en readStream: si los tramos no alcanzan para el tamaño, el archivo esta dañado
+    if (planned < total) {
+        consoleErr() << "Error: Los tramos del archivo cubren menos que su tamaño.\n";
+        return false;
+    }
+
+    if (!readRuns(runs)) {
+        consoleErr() << "Error: Failed to read block data.\n";
+        return false;
+    }
+
+    if (tailBytes > 0) std::memcpy(dst + total - tailBytes, tail, tailBytes);
+    bytesRead = planned;
+    return true;
+}
+
+std::vector<char> BlockDevice::readBlock(size_t blockNumber) {
+    std::vector<char> data(isOpen() ? getBlockSize() : 0);
+    if (data.empty()) return {};
+    if (!readBlock(blockNumber, data.data(), data.size())) return {};
+    return data;
+}
+
+bool BlockDevice::readBlock(size_t blockNumber, char *dst, size_t len) {
+    ScopedLatency timer(stats, StatOp::READ_BLOCK);
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+
+    BlockRef block = pinBlock(blockNumber);
+    if (!block) return false;
+
+    std::memcpy(dst, block.data(), std::min(len, block.size()));
+    return true;
+}
+
+BlockRef BlockDevice::viewBlock(size_t blockNumber) {
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+    return pinBlock(blockNumber);
+}
+
+BlockRef BlockDevice::pinBlock(size_t blockNumber) {
+    if (!isOpen() || blockNumber >= getBlockCount()) return BlockRef();
+    // La tabla de sumas tiene su propia cache, que puede ser mas nueva que el disco
+    if (checksums.inTable(blockNumber)) return checksumCache.pin(blockNumber);
+
+    // Con mmap los bloques limpios se leen directo de la proyeccion; la cache solo guarda lo escrito
+    // Se mira la cache antes que el journal: si el bloque se desaloja entre medias, ya esta en el journal
+    const char *mapped = storage->view(blockNumber * getBlockSize(), getBlockSize());
+    if (mapped) {
+        BlockRef cached = cache.pinIfPresent(blockNumber);
+        if (cached) return cached;
+    }
+    if (mapped && !journal.isStaged(blockNumber)) {
+
+        // La proyeccion no pasa por loadBlock: cada bloque se verifica la primera vez que se ve
+        if (checksums.isEnabled() && !checksums.isVerified(blockNumber)) {
+            if (!verifyBlocks(blockNumber, 1, mapped)) return BlockRef();
+            checksums.markVerified(blockNumber);
+        }
+        return BlockRef(nullptr, blockNumber, mapped, getBlockSize());
+    }
+
+    return cache.pin(blockNumber);
+}
+
+void BlockDevice::info() {
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+
+    if (isOpen()) {
+        consoleOut() << "Info:\n";
+        consoleOut() << "  Superblock: version " << (superblock.hasMagic() ? superblock.version : 0) << ", "
+                  << getBlockCount() << " bloques de " << getBlockSize() << " bytes\n";
+        size_t readyInodeBlocks;
+        {
+            std::shared_lock<std::shared_mutex> names(namespaceMutex);
+            readyInodeBlocks = inodeBlocksEnd() - superblock.inodesInitialBlockPos;
+        }
+        consoleOut() << "  Inode Table: " << readyInodeBlocks << " de "
+                  << superblock.initialBlock - superblock.inodesInitialBlockPos << " bloques inicializados\n";
+        consoleOut() << "  Initial Block: " << superblock.initialBlock << "\n";
+        consoleOut() << "  Inodes Per Block: " << superblock.inodesPerBlock << "\n";
+        consoleOut() << "  Cache: " << cache.getCapacity() << " bloques ("
+                  << (cache.getPolicy() == EvictionPolicy::LRU ? "LRU" : "CLOCK") << "), "
+                  << cache.getHits() << " hits, " << cache.getMisses() << " misses, "
+                  << cache.getDirtyCount() << " sucios\n";
+        if (journal.isEnabled()) {
+            consoleOut() << "  Journal: " << journal.getBlockCount() << " bloques desde el " << journal.getFirstBlock()
+                      << ", " << journal.getCommits() << " commits\n";
+        }
+        consoleOut() << "  Backend: " << (storage->type() == BackendType::MMAP ? "mmap" :
+                                       storage->type() == BackendType::PREAD ? "pread" : "fstream") << "\n";
+        if (cache.getShardCount() > 1) consoleOut() << "  Cache shards: " << cache.getShardCount() << "\n";
+        if (engine) consoleOut() << "  E/S asincrona: " << engine->name() << " (profundidad " << engine->depth() << ")\n";
+        if (checksums.isEnabled()) {
+            consoleOut() << "  Sumas de verificacion: CRC32C (" << (crc32cHardware() ? "SSE4.2" : "software") << "), "
+                      << superblock.checksumBlocks << " bloques desde el " << superblock.checksumPos << "\n";
+        } else {
+            consoleOut() << "  Sumas de verificacion: no (imagen anterior a la version 5)\n";
+        }
+    } else {
+        consoleErr() << "Error: No block device is open.\n";
+    }
+}
+
+void BlockDevice::printStats(std::ostream &out, StatsFormat format) {
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+
+    DeviceStats::Metrics extra = {
+        {"cache_hits", cache.getHits(), true},
+        {"cache_misses", cache.getMisses(), true},
+        {"cache_dirty_blocks", cache.getDirtyCount(), false},
+        {"alloc_searches", freeBlockMap.getSearches(), true},
+        {"alloc_search_steps", freeBlockMap.getSearchSteps(), true},
+        {"inode_search_steps", inodeMap.getSearchSteps(), true},
+        {"free_inodes", isOpen() ? inodeMap.getFreeCount() : 0, false},
+        {"free_blocks", isOpen() ? freeBlockMap.getFreeCount() : 0, false},
+        {"journal_commits", journal.getCommits(), true},
+        {"journal_staged_blocks", journal.getStagedCount(), false},
+        {"dedup_hits", dedupHits.load(), true},
+        {"dedup_fingerprints", dedupIndex.fingerprints(), false},
+        {"dedup_shared_blocks", dedupIndex.sharedBlocks(), false},
+        {"checksum_errors", checksumErrors.load(), true},
+        {"holes_punched", holesPunched.load(), true},
+        {"punched_blocks", punchedBlocks.load(), true},
+    };
+    stats.dump(out, format, extra);
+}
+
+void BlockDevice::resetStats() {
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+
+    stats.reset();
+    cache.resetCounters();
+    freeBlockMap.resetSearchStats();
+    inodeMap.resetSearchStats();
+    dedupHits = 0;
+    checksumErrors = 0;
+    holesPunched = 0;
+    punchedBlocks = 0;
+}
+
+bool BlockDevice::format() {
+    std::unique_lock<std::shared_mutex> device(deviceMutex);
+
+    if (!isOpen()) {
+        consoleErr() << "Error: No block device is open.\n";
+        return false;
+    }
+
+    // El formateo escribe directamente al archivo; lo pendiente en cache queda obsoleto
+    cache.invalidate();
+    checksumCache.invalidate();
+    initializeSuperblock(getBlockSize(), getBlockCount());
+
+    journal.attach(storage.get(), getBlockSize(), superblock.journalStart, superblock.journalBlocks);
+    pendingFrees.clear();
+    pendingFreeBlocks = 0;
+
+    index.clear();
+    dedupIndex.clear();
+
+    // El area de datos no se escribe: el mapa la marca libre y se devuelve al host en un solo
+    // agujero. De la tabla de inodos solo se inicializa el primer bloque.
+    // Las sumas viejas no valen: la tabla queda sin registrar salvo lo que se escribe aca,
+    // que entra con el commit de abajo
+    if (!clearChecksumTable()) return false;
+    configureChecksums();
+
+    std::vector<char> rawData(getBlockSize(), 0);
+    std::memcpy(rawData.data(), &superblock, sizeof(Superblock));
+    storage->writeAt(0, rawData.data(), rawData.size());
+    checksums.update(0, rawData.data());
+
+    rawData = emptyInodeBlock();
+    storage->writeAt(superblock.inodesInitialBlockPos * getBlockSize(), rawData.data(), rawData.size());
+    checksums.update(superblock.inodesInitialBlockPos, rawData.data());
+
+    DirectoryTree::initNode(rawData.data(), getBlockSize());
+    storage->writeAt(superblock.rootDirBlock * getBlockSize(), rawData.data(), rawData.size());
+    checksums.update(superblock.rootDirBlock, rawData.data());
+    journal.clear();
+
+    freeBlockMap.reset(getBlockCount(), getBitmapChunkSize());
+    freeBlockMap.markUsed(0, superblock.initialBlock);
+    saveBitmap();
+
+    // Recien reiniciado, todo el mapa de inodos queda sucio y se escribe entero
+    inodeMap.reset(getInodeSlots(), getBitmapChunkSize());
+    saveInodeMap();
+
+    if (!commitLocked()) return false;
+    if (holePunching.load(std::memory_order_relaxed)) {
+        punchExtents({{static_cast<int64_t>(superblock.initialBlock), getBlockCount() - superblock.initialBlock}});
+    }
+    return true;
+}
+
+
+void BlockDevice::listFiles(const std::string &dir, const std::string &prefix)
+{
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+
+    if (!isOpen()) {
+        consoleErr() << "The file is not open.\n";
+        return;
+    }
+
+    // Con los nombres tomados no se crean ni borran archivos mientras se lista
+    std::shared_lock<std::shared_mutex> names(namespaceMutex);
+
+    int64_t dirOffset = dir.empty() ? InodeIndex::ROOT : dir == "@" ? InodeIndex::SNAPSHOTS : buscarInodo(dir);
+    int64_t root = dirOffset == -1 ? -1 : directoryRoot(dirOffset);
+    if (root == -1) {
+        consoleErr() << "Directorio no encontrado.\n";
+        return;
+    }
+
+    bool foundFile = false;
+
+    // Las hojas del arbol ya estan en orden: se empieza en el prefijo y se corta al salir de el
+    directories.scan(root, prefix, [&](const char *name, int64_t offset) {
+        if (std::strncmp(name, prefix.c_str(), prefix.size()) != 0) return false;
+
+        Inodo inode = readInode(offset);
+        if (!inode.isDirectory() && inode.size == 0) return true;
+
+        if (!foundFile) {
+            consoleOut() << "Archivos disponibles en el sistema:\n";
+            foundFile = true;
+        }
+        if (inode.isDirectory()) {
+            consoleOut() << "- Directorio: " << name << "/ (Entradas: " << inode.size << ")\n";
+        } else {
+            consoleOut() << "- Archivo: " << name << " (Tamaño: " << inode.size << " bytes)\n";
+        }
+        return true;
+    });
+
+    if (!foundFile) {
+        consoleOut() << "Ningun archivo disponible.\n";
+    }
+}
+
+bool BlockDevice::mkdir(const std::string &path)
+{
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+    if (!isOpen()) {
+        consoleErr() << "Error: No block device is open.\n";
+        return false;
+    }
+
+    bool ok = makeDirectory(path);
+    endOperation();
+    return ok;
+}
+
+bool BlockDevice::makeDirectory(const std::string &path)
+{
+    if (isSnapshotPath(path)) return false;
+    std::shared_lock<std::shared_mutex> txn(commitMutex);
+    std::unique_lock<std::shared_mutex> names(namespaceMutex);
+
+    std::string leaf;
+    int64_t parent = resolveParent(path, leaf);
+    if (parent == -1) {
+        consoleErr() << "El directorio padre no existe.\n";
+        return false;
+    }
+    if (leaf.size() >= sizeof(Inodo::name)) {
+        consoleErr() << "El nombre es demasiado largo.\n";
+        return false;
+    }
+    if (index.find(parent, leaf) != -1) {
+        consoleErr() << "Ya existe un archivo o directorio con ese nombre.\n";
+        return false;
+    }
+
+    int64_t root = freeBlockMap.allocate();
+    if (root == BlockAllocator::NONE) {
+        consoleErr() << "NO hay bloques libres suficientes.\n";
+        return false;
+    }
+    int64_t offset = buscarInodoLibre();
+    if (offset == -1) {
+        freeBlockMap.markFree(root, 1);
+        consoleErr() << "NO hay ninguna inodo disponible.\n";
+        return false;
+    }
+
+    std::vector<char> node(getBlockSize());
+    DirectoryTree::initNode(node.data(), getBlockSize());
+    cache.write(root, node.data(), node.size());
+
+    Inodo inode(leaf, false);
+    inode.type = Inodo::DIRECTORY_TYPE;
+    inode.extents[0] = {root, 1};
+    writeInode(offset, inode);
+
+    if (!addEntry(parent, leaf, offset)) {
+        inode.free = true;
+        writeInode(offset, inode);
+        releaseInode(offset);
+        freeBlockMap.markFree(root, 1);
+        saveBitmap();
+        consoleErr() << "No se pudo agregar la entrada al directorio.\n";
+        return false;
+    }
+    return true;
+}
+
+bool BlockDevice::rmdir(const std::string &path)
+{
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+    if (!isOpen()) {
+        consoleErr() << "Error: No block device is open.\n";
+        return false;
+    }
+
+    bool ok = removeDirectory(path);
+    endOperation();
+    return ok;
+}
+
+bool BlockDevice::removeDirectory(const std::string &path)
+{
+    if (isSnapshotPath(path)) return false;
+    std::shared_lock<std::shared_mutex> txn(commitMutex);
+    std::unique_lock<std::shared_mutex> names(namespaceMutex);
+
+    std::string leaf;
+    int64_t parent = resolveParent(path, leaf);
+    int64_t offset = parent == -1 ? -1 : index.find(parent, leaf);
+    if (offset == -1) {
+        consoleErr() << "Directorio no encontrado.\n";
+        return false;
+    }
+
+    Inodo inode = readInode(offset);
+    if (!inode.isDirectory()) {
+        consoleErr() << "No es un directorio.\n";
+        return false;
+    }
+    if (inode.size != 0) {
+        consoleErr() << "El directorio no esta vacio.\n";
+        return false;
+    }
+
+    // Un arbol vacio puede conservar hojas de entradas ya borradas
+    std::vector<int64_t> nodes{inode.extents[0].start};
+    if (!directories.collectNodes(inode.extents[0].start, nodes)) {
+        consoleErr() << "El arbol del directorio esta dañado.\n";
+        return false;
+    }
+
+    removeEntry(parent, leaf);
+    inode.free = true;
+    writeInode(offset, inode);
+    releaseInode(offset);
+    names.unlock();
+
+    std::vector<Extent> extents;
+    for (int64_t block : nodes) extents.push_back({block, 1});
+    releaseExtents(extents, true);
+    saveBitmap();
+    return true;
+}
+
+
+void BlockDevice::cat(const std::string &file)
+{
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+    std::shared_lock<std::shared_mutex> guard;
+    int64_t inodeOffset = lookupShared(file, guard);
+    if (inodeOffset == -1)
+    {
+        consoleErr() << "File not found.\n";
+        return;
+    }
+
+    readStream(readInode(inodeOffset), [](const char *data, size_t len) {
+        consoleOut().write(data, len);
+        return !consoleOut().fail();
+    });
+}
+
+void BlockDevice::hexdump(const std::string &file) {
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+    std::shared_lock<std::shared_mutex> guard;
+    int64_t inodeOffset = lookupShared(file, guard);
+    Inodo inode = inodeOffset == -1 ? Inodo() : readInode(inodeOffset);
+    if (inode.size == 0) {
+        consoleOut() << "No contiene texto.\n";
+        return;
+    }
+
+    size_t i = 0;
+    readStream(inode, [&i](const char *data, size_t len) {
+        for (size_t j = 0; j < len; j++, i++) {
+            unsigned int num = static_cast<unsigned char>(data[j]);
+            consoleOut() << std::hex << std::setw(2) << std::setfill('0') << num << " ";
+            if ((i + 1) % 16 == 0) {
+                consoleOut() << std::endl;
+            }
+        }
+        return true;
+    });
+
+    consoleOut() << std::dec << "\n\n";
+}
+
+bool BlockDevice::write(const std::string &file, const std::string &text)
+{
+    ScopedLatency timer(stats, StatOp::WRITE);
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+
+    size_t pos = 0;
+    bool ok = writeStream(file, text.size(), [&](char *dst, size_t len) {
+        std::memcpy(dst, text.data() + pos, len);
+        pos += len;
+        return true;
+    });
+
+    endOperation();
+    return ok;
+}
+
+std::vector<char> &BlockDevice::getStreamBuffer() {
+    static thread_local std::vector<char> streamBuffer;
+
+    size_t blocks = std::max<size_t>(1, STREAM_BUFFER_BYTES / getBlockSize());
+    if (streamBuffer.size() != blocks * getBlockSize()) {
+        streamBuffer.assign(blocks * getBlockSize(), 0);
+    }
+    return streamBuffer;
+}
+
+// Une tramos que quedaron uno a continuacion del otro
+static void mergeAdjacent(std::vector<Extent> &extents) {
+    size_t out = 0;
+    for (size_t i = 0; i < extents.size(); i++) {
+        if (out > 0 && extents[out - 1].start + static_cast<int64_t>(extents[out - 1].length) == extents[i].start) {
+            extents[out - 1].length += extents[i].length;
+        } else {
+            extents[out++] = extents[i];
+        }
+    }
+    extents.resize(out);
+}
+
+bool BlockDevice::writeStream(const std::string &file, size_t size, const std::function<bool(char *, size_t)> &fill)
+{
+    if (!isOpen()) {
+        consoleErr() << "Error: No block device is open.\n";
+        return false;
+    }
+    if (isSnapshotPath(file)) return false;
+    size_t blockCount = (size + getBlockSize() - 1) / getBlockSize();
+
+    std::shared_lock<std::shared_mutex> txn(commitMutex);
+    // La marca entra en la transaccion antes de que se comparta el primer bloque
+    if (deduplication) markSharedBlocks();
+
+    // El inodo queda bloqueado en exclusivo hasta terminar: los lectores ven el archivo viejo o el nuevo
+    std::unique_lock<std::shared_mutex> guard;
+    int64_t inodeOffset;
+    {
+        std::shared_lock<std::shared_mutex> names(namespaceMutex);
+        inodeOffset = buscarInodo(file);
+        if (inodeOffset != -1) guard = std::unique_lock<std::shared_mutex>(inodeLock(inodeOffset));
+    }
+
+    bool nuevo = inodeOffset == -1;
+    if (nuevo)
+    {
+        std::unique_lock<std::shared_mutex> names(namespaceMutex);
+
+        // Otro hilo pudo crearlo entre los dos candados
+        inodeOffset = buscarInodo(file);
+        nuevo = inodeOffset == -1;
+        if (nuevo)
+        {
+            std::string leaf;
+            int64_t parent = resolveParent(file, leaf);
+            if (parent == -1 || leaf.size() >= sizeof(Inodo::name))
+            {
+                consoleErr() << "El directorio no existe o el nombre es demasiado largo.\n";
+                return false;
+            }
+
+            int64_t freeInodeOffset = buscarInodoLibre();
+            if (freeInodeOffset == -1)
+            {
+                consoleErr() << "NO hay ninguna inodo disponible.\n";
+                return false;
+            }
+            inodeOffset = freeInodeOffset;
+
+            // Se reserva vacio y con nombre; quien lo busque espera al candado del inodo
+            writeInode(inodeOffset, Inodo(leaf, false));
+            if (!addEntry(parent, leaf, inodeOffset))
+            {
+                writeInode(inodeOffset, Inodo());
+                releaseInode(inodeOffset);
+                consoleErr() << "No se pudo agregar la entrada al directorio.\n";
+                return false;
+            }
+        }
+        guard = std::unique_lock<std::shared_mutex>(inodeLock(inodeOffset));
+    }
+
+    Inodo oldInode = readInode(inodeOffset);
+    if (oldInode.isDirectory())
+    {
+        consoleErr() << "Es un directorio.\n";
+        return false;
+    }
+
+    // El nombre en el inodo es el del ultimo componente de la ruta
+    Inodo inode("", false);
+    std::memcpy(inode.name, oldInode.name, sizeof(inode.name));
+    inode.size = size;
+
+    // Un archivo chico va dentro del inodo: una sola escritura, que entra en el journal.
+    // Si despues se reescribe mas grande vuelve a tener bloques, y al reves
+    if (size > 0 && size <= Inodo::INLINE_BYTES)
+    {
+        inode.type = Inodo::INLINE_TYPE;
+        std::memset(inode.inlineData(), 0, Inodo::INLINE_BYTES);
+        if (!fill(inode.inlineData(), size))
+        {
+            consoleErr() << "Error al leer los datos de origen.\n";
+            if (nuevo)
+            {
+                guard.unlock();
+                dropReservation(file, inodeOffset);
+            }
+            return false;
+        }
+
+        writeInode(inodeOffset, inode);
+        releaseBlocks(oldInode, true);
+        saveBitmap();
+        return true;
+    }
+
+    std::vector<Extent> extents;
+    auto rollback = [&]() {
+        releaseBlocks(inode);
+        // Con deduplicacion algunos pueden ser de otro archivo: solo se devuelve la referencia
+        releaseExtents(extents, true);
+        saveBitmap();
+
+        if (nuevo)
+        {
+            guard.unlock();
+            dropReservation(file, inodeOffset);
+        }
+        return false;
+    };
+
+    // El primer trozo se lee antes de decidir: si no comprime, el archivo va tal cual y
+    // no paga las cabeceras de cada trozo. Despues se entrega de nuevo desde head
+    bool comprimir = compression && size > getBlockSize();
+    static thread_local std::vector<char> head;
+    size_t headLen = 0, headPos = 0;
+    std::function<bool(char *, size_t)> source = fill;
+    if (comprimir)
+    {
+        headLen = std::min(getCompressionChunk(), size);
+        head.resize(headLen);
+        if (!fill(head.data(), headLen))
+        {
+            consoleErr() << "Error al leer los datos de origen.\n";
+            return rollback();
+        }
+        comprimir = worthCompressing(head.data(), headLen);
+        source = [&](char *dst, size_t len) {
+            size_t count = std::min(len, headLen - headPos);
+            std::memcpy(dst, head.data() + headPos, count);
+            headPos += count;
+            return count == len || fill(dst + count, len - count);
+        };
+    }
+
+    // Deduplicado cada trozo reserva solo los bloques que no encontro
+    bool deduplicar = deduplication && !comprimir;
+    if (deduplicar)
+    {
+        if (!writeDeduped(size, source, extents))
+        {
+            consoleErr() << "Error al escribir los bloques del archivo.\n";
+            return rollback();
+        }
+    }
+    else
+    {
+        // Comprimido se reserva el peor caso, se escribe y la cola sin usar vuelve al mapa
+        if (comprimir) blockCount = getCompressedBlocks(size);
+
+        if (!allocateExtents(blockCount, extents))
+        {
+            consoleErr() << "NO hay bloques libres suficientes.\n";
+            return rollback();
+        }
+        mergeAdjacent(extents);
+    }
+
+    if (comprimir)
+    {
+        size_t usedBlocks = 0;
+        if (!writeCompressed(extents, size, source, usedBlocks))
+        {
+            consoleErr() << "Error al escribir los bloques del archivo.\n";
+            return rollback();
+        }
+
+        // Nadie referencia todavia los bloques sobrantes: se liberan sin esperar al commit
+        size_t kept = 0, out = 0;
+        for (const Extent &extent : extents)
+        {
+            size_t keep = std::min<size_t>(extent.length, usedBlocks - kept);
+            if (keep < extent.length) freeBlockMap.markFree(extent.start + keep, extent.length - keep);
+            if (keep > 0) extents[out++] = {extent.start, keep};
+            kept += keep;
+        }
+        extents.resize(out);
+        inode.type = Inodo::COMPRESSED_TYPE;
+    }
+
+    if (!writeExtents(inode, extents))
+    {
+        consoleErr() << "El archivo esta demasiado fragmentado.\n";
+        return rollback();
+    }
+    // releaseBlocks ya libera los tramos de un inodo con extents escritos
+    std::vector<Extent> written = extents;
+    extents.clear();
+
+    // Se llena el buffer una vez por trozo y se reparte en una escritura por tramo.
+    // Los datos comprimidos o deduplicados ya se escribieron
+    std::vector<char> &buffer = getStreamBuffer();
+    size_t current = 0, blockInExtent = 0, pos = comprimir || deduplicar ? size : 0;
+
+    static thread_local std::vector<RunIO> runs;
+
+    while (pos < size)
+    {
+        size_t chunk = std::min(buffer.size(), size - pos);
+        if (!source(buffer.data(), chunk))
+        {
+            consoleErr() << "Error al leer los datos de origen.\n";
+            return rollback();
+        }
+
+        // El ultimo bloque parcial se completa con ceros
+        size_t blocks = (chunk + getBlockSize() - 1) / getBlockSize();
+        std::memset(buffer.data() + chunk, 0, blocks * getBlockSize() - chunk);
+
+        runs.clear();
+        for (size_t done = 0; done < blocks;)
+        {
+            const Extent &extent = written[current];
+            size_t count = std::min<size_t>(extent.length - blockInExtent, blocks - done);
+            runs.push_back({static_cast<size_t>(extent.start) + blockInExtent, count, buffer.data() + done * getBlockSize()});
+
+            done += count;
+            blockInExtent += count;
+            if (blockInExtent == extent.length)
+            {
+                current++;
+                blockInExtent = 0;
+            }
+        }
+
+        if (!writeRuns(runs))
+        {
+            consoleErr() << "Error al escribir los bloques del archivo.\n";
+            return rollback();
+        }
+        pos += chunk;
+    }
+
+    writeInode(inodeOffset, inode);
+
+    releaseBlocks(oldInode, true);
+    saveBitmap();
+
+    return true;
+}
+
+size_t BlockDevice::getCompressedBlocks(size_t size) {
+    size_t chunks = (size + getCompressionChunk() - 1) / getCompressionChunk();
+    return (size + chunks * sizeof(uint32_t) + getBlockSize() - 1) / getBlockSize();
+}
+
+bool BlockDevice::worthCompressing(const char *src, size_t len) {
+    // Una muestra que no baja al menos un octavo descarta el trozo entero
+    static thread_local std::vector<char> scratch(COMPRESSION_SAMPLE_BYTES);
+    size_t sample = std::min(len, COMPRESSION_SAMPLE_BYTES);
+    return lzCompress(src, sample, scratch.data(), sample - sample / 8) != 0;
+}
+
+size_t BlockDevice::compressChunk(const char *src, size_t len, char *dst) {
+    if (len > COMPRESSION_SAMPLE_BYTES && !worthCompressing(src, len)) return 0;
+
+    // Solo sirve si queda mas chico que el original
+    return lzCompress(src, len, dst, len - 1);
+}
+
+bool BlockDevice::writeCompressed(const std::vector<Extent> &extents, size_t size,
+                                  const std::function<bool(char *, size_t)> &fill, size_t &usedBlocks)
+{
+    size_t bs = getBlockSize();
+    size_t chunkBytes = getCompressionChunk();
+    usedBlocks = 0;
+
+    // La salida se junta en el buffer de flujo y se escribe cada vez que se llena
+    std::vector<char> &buffer = getStreamBuffer();
+    static thread_local std::vector<char> plain, packed;
+    static thread_local std::vector<RunIO> runs;
+    plain.resize(chunkBytes);
+    packed.resize(chunkBytes);
+
+    size_t current = 0, blockInExtent = 0, filled = 0;
+
+    auto flush = [&]() {
+        size_t blocks = (filled + bs - 1) / bs;
+        std::memset(buffer.data() + filled, 0, blocks * bs - filled);
+
+        runs.clear();
+        for (size_t done = 0; done < blocks;) {
+            if (current == extents.size()) return false;
+            const Extent &extent = extents[current];
+            size_t count = std::min<size_t>(extent.length - blockInExtent, blocks - done);
+            runs.push_back({static_cast<size_t>(extent.start) + blockInExtent, count, buffer.data() + done * bs});
+
+            done += count;
+            blockInExtent += count;
+            if (blockInExtent == extent.length) {
+                current++;
+                blockInExtent = 0;
+            }
+        }
+
+        usedBlocks += blocks;
+        filled = 0;
+        return writeRuns(runs);
+    };
+    auto put = [&](const char *src, size_t len) {
+        while (len > 0) {
+            size_t count = std::min(len, buffer.size() - filled);
+            std::memcpy(buffer.data() + filled, src, count);
+            filled += count;
+            src += count;
+            len -= count;
+            if (filled == buffer.size() && !flush()) return false;
+        }
+        return true;
+    };
+
+    for (size_t pos = 0; pos < size;) {
+        size_t logical = std::min(chunkBytes, size - pos);
+        if (!fill(plain.data(), logical)) return false;
+
+        size_t stored = compressChunk(plain.data(), logical, packed.data());
+        uint32_t header = static_cast<uint32_t>(stored != 0 ? stored : logical);
+        if (!put(reinterpret_cast<const char *>(&header), sizeof(header)) ||
+            !put(stored != 0 ? packed.data() : plain.data(), header)) {
+            return false;
+        }
+        pos += logical;
+    }
+
+    return filled == 0 || flush();
+}
+
+void BlockDevice::markSharedBlocks()
+{
+    std::unique_lock<std::shared_mutex> names(namespaceMutex);
+    if (superblock.features & Superblock::SHARED_BLOCKS) return;
+
+    // Una version anterior no sabria contar referencias: la imagen pasa al menos a la 4
+    // (la 5 agrega la tabla de sumas, que una imagen vieja no tiene)
+    superblock.features |= Superblock::SHARED_BLOCKS;
+    if (superblock.hasMagic()) superblock.version = std::max<uint32_t>(superblock.version, 4);
+    writeSuperblock();
+}
+
+void BlockDevice::rebuildReferences()
+{
+    // Cada extent suma uno donde empieza y resta uno donde termina; recorriendo los bordes
+    // en orden, los tramos cubiertos dos o mas veces son los compartidos
+    std::vector<std::pair<size_t, int>> edges;
+    std::vector<Extent> extents;
+
+    for (size_t block = superblock.inodesInitialBlockPos; block < inodeBlocksEnd(); block++) {
+        if (!inodeBlockUsed(block)) continue;
+
+        for (size_t i = 0; i < superblock.inodesPerBlock; i++) {
+            Inodo inode = readInode(block * getBlockSize() + i * sizeof(Inodo));
+            if (inode.free || inode.isDirectory() || inode.isInline()) continue;
+            // Lo que se pudo leer cuenta igual: sin esas referencias, un bloque compartido
+            // se liberaria con el primero de sus duenos que se borre
+            if (!readExtents(inode, extents)) {
+                consoleErr() << "Aviso: No se pudieron leer todos los tramos de " << inode.name << ".\n";
+            }
+
+            for (const Extent &extent : extents) {
+                edges.push_back({static_cast<size_t>(extent.start), 1});
+                edges.push_back({extent.start + extent.length, -1});
+            }
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    std::vector<DedupIndex::SharedRun> runs;
+    uint32_t depth = 0;
+    for (size_t i = 0; i < edges.size();) {
+        size_t pos = edges[i].first;
+        for (; i < edges.size() && edges[i].first == pos; i++) depth += edges[i].second;
+        if (depth < 2 || i == edges.size()) continue;
+
+        size_t count = edges[i].first - pos;
+        if (!runs.empty() && runs.back().first + runs.back().count == pos && runs.back().refs == depth) {
+            runs.back().count += count;
+        } else {
+            runs.push_back({pos, count, depth});
+        }
+    }
+    dedupIndex.setRefs(runs);
+}
+
+bool BlockDevice::writeDeduped(size_t size, const std::function<bool(char *, size_t)> &fill, std::vector<Extent> &extents)
+{
+    size_t bs = getBlockSize();
+    std::vector<char> &buffer = getStreamBuffer();
+    // Por bloque del trozo: huella, bloque del device y primer bloque del trozo con el mismo contenido
+    static thread_local std::vector<uint64_t> hashes;
+    static thread_local std::vector<int64_t> targets;
+    static thread_local std::vector<size_t> sameAs;
+    static thread_local std::vector<size_t> written;
+    static thread_local std::vector<char> candidates;
+    static thread_local std::vector<Extent> fresh;
+    static thread_local std::vector<RunIO> runs;
+    std::unordered_map<uint64_t, size_t> local;
+
+    extents.clear();
+    auto append = [&](int64_t block) {
+        if (!extents.empty() && extents.back().start + static_cast<int64_t>(extents.back().length) == block) {
+            extents.back().length++;
+        } else {
+            extents.push_back({block, 1});
+        }
+    };
+    // Lo que esta en extents tiene una referencia de este archivo; el resto del trozo, en targets
+    auto fail = [&](size_t blocks) {
+        for (size_t i = 0; i < blocks; i++) {
+            if (sameAs[i] == i && targets[i] >= 0) append(targets[i]);
+        }
+        releaseExtents(extents, true);
+        extents.clear();
+        return false;
+    };
+
+    for (size_t pos = 0; pos < size;) {
+        size_t chunk = std::min(buffer.size(), size - pos);
+        if (!fill(buffer.data(), chunk)) return fail(0);
+
+        size_t blocks = (chunk + bs - 1) / bs;
+        std::memset(buffer.data() + chunk, 0, blocks * bs - chunk);
+
+        // Primero las huellas de todo el trozo en una pasada, despues las busquedas
+        hashes.resize(blocks);
+        for (size_t i = 0; i < blocks; i++) hashes[i] = DedupIndex::fingerprint(buffer.data() + i * bs, bs);
+
+        targets.assign(blocks, -1);
+        sameAs.resize(blocks);
+        local.clear();
+        for (size_t i = 0; i < blocks; i++) {
+            sameAs[i] = i;
+            auto seen = local.find(hashes[i]);
+            if (seen != local.end() && std::memcmp(buffer.data() + seen->second * bs, buffer.data() + i * bs, bs) == 0) {
+                sameAs[i] = seen->second;
+                continue;
+            }
+            targets[i] = dedupIndex.acquire(hashes[i]);
+            local.emplace(hashes[i], i);
+        }
+
+        // Dos contenidos distintos pueden dar la misma huella: cada candidato se compara con el
+        // disco, y los que estan seguidos en el device se leen juntos
+        for (size_t i = 0; i < blocks;) {
+            if (sameAs[i] != i || targets[i] == -1) {
+                i++;
+                continue;
+            }
+            size_t run = 1;
+            while (i + run < blocks && sameAs[i + run] == i + run && targets[i + run] == targets[i] + static_cast<int64_t>(run)) {
+                run++;
+            }
+
+            candidates.resize(run * bs);
+            bool read = readRun(targets[i], run, candidates.data());
+            for (size_t k = i; k < i + run; k++) {
+                if (read && std::memcmp(candidates.data() + (k - i) * bs, buffer.data() + k * bs, bs) == 0) {
+                    dedupHits++;
+                    continue;
+                }
+                releaseExtents({{targets[k], 1}}, true);
+                targets[k] = -1;
+            }
+            i += run;
+        }
+
+        size_t needed = 0;
+        for (size_t i = 0; i < blocks; i++) {
+            if (sameAs[i] == i && targets[i] == -1) needed++;
+        }
+        if (!allocateExtents(needed, fresh)) {
+            consoleErr() << "NO hay bloques libres suficientes.\n";
+            return fail(blocks);
+        }
+
+        // Los bloques nuevos seguidos en el trozo y en el device van en una sola escritura
+        size_t current = 0, blockInExtent = 0;
+        runs.clear();
+        written.clear();
+        for (size_t i = 0; i < blocks; i++) {
+            if (sameAs[i] != i) {
+                targets[i] = targets[sameAs[i]];
+                dedupIndex.addRef(targets[i]);
+            } else if (targets[i] == -1) {
+                targets[i] = fresh[current].start + blockInExtent;
+                if (++blockInExtent == fresh[current].length) {
+                    current++;
+                    blockInExtent = 0;
+                }
+
+                char *data = buffer.data() + i * bs;
+                RunIO *last = runs.empty() ? nullptr : &runs.back();
+                if (last && last->firstBlock + last->blockCount == static_cast<size_t>(targets[i]) &&
+                    last->data + last->blockCount * bs == data) {
+                    last->blockCount++;
+                } else {
+                    runs.push_back({static_cast<size_t>(targets[i]), 1, data});
+                }
+                written.push_back(i);
+            }
+            append(targets[i]);
+        }
+
+        if (!writeRuns(runs)) return fail(0);
+
+        // Recien escritos pueden servir a los bloques que vengan despues
+        for (size_t i : written) dedupIndex.insert(hashes[i], targets[i]);
+        pos += chunk;
+    }
+    return true;
+}
+
+bool BlockDevice::readCompressed(const Inodo &inode, size_t limit, const std::function<bool(const char *, size_t)> &sink)
+{
+    std::vector<Extent> extents;
+    if (!readExtents(inode, extents)) return false;
+    mergeAdjacent(extents);
+
+    size_t bs = getBlockSize();
+    size_t chunkBytes = getCompressionChunk();
+
+    std::vector<char> &buffer = getStreamBuffer();
+    static thread_local std::vector<char> plain, packed;
+    plain.resize(chunkBytes);
+    packed.resize(chunkBytes);
+
+    // Los bloques se leen en orden, de a un buffer por vez
+    size_t current = 0, blockInExtent = 0, available = 0, at = 0;
+
+    auto take = [&](char *dst, size_t len) {
+        while (len > 0) {
+            if (at == available) {
+                if (current == extents.size()) return false;
+                const Extent &extent = extents[current];
+                size_t count = std::min<size_t>(extent.length - blockInExtent, buffer.size() / bs);
+                if (!readRun(extent.start + blockInExtent, count, buffer.data())) return false;
+
+                available = count * bs;
+                at = 0;
+                blockInExtent += count;
+                if (blockInExtent == extent.length) {
+                    current++;
+                    blockInExtent = 0;
+                }
+            }
+
+            size_t count = std::min(len, available - at);
+            std::memcpy(dst, buffer.data() + at, count);
+            at += count;
+            dst += count;
+            len -= count;
+        }
+        return true;
+    };
+
+    for (size_t done = 0; done < limit;) {
+        size_t logical = std::min(chunkBytes, static_cast<size_t>(inode.size) - done);
+        uint32_t stored;
+        if (!take(reinterpret_cast<char *>(&stored), sizeof(stored)) || stored > logical ||
+            !take(packed.data(), stored)) {
+            consoleErr() << "Error: Failed to read block data.\n";
+            return false;
+        }
+
+        const char *data = packed.data();
+        if (stored < logical) {
+            if (!lzDecompress(packed.data(), stored, plain.data(), logical)) {
+                consoleErr() << "Error: Datos comprimidos dañados.\n";
+                return false;
+            }
+            data = plain.data();
+        }
+
+        size_t count = std::min(logical, limit - done);
+        if (!sink(data, count)) return false;
+        done += count;
+    }
+    return true;
+}
+
+bool BlockDevice::readStream(const Inodo &inode, const std::function<bool(const char *, size_t)> &sink)
+{
+    ScopedLatency timer(stats, StatOp::READ);
+    if (inode.isInline()) return sink(inode.inlineData(), std::min<size_t>(inode.size, Inodo::INLINE_BYTES));
+    if (inode.isCompressed()) return readCompressed(inode, inode.size, sink);
+
+    std::vector<Extent> extents;
+    if (!readExtents(inode, extents)) return false;
+    mergeAdjacent(extents);
+
+    std::vector<char> &buffer = getStreamBuffer();
+    size_t bufferBlocks = buffer.size() / getBlockSize();
+    size_t remaining = inode.size;
+    size_t filled = 0;
+
+    // Los tramos que caben en el buffer se leen juntos antes de entregarlo
+    static thread_local std::vector<RunIO> runs;
+    runs.clear();
+
+    for (const Extent &extent : extents)
+    {
+        for (size_t block = 0; block < extent.length && remaining > filled;)
+        {
+            size_t needed = (remaining - filled + getBlockSize() - 1) / getBlockSize();
+            size_t count = std::min({extent.length - block, bufferBlocks - filled / getBlockSize(), needed});
+
+            runs.push_back({static_cast<size_t>(extent.start) + block, count, buffer.data() + filled});
+            filled += count * getBlockSize();
+            block += count;
+
+            if (filled == buffer.size() || filled >= remaining)
+            {
+                if (!readRuns(runs)) return false;
+                runs.clear();
+
+                size_t len = std::min(filled, remaining);
+                if (!sink(buffer.data(), len)) return false;
+                remaining -= len;
+                filled = 0;
+            }
+        }
+    }
+
+    return remaining == 0;
+}
+
+bool BlockDevice::copyOut(const std::string &file1, const std::string &file2)
+{
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+    std::shared_lock<std::shared_mutex> guard;
+    int64_t inodeOffset = lookupShared(file1, guard);
+    if (inodeOffset == -1)
+    {
+        consoleErr() << "File not found.\n";
+        return false;
+    }
+
+    std::ofstream out(file2, std::ios::binary);
+    if (!out.is_open())
+    {
+        return false;
+    }
+
+    bool ok = readStream(readInode(inodeOffset), [&out](const char *data, size_t len) {
+        out.write(data, len);
+        return !out.fail();
+    });
+
+    return ok && !out.fail();
+}
+
+bool BlockDevice::copyIn(const std::string &file1, const std::string &file2)
+{
+    ScopedLatency timer(stats, StatOp::WRITE);
+    std::ifstream in(file1, std::ios::binary | std::ios::ate);
+    if (!in.is_open())
+    {
+        return false;
+    }
+
+    size_t size = in.tellg();
+    in.seekg(0, std::ios::beg);
+
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+    bool ok = writeStream(file2, size, [&in](char *dst, size_t len) {
+        in.read(dst, len);
+        return static_cast<size_t>(in.gcount()) == len;
+    });
+
+    endOperation();
+    return ok;
+}
+
+bool BlockDevice::remove(const std::string &file)
+{
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+
+    bool ok = removeFile(file);
+    endOperation();
+    return ok;
+}
+
+bool BlockDevice::removeFile(const std::string &file)
+{
+    if (isSnapshotPath(file)) return false;
+    std::shared_lock<std::shared_mutex> txn(commitMutex);
+    std::unique_lock<std::shared_mutex> names(namespaceMutex);
+
+    std::string leaf;
+    int64_t parent = resolveParent(file, leaf);
+    int64_t inodeOffset = parent == -1 ? -1 : index.find(parent, leaf);
+    
+    if (inodeOffset == -1)
+    {
+        consoleErr() << "Archivo no encontrado.\n";
+        return false;
+    }
+
+    // Se espera a que terminen los lectores y escritores del archivo
+    std::unique_lock<std::shared_mutex> guard(inodeLock(inodeOffset));
+    Inodo inode = readInode(inodeOffset);
+    if (inode.isDirectory())
+    {
+        consoleErr() << "Es un directorio; se borra con rmdir.\n";
+        return false;
+    }
+
+    inode.free = true;
+
+    writeInode(inodeOffset, inode);
+    removeEntry(parent, leaf);
+    releaseInode(inodeOffset);
+    names.unlock();
+
+    releaseBlocks(inode, true);
+    saveBitmap();
+
+    return true;
+}
+
+int64_t BlockDevice::cloneInode(int64_t source, const std::string &name)
+{
+    bool directory = source == InodeIndex::ROOT || readInode(source).isDirectory();
+    Inodo original = source == InodeIndex::ROOT ? Inodo() : readInode(source);
+
+    int64_t offset = buscarInodoLibre();
+    if (offset == -1) {
+        consoleErr() << "NO hay ninguna inodo disponible.\n";
+        return -1;
+    }
+
+    Inodo copy(name, false);
+    copy.type = original.type;
+    copy.size = original.size;
+
+    if (directory) {
+        int64_t root = freeBlockMap.allocate();
+        if (root == BlockAllocator::NONE) {
+            releaseInode(offset);
+            consoleErr() << "NO hay bloques libres suficientes.\n";
+            return -1;
+        }
+        std::vector<char> node(getBlockSize());
+        DirectoryTree::initNode(node.data(), getBlockSize());
+        cache.write(root, node.data(), node.size());
+
+        // addEntry cuenta las entradas a medida que entran
+        copy.type = Inodo::DIRECTORY_TYPE;
+        copy.size = 0;
+        copy.extents[0] = {root, 1};
+        writeInode(offset, copy);
+
+        // Las entradas se juntan antes: no se inserta en un arbol mientras se recorre otro
+        std::vector<std::pair<std::string, int64_t>> entries;
+        directories.scan(directoryRoot(source), "", [&](const char *entry, int64_t child) {
+            entries.emplace_back(entry, child);
+            return true;
+        });
+        for (const auto &[entry, child] : entries) {
+            int64_t childCopy = cloneInode(child, entry);
+            if (childCopy == -1 || !addEntry(offset, entry, childCopy)) {
+                if (childCopy != -1) releaseTree(childCopy);
+                releaseTree(offset);
+                return -1;
+            }
+        }
+        return offset;
+    }
+
+    // Un archivo en linea se copia entero con el inodo
+    if (original.isInline()) {
+        std::memcpy(copy.inlineData(), original.inlineData(), Inodo::INLINE_BYTES);
+        writeInode(offset, copy);
+        return offset;
+    }
+
+    // Los extents son los mismos; los bloques indirectos que los guardan son nuevos
+    std::vector<Extent> extents;
+    if (!readExtents(original, extents) || !writeExtents(copy, extents)) {
+        releaseInode(offset);
+        saveBitmap();
+        consoleErr() << "No se pudieron copiar los extents de " << name << ".\n";
+        return -1;
+    }
+    for (const Extent &extent : extents) dedupIndex.addRef(extent.start, extent.length);
+    writeInode(offset, copy);
+    saveBitmap();
+    return offset;
+}
+
+void BlockDevice::releaseTree(int64_t offset)
+{
+    Inodo inode = readInode(offset);
+
+    if (inode.isDirectory()) {
+        int64_t root = inode.extents[0].start;
+        std::vector<std::pair<std::string, int64_t>> entries;
+        directories.scan(root, "", [&](const char *entry, int64_t child) {
+            entries.emplace_back(entry, child);
+            return true;
+        });
+        for (const auto &[entry, child] : entries) {
+            releaseTree(child);
+            index.erase(offset, entry);
+        }
+
+        std::vector<int64_t> nodes{root};
+        directories.collectNodes(root, nodes);
+        std::vector<Extent> extents;
+        for (int64_t block : nodes) extents.push_back({block, 1});
+        releaseExtents(extents, true);
+    } else {
+        releaseBlocks(inode, true);
+    }
+
+    inode.free = true;
+    writeInode(offset, inode);
+    releaseInode(offset);
+    saveBitmap();
+}
+
+bool BlockDevice::snapshot(const std::string &name)
+{
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+    if (!isOpen()) {
+        consoleErr() << "Error: No block device is open.\n";
+        return false;
+    }
+    if (name.empty() || name.find('/') != std::string::npos || name.size() >= sizeof(Inodo::name)) {
+        consoleErr() << "Nombre de instantanea invalido.\n";
+        return false;
+    }
+
+    // Sin operaciones a medias: la instantanea ve cada archivo entero, viejo o nuevo
+    std::unique_lock<std::shared_mutex> txn(commitMutex);
+    markSharedBlocks();
+    std::unique_lock<std::shared_mutex> names(namespaceMutex);
+
+    if (superblock.snapshotDirBlock == 0) {
+        int64_t root = freeBlockMap.allocate();
+        if (root == BlockAllocator::NONE) {
+            consoleErr() << "NO hay bloques libres suficientes.\n";
+            return false;
+        }
+        std::vector<char> node(getBlockSize());
+        DirectoryTree::initNode(node.data(), getBlockSize());
+        cache.write(root, node.data(), node.size());
+        superblock.snapshotDirBlock = root;
+        writeSuperblock();
+        saveBitmap();
+    }
+    if (index.find(InodeIndex::SNAPSHOTS, name) != -1) {
+        consoleErr() << "Ya existe una instantanea con ese nombre.\n";
+        return false;
+    }
+
+    int64_t offset = cloneInode(InodeIndex::ROOT, name);
+    if (offset == -1 || !addEntry(InodeIndex::SNAPSHOTS, name, offset)) {
+        if (offset != -1) releaseTree(offset);
+        consoleErr() << "No se pudo crear la instantanea.\n";
+        return false;
+    }
+    return commitLocked();
+}
+
+bool BlockDevice::deleteSnapshot(const std::string &name)
+{
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+    if (!isOpen()) {
+        consoleErr() << "Error: No block device is open.\n";
+        return false;
+    }
+
+    std::unique_lock<std::shared_mutex> txn(commitMutex);
+    std::unique_lock<std::shared_mutex> names(namespaceMutex);
+
+    int64_t offset = index.find(InodeIndex::SNAPSHOTS, name);
+    if (offset == -1) {
+        consoleErr() << "Instantanea no encontrada.\n";
+        return false;
+    }
+
+    removeEntry(InodeIndex::SNAPSHOTS, name);
+    releaseTree(offset);
+    return commitLocked();
+}
+
+bool BlockDevice::clone(const std::string &source, const std::string &target)
+{
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+    if (!isOpen()) {
+        consoleErr() << "Error: No block device is open.\n";
+        return false;
+    }
+    if (isSnapshotPath(target)) return false;
+
+    std::unique_lock<std::shared_mutex> txn(commitMutex);
+    markSharedBlocks();
+    std::unique_lock<std::shared_mutex> names(namespaceMutex);
+
+    int64_t offset = buscarInodo(source);
+    if (offset == -1) {
+        consoleErr() << "Archivo no encontrado.\n";
+        return false;
+    }
+
+    std::string leaf;
+    int64_t parent = resolveParent(target, leaf);
+    if (parent == -1 || leaf.size() >= sizeof(Inodo::name)) {
+        consoleErr() << "El directorio no existe o el nombre es demasiado largo.\n";
+        return false;
+    }
+    if (index.find(parent, leaf) != -1) {
+        consoleErr() << "Ya existe un archivo o directorio con ese nombre.\n";
+        return false;
+    }
+
+    int64_t copy = cloneInode(offset, leaf);
+    if (copy == -1 || !addEntry(parent, leaf, copy)) {
+        if (copy != -1) releaseTree(copy);
+        consoleErr() << "No se pudo crear la copia.\n";
+        return false;
+    }
+    return commitLocked();
+}
+
+bool BlockDevice::defragStep(size_t sliceMillis)
+{
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+    if (!isOpen()) {
+        consoleErr() << "Error: No block device is open.\n";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> running(defragMutex);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(sliceMillis);
+
+    if (defragPhase == DefragPhase::DONE) {
+        defragPhase = DefragPhase::METADATA;
+        defragCursor = 0;
+        defragRound = 0;
+        defragSkipped = false;
+        defragProgress = DefragProgress();
+    }
+    defragProgress.steps++;
+
+    if (defragPhase == DefragPhase::METADATA) {
+        bool finished = false;
+        if (!defragMetadata(deadline, finished)) {
+            defragProgress.failed = true;
+            defragPhase = DefragPhase::DONE;
+            return false;
+        }
+        if (!finished) return true;
+        defragPhase = DefragPhase::RELOCATE;
+    }
+
+    while (std::chrono::steady_clock::now() < deadline) {
+        int64_t offset = -1;
+        {
+            std::shared_lock<std::shared_mutex> names(namespaceMutex);
+            size_t slots = (inodeBlocksEnd() - superblock.inodesInitialBlockPos) * superblock.inodesPerBlock;
+            while (defragCursor < slots && inodeMap.isFree(defragCursor)) defragCursor++;
+            if (defragCursor < slots) offset = inodeOffsetOf(defragCursor++);
+        }
+        if (offset == -1 && defragSkipped && defragRound == 0) {
+            // Lo que se libero en la primera vuelta tiene que estar confirmado para reutilizarse
+            std::unique_lock<std::shared_mutex> txn(commitMutex);
+            if (!commitLocked()) {
+                defragProgress.failed = true;
+                defragPhase = DefragPhase::DONE;
+                return false;
+            }
+            defragRound++;
+            defragCursor = 0;
+            continue;
+        }
+        if (offset == -1) {
+            // Los bloques que quedaron atras se liberan al confirmar
+            defragPhase = DefragPhase::DONE;
+            std::unique_lock<std::shared_mutex> txn(commitMutex);
+            if (!commitLocked()) defragProgress.failed = true;
+            return false;
+        }
+        if (relocateFile(offset) > 0) endOperation();
+    }
+    return true;
+}
+
+bool BlockDevice::defrag(size_t sliceMillis)
+{
+    {
+        std::lock_guard<std::mutex> running(defragMutex);
+        defragPhase = DefragPhase::DONE;
+    }
+
+    while (defragStep(sliceMillis)) {
+        // Lo que espero los candados durante el paso entra antes del siguiente
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    std::lock_guard<std::mutex> running(defragMutex);
+    const DefragProgress &done = defragProgress;
+    if (done.failed) return false;
+    consoleOut() << "Defrag: " << done.files << " archivos reubicados (" << done.blocks << " bloques), "
+              << done.movedInodes << " inodos movidos en la tabla, " << done.reclaimedBlocks << " bloques y "
+              << done.reclaimedInodes << " inodos recuperados, en " << done.steps << " pasos\n";
+    if (done.unreadableFiles != 0) {
+        consoleErr() << "Error: " << done.unreadableFiles << " archivos con tramos ilegibles no se reubicaron.\n";
+    }
+    if (done.unownedBlocks != 0) {
+        consoleOut() << "  " << done.unownedBlocks << " bloques en uso que ningun archivo referencia se conservan"
+                  << " (pueden ser de write <bloque>; fsck liberar los libera)\n";
+    }
+    return done.unreadableFiles == 0;
+}
+
+bool BlockDevice::defragMetadata(std::chrono::steady_clock::time_point deadline, bool &finished)
+{
+    // Con lo pendiente confirmado, lo que siga en uso sin que nada lo alcance es huerfano
+    std::unique_lock<std::shared_mutex> txn(commitMutex);
+    if (!commitLocked()) return false;
+    std::unique_lock<std::shared_mutex> names(namespaceMutex);
+
+    // referenced: lo que usa algo vivo. orphaned: lo que usaban los inodos sin nombre, lo unico
+    // que se libera; un bloque en uso sin dueno puede tener datos de writeBlock y se deja
+    std::vector<bool> referenced(getBlockCount());
+    std::vector<bool> orphaned(getBlockCount());
+    auto mark = [](std::vector<bool> &blocks, int64_t first, size_t count) {
+        for (int64_t block = first; block >= 0 && block < first + static_cast<int64_t>(count) &&
+                                    static_cast<size_t>(block) < blocks.size(); block++) {
+            blocks[block] = true;
+        }
+    };
+    // false si no se pudieron leer los extents del archivo
+    std::vector<Extent> extents;
+    auto markInode = [&](std::vector<bool> &blocks, const Inodo &inode) {
+        if (inode.isInline()) return true;
+        if (inode.isDirectory()) {
+            std::vector<int64_t> nodes{inode.extents[0].start};
+            directories.collectNodes(inode.extents[0].start, nodes);
+            for (int64_t node : nodes) mark(blocks, node, 1);
+            return true;
+        }
+
+        if (!readExtents(inode, extents)) return false;
+        for (const Extent &extent : extents) mark(blocks, extent.start, extent.length);
+        mark(blocks, inode.indirect, 1);
+        if (inode.doubleIndirect != -1) {
+            mark(blocks, inode.doubleIndirect, 1);
+            BlockRef pointers = pinBlock(inode.doubleIndirect);
+            for (size_t i = 0; i < pointers.size() / sizeof(int64_t); i++) {
+                int64_t block;
+                std::memcpy(&block, pointers.data() + i * sizeof(int64_t), sizeof(int64_t));
+                if (block == -1) break;
+                mark(blocks, block, 1);
+            }
+        }
+        return true;
+    };
+
+    // Los arboles desde la raiz y las instantaneas dicen que inodos estan vivos y quien los nombra
+    ParentMap parents;
+    std::vector<int64_t> pending{InodeIndex::ROOT, InodeIndex::SNAPSHOTS};
+    while (!pending.empty()) {
+        int64_t dir = pending.back();
+        pending.pop_back();
+
+        int64_t root = directoryRoot(dir);
+        if (root == -1) continue;
+        std::vector<int64_t> nodes{root};
+        directories.collectNodes(root, nodes);
+        for (int64_t node : nodes) mark(referenced, node, 1);
+
+        directories.scan(root, "", [&](const char *name, int64_t offset) {
+            if (!parents.emplace(offset, std::make_pair(dir, std::string(name))).second) return true;
+            if (readInode(offset).isDirectory()) pending.push_back(offset);
+            return true;
+        });
+    }
+
+    size_t slots = (inodeBlocksEnd() - superblock.inodesInitialBlockPos) * superblock.inodesPerBlock;
+    bool freedInodes = false;
+    bool intact = true;
+    for (size_t slot = 0; slot < slots; slot++) {
+        if (inodeMap.isFree(slot)) continue;
+        int64_t offset = inodeOffsetOf(slot);
+        Inodo inode = readInode(offset);
+
+        // Un inodo que ningun directorio nombra quedo de una operacion cortada
+        if (inode.free || parents.count(offset) == 0) {
+            if (!inode.free) {
+                markInode(orphaned, inode);
+                inode.free = true;
+                writeInode(offset, inode);
+            }
+            inodeMap.markFree(slot, 1);
+            defragProgress.reclaimedInodes++;
+            freedInodes = true;
+            continue;
+        }
+        if (inode.isDirectory()) continue;
+
+        // Sin los extents de un archivo no se sabe que bloques usa: no se recupera ninguno
+        if (!markInode(referenced, inode)) intact = false;
+    }
+
+    // Las regiones fijas (antes de initialBlock) siempre estan en uso. Lo que tambien use un
+    // archivo vivo (un bloque compartido) no se libera
+    defragProgress.unownedBlocks = 0;
+    for (size_t block = superblock.initialBlock; intact && block < getBlockCount(); block++) {
+        if (referenced[block] || freeBlockMap.isFree(block)) continue;
+        if (!orphaned[block]) {
+            defragProgress.unownedBlocks++;
+            continue;
+        }
+
+        size_t end = block + 1;
+        while (end < getBlockCount() && !referenced[end] && orphaned[end] && !freeBlockMap.isFree(end)) end++;
+        // Una huella que apunte a un bloque libre haria compartir lo que se va a pisar
+        if (dedupIndex.fingerprints() != 0) {
+            for (size_t b = block; b < end; b++) dedupIndex.forget(b);
+        }
+        freeBlockMap.markFree(block, end - block);
+        defragProgress.reclaimedBlocks += end - block;
+        block = end - 1;
+    }
+    if (freedInodes && (superblock.features & Superblock::SHARED_BLOCKS)) rebuildReferences();
+
+    // El inodo en uso mas alto pasa al hueco libre mas bajo, mientras eso vacie bloques de la tabla
+    // Al menos un inodo por paso: si el recorrido ya consumio el tiempo, igual se avanza
+    finished = true;
+    size_t low = 0, high = slots;
+    for (size_t moves = 0;; moves++) {
+        while (low < slots && !inodeMap.isFree(low)) low++;
+        while (high > low && inodeMap.isFree(high - 1)) high--;
+        if (high <= low || (high - 1) / superblock.inodesPerBlock == low / superblock.inodesPerBlock) break;
+        if (moves > 0 && std::chrono::steady_clock::now() >= deadline) {
+            finished = false;
+            break;
+        }
+
+        inodeMap.markUsed(low, 1);
+        moveInode(inodeOffsetOf(high - 1), inodeOffsetOf(low), parents);
+        defragProgress.movedInodes++;
+    }
+
+    saveBitmap();
+    saveInodeMap();
+    return commitLocked();
+}
+
+void BlockDevice::moveInode(int64_t from, int64_t to, ParentMap &parents)
+{
+    // Los lectores que ya tienen el inodo terminan antes; los nuevos lo buscan por nombre
+    std::unique_lock<std::shared_mutex> guard(inodeLock(from));
+    Inodo inode = readInode(from);
+    writeInode(to, inode);
+
+    auto [parent, name] = parents[from];
+    parents.erase(from);
+    parents[to] = {parent, name};
+
+    int64_t root = directoryRoot(parent);
+    directories.erase(root, name);
+    if (!directories.insert(root, name, to)) consoleErr() << "Aviso: No se pudo actualizar la entrada " << name << ".\n";
+    index.erase(parent, name);
+    index.insert(parent, name, to);
+
+    // Las entradas del indice van por el offset del directorio
+    if (inode.isDirectory()) {
+        directories.scan(inode.extents[0].start, "", [&](const char *child, int64_t offset) {
+            index.erase(from, child);
+            index.insert(to, child, offset);
+            parents[offset].first = to;
+            return true;
+        });
+    }
+
+    writeInode(from, Inodo());
+    inodeMap.markFree(inodeSlotOf(from), 1);
+}
+
+size_t BlockDevice::relocateFile(int64_t offset)
+{
+    std::shared_lock<std::shared_mutex> txn(commitMutex);
+    std::unique_lock<std::shared_mutex> guard(inodeLock(offset));
+
+    Inodo inode = readInode(offset);
+    if (inode.free || inode.isDirectory() || inode.isInline()) return 0;
+
+    // Sin la lista entera el inodo nuevo perderia los tramos que no se leyeron
+    std::vector<Extent> extents;
+    if (!readExtents(inode, extents)) {
+        consoleErr() << "Error: No se pudieron leer los tramos de " << inode.name << "; no se reubica.\n";
+        defragProgress.unreadableFiles++;
+        return 0;
+    }
+    if (extents.empty()) return 0;
+    bool fragmented = extents.size() > 1;
+    size_t total = 0;
+    for (const Extent &extent : extents) {
+        // Mover un bloque compartido obligaria a cambiar todos los inodos que lo usan
+        if (dedupIndex.isShared(extent.start, extent.length)) return 0;
+        total += extent.length;
+    }
+
+    // Un archivo de un solo tramo solo baja, asi el espacio libre se junta al final. Uno
+    // fragmentado va a un tramo contiguo o, si no hay, a tramos que se achican a la mitad
+    // mientras el archivo termine con menos tramos que ahora
+    std::vector<Extent> target;
+    if (!fragmented) {
+        int64_t start = freeBlockMap.allocateContiguous(total);
+        if (start == BlockAllocator::NONE) return 0;
+        if (start >= extents[0].start) {
+            freeBlockMap.markFree(start, total);
+            return 0;
+        }
+        target.push_back({start, total});
+    } else {
+        size_t minRun = total / extents.size() + 1;
+        size_t remaining = total;
+        for (size_t want = total; remaining > 0;) {
+            size_t size = std::min(want, remaining);
+            int64_t start = size == 0 ? BlockAllocator::NONE : freeBlockMap.allocateContiguous(size);
+            if (start != BlockAllocator::NONE) {
+                target.push_back({start, size});
+                remaining -= size;
+                continue;
+            }
+            if (size < minRun) break;
+            want = size / 2;
+        }
+        mergeAdjacent(target);
+        if (remaining > 0 || target.size() >= extents.size()) {
+            for (const Extent &extent : target) freeBlockMap.markFree(extent.start, extent.length);
+            defragSkipped = true;
+            return 0;
+        }
+    }
+
+    // Los bloques pasan tal cual (tambien los trozos comprimidos). Un bloque que no coincide
+    // con su suma corta la copia: en el lugar nuevo tendria una suma valida
+    size_t bs = getBlockSize();
+    auto writeTarget = [&](size_t pos, const char *data, size_t count) {
+        for (const Extent &extent : target) {
+            if (count == 0) break;
+            if (pos >= extent.length) {
+                pos -= extent.length;
+                continue;
+            }
+            size_t n = std::min<size_t>(count, extent.length - pos);
+            if (!writeRun(extent.start + pos, data, n * bs)) return false;
+            data += n * bs;
+            count -= n;
+            pos = 0;
+        }
+        return true;
+    };
+
+    std::vector<char> &buffer = getStreamBuffer();
+    size_t maxRun = buffer.size() / bs;
+    size_t pos = 0;
+    bool ok = true;
+    for (const Extent &extent : extents) {
+        for (size_t done = 0; ok && done < extent.length;) {
+            size_t count = std::min<size_t>(maxRun, extent.length - done);
+            ok = readRun(extent.start + done, count, buffer.data()) && writeTarget(pos, buffer.data(), count);
+            done += count;
+            pos += count;
+        }
+    }
+
+    Inodo moved = inode;
+    for (Extent &extent : moved.extents) extent = {-1, 0};
+    moved.indirect = moved.doubleIndirect = -1;
+    if (!ok || !writeExtents(moved, target)) {
+        for (const Extent &extent : target) freeBlockMap.markFree(extent.start, extent.length);
+        saveBitmap();
+        consoleErr() << "No se pudo reubicar " << inode.name << ".\n";
+        return 0;
+    }
+    writeInode(offset, moved);
+
+    // El inodo viejo sigue en el disco hasta el commit: sus bloques esperan a que pase
+    releaseBlocks(inode, true);
+    saveBitmap();
+    defragProgress.files++;
+    defragProgress.blocks += total;
+    return total;
+}
+
+size_t BlockDevice::getBlockCount() {
+    return deviceBlocks;
+}
+
+int BlockDevice::getEstado(size_t index) {
+    if (index >= freeBlockMap.getBlockCount()) return -1;
+    return freeBlockMap.isFree(index);
+}
+
+bool BlockDevice::scrub(size_t threads)
+{
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+    if (!isOpen()) {
+        consoleErr() << "Error: No block device is open.\n";
+        return false;
+    }
+    if (!checksums.isEnabled()) {
+        consoleErr() << "Error: La imagen no tiene sumas de verificacion (es anterior a la version 5).\n";
+        return false;
+    }
+
+    // Con lo pendiente confirmado el disco es la unica copia; las escrituras esperan al final
+    std::unique_lock<std::shared_mutex> txn(commitMutex);
+    if (!commitLocked()) return false;
+
+    // Tramos de bloques en uso con suma, de a lo que entra en el buffer de cada hilo
+    size_t bs = getBlockSize();
+    size_t maxRun = std::max<size_t>(1, STREAM_BUFFER_BYTES / bs);
+    std::vector<std::pair<size_t, size_t>> runs;
+    size_t checked = 0;
+    for (size_t block = 0; block < getBlockCount(); block++) {
+        if (freeBlockMap.isFree(block) || !checksums.hasChecksum(block)) continue;
+
+        checked++;
+        if (!runs.empty() && runs.back().first + runs.back().second == block && runs.back().second < maxRun) {
+            runs.back().second++;
+        } else {
+            runs.push_back({block, 1});
+        }
+    }
+
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::max<size_t>(1, std::min(threads, runs.size()));
+
+    std::atomic<size_t> next{0};
+    std::atomic<bool> readFailed{false};
+    std::mutex badMutex;
+    std::vector<size_t> bad;
+
+    auto worker = [&]() {
+        std::vector<char> &buffer = getStreamBuffer();
+        for (size_t i = next++; i < runs.size(); i = next++) {
+            auto [first, count] = runs[i];
+            stats.noteRead(first * bs, count * bs, bs);
+            if (!storage->readAt(first * bs, buffer.data(), count * bs)) {
+                readFailed = true;
+                continue;
+            }
+
+            for (size_t j = 0; j < count; j++) {
+                if (checksums.verify(first + j, buffer.data() + j * bs)) continue;
+                std::lock_guard<std::mutex> lock(badMutex);
+                bad.push_back(first + j);
+            }
+        }
+    };
+
+    // Los mensajes de los hilos van a donde van los de quien llamo
+    std::ostream &out = consoleOut(), &err = consoleErr();
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < threads; i++) {
+        pool.emplace_back([&] {
+            ConsoleRedirect console(out, err);
+            worker();
+        });
+    }
+    worker();
+    for (std::thread &thread : pool) thread.join();
+
+    std::sort(bad.begin(), bad.end());
+    checksumErrors += bad.size();
+
+    auto regionOf = [&](size_t block) -> const char * {
+        if (block == 0) return "superbloque";
+        if (block < superblock.journalStart) return "mapa de bloques";
+        if (block >= superblock.inodeMapPos && block < superblock.inodeMapPos + superblock.inodeMapBlocks) return "mapa de inodos";
+        if (block >= superblock.inodesInitialBlockPos && block < superblock.initialBlock) return "tabla de inodos";
+        if (block >= superblock.initialBlock) return "datos o metadatos de archivos";
+        return "metadatos";
+    };
+
+    consoleOut() << "Scrub: " << checked << " bloques revisados con " << threads << " hilos, "
+              << bad.size() << " con errores\n";
+    constexpr size_t MAX_LISTED = 16;
+    for (size_t i = 0; i < bad.size() && i < MAX_LISTED; i++) {
+        consoleOut() << "  Bloque " << bad[i] << " (" << regionOf(bad[i]) << ")\n";
+    }
+    if (bad.size() > MAX_LISTED) consoleOut() << "  ... y " << bad.size() - MAX_LISTED << " mas\n";
+    if (readFailed) consoleErr() << "Error: No se pudieron leer algunos bloques.\n";
+
+    return bad.empty() && !readFailed;
+}
+
+bool BlockDevice::trim()
+{
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+    if (!isOpen()) {
+        consoleErr() << "Error: No block device is open.\n";
+        return false;
+    }
+
+    // Con lo pendiente confirmado, el mapa dice exactamente que bloques no referencia el disco;
+    // las demas operaciones esperan hasta el final para no tomar uno mientras tanto
+    std::unique_lock<std::shared_mutex> txn(commitMutex);
+    if (!commitLocked()) return false;
+
+    std::vector<Extent> runs;
+    size_t blocks = 0;
+    for (size_t block = superblock.initialBlock; block < getBlockCount(); block++) {
+        if (!freeBlockMap.isFree(block)) continue;
+
+        blocks++;
+        if (!runs.empty() && static_cast<size_t>(runs.back().start) + runs.back().length == block) {
+            runs.back().length++;
+        } else {
+            runs.push_back({static_cast<int64_t>(block), 1});
+        }
+    }
+
+    // Las sumas viejas se borran en el disco antes de que los bloques pasen a leerse en ceros
+    for (const Extent &run : runs) checksums.clear(run.start, run.length);
+    if (!commitLocked()) return false;
+
+    // Un fallo anterior pudo ser pasajero: se vuelve a probar
+    punchSupported = true;
+    if (punchExtents(runs) < runs.size()) return false;
+
+    consoleOut() << "Trim: " << blocks << " bloques libres devueltos en " << runs.size() << " tramos\n";
+    return true;
+}
+
+bool BlockDevice::fsckClaim(FsckState &state, const Inodo &inode, int delta)
+{
+    size_t count = getBlockCount();
+    bool ok = true;
+    // Lo anterior a initialBlock (superbloque, mapas, journal, sumas y tabla de inodos) no es de nadie
+    auto claim = [&](std::vector<std::atomic<uint32_t>> &refs, int64_t start, uint64_t length) {
+        if (start < static_cast<int64_t>(superblock.initialBlock) || length == 0 || length > count ||
+            static_cast<uint64_t>(start) > count - length) {
+            ok = false;
+            return false;
+        }
+        for (uint64_t i = 0; i < length; i++) {
+            refs[start + i].fetch_add(static_cast<uint32_t>(delta), std::memory_order_relaxed);
+            if (delta < 0) state.orphaned[start + i] = 1;
+        }
+        return true;
+    };
+
+    if (inode.isDirectory()) {
+        int64_t root = inode.extents[0].start;
+        std::vector<int64_t> nodes;
+        // La raiz de una imagen nueva tiene su primer nodo en el area fija
+        bool fixedRoot = static_cast<uint64_t>(root) == superblock.rootDirBlock && root < static_cast<int64_t>(superblock.initialBlock);
+        if (!fixedRoot && !claim(state.metaRefs, root, 1)) return false;
+        if (!directories.collectNodes(root, nodes)) ok = false;
+        for (int64_t node : nodes) claim(state.metaRefs, node, 1);
+        return ok;
+    }
+    if (inode.isInline()) return true;
+
+    // Los datos se leen como en readExtents; los bloques de extents se cuentan como en releaseBlocks
+    uint64_t blocks = 0;
+    auto claimList = [&](int64_t block) {
+        BlockRef rawData = pinBlock(block);
+        if (!rawData) {
+            ok = false;
+            return false;
+        }
+        for (size_t i = 0; i < rawData.size() / sizeof(Extent); i++) {
+            Extent extent;
+            std::memcpy(&extent, rawData.data() + i * sizeof(Extent), sizeof(Extent));
+            if (extent.start == -1) return false;
+            if (claim(state.dataRefs, extent.start, extent.length)) blocks += extent.length;
+        }
+        return true;
+    };
+
+    bool more = true;
+    for (int i = 0; i < Inodo::DIRECT_EXTENTS && more; i++) {
+        const Extent &extent = inode.extents[i];
+        if (extent.start == -1) more = false;
+        else if (claim(state.dataRefs, extent.start, extent.length)) blocks += extent.length;
+    }
+
+    if (inode.indirect != -1 && claim(state.metaRefs, inode.indirect, 1) && more) {
+        more = claimList(inode.indirect);
+    } else {
+        more = false;
+    }
+
+    if (inode.doubleIndirect != -1 && claim(state.metaRefs, inode.doubleIndirect, 1)) {
+        BlockRef pointers = pinBlock(inode.doubleIndirect);
+        if (!pointers) ok = false;
+        for (size_t i = 0; pointers && i < pointers.size() / sizeof(int64_t); i++) {
+            int64_t block;
+            std::memcpy(&block, pointers.data() + i * sizeof(int64_t), sizeof(int64_t));
+            if (block == -1 || !claim(state.metaRefs, block, 1)) break;
+            if (more) more = claimList(block);
+        }
+    }
+
+    // Un archivo comprimido ocupa menos que su tamano; uno comun no
+    if (delta > 0 && !inode.isCompressed() && blocks * getBlockSize() < inode.size) state.shortFiles++;
+    return ok;
+}
+
+bool BlockDevice::fsck(size_t threads, bool freeUnowned)
+{
+    std::shared_lock<std::shared_mutex> device(deviceMutex);
+    if (!isOpen()) {
+        consoleErr() << "Error: No block device is open.\n";
+        return false;
+    }
+
+    // Con lo pendiente confirmado el disco y la memoria dicen lo mismo; nada mas corre hasta el final
+    std::unique_lock<std::shared_mutex> txn(commitMutex);
+    if (!commitLocked()) return false;
+    std::unique_lock<std::shared_mutex> names(namespaceMutex);
+
+    size_t bs = getBlockSize();
+    size_t count = getBlockCount();
+    size_t perBlock = superblock.inodesPerBlock;
+    size_t tableBlocks = inodeBlocksEnd() - superblock.inodesInitialBlockPos;
+    size_t slots = tableBlocks * perBlock;
+
+    FsckState state;
+    state.dataRefs = std::vector<std::atomic<uint32_t>>(count);
+    state.metaRefs = std::vector<std::atomic<uint32_t>>(count);
+    state.orphaned.assign(count, 0);
+    // Por inodo de la parte inicializada de la tabla: 0 libre, 1 archivo, 2 directorio
+    std::vector<uint8_t> kinds(slots, 0);
+    std::atomic<size_t> damaged{0};
+
+    struct Entry
+    {
+        int64_t dir;
+        std::string name;
+        int64_t offset;
+    };
+    // Cuenta los nodos del arbol y junta sus entradas; el limite corta una cadena de hojas en ciclo
+    auto walkDirectory = [&](int64_t dir, const Inodo &inode, std::vector<Entry> &entries) {
+        if (!fsckClaim(state, inode, 1)) {
+            damaged++;
+            return;
+        }
+        std::vector<int64_t> nodes;
+        directories.collectNodes(inode.extents[0].start, nodes);
+        size_t limit = (nodes.size() + 1) * DirectoryTree::fanout(bs);
+        directories.scan(inode.extents[0].start, "", [&](const char *name, int64_t offset) {
+            entries.push_back({dir, name, offset});
+            return --limit > 0;
+        });
+    };
+
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    // Tramos chicos de la tabla: un hilo que cae en directorios grandes no frena a los demas
+    size_t chunk = std::max<size_t>(1, tableBlocks / (threads * 8));
+    threads = std::max<size_t>(1, std::min(threads, (tableBlocks + chunk - 1) / chunk));
+    std::vector<std::vector<Entry>> found(threads);
+
+    // La raiz y las instantaneas no tienen inodo
+    for (int64_t dir : {InodeIndex::ROOT, InodeIndex::SNAPSHOTS}) {
+        int64_t root = directoryRoot(dir);
+        if (root == -1) continue;
+        Inodo tree;
+        tree.type = Inodo::DIRECTORY_TYPE;
+        tree.extents[0] = {root, 1};
+        walkDirectory(dir, tree, found[0]);
+    }
+
+    std::atomic<size_t> next{0};
+    auto worker = [&](std::vector<Entry> &entries) {
+        for (size_t start = next.fetch_add(chunk); start < tableBlocks; start = next.fetch_add(chunk)) {
+            for (size_t block = start; block < std::min(start + chunk, tableBlocks); block++) {
+                size_t tableBlock = superblock.inodesInitialBlockPos + block;
+                BlockRef rawData = pinBlock(tableBlock);
+                if (!rawData) {
+                    damaged++;
+                    continue;
+                }
+
+                for (size_t i = 0; i < perBlock; i++) {
+                    Inodo inode;
+                    std::memcpy(&inode, rawData.data() + i * sizeof(Inodo), sizeof(Inodo));
+                    if (inode.free) continue;
+
+                    int64_t offset = tableBlock * bs + i * sizeof(Inodo);
+                    kinds[block * perBlock + i] = inode.isDirectory() ? 2 : 1;
+                    if (inode.isDirectory()) walkDirectory(offset, inode, entries);
+                    else if (!fsckClaim(state, inode, 1)) damaged++;
+                }
+            }
+        }
+    };
+
+    // Los mensajes de los hilos van a donde van los de quien llamo
+    std::ostream &out = consoleOut(), &err = consoleErr();
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < threads; i++) {
+        pool.emplace_back([&, i] {
+            ConsoleRedirect console(out, err);
+            worker(found[i]);
+        });
+    }
+    worker(found[0]);
+    for (std::thread &thread : pool) thread.join();
+
+    // Los nombres se recorren desde la raiz y las instantaneas: lo que no se alcanza es huerfano
+    std::vector<Entry> entries;
+    for (std::vector<Entry> &part : found) {
+        std::move(part.begin(), part.end(), std::back_inserter(entries));
+        std::vector<Entry>().swap(part);
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        return a.dir != b.dir ? a.dir < b.dir : a.name < b.name;
+    });
+    std::unordered_map<int64_t, std::pair<size_t, size_t>> ranges;
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (i == 0 || entries[i].dir != entries[i - 1].dir) ranges[entries[i].dir].first = i;
+        ranges[entries[i].dir].second = i + 1;
+    }
+
+    auto slotOf = [&](int64_t offset) -> int64_t {
+        if (offset < static_cast<int64_t>(superblock.inodesInitialBlockPos * bs) ||
+            offset >= static_cast<int64_t>(inodeBlocksEnd() * bs)) return -1;
+        size_t inBlock = offset % bs;
+        if (inBlock % sizeof(Inodo) != 0 || inBlock / sizeof(Inodo) >= perBlock) return -1;
+        return inodeSlotOf(offset);
+    };
+
+    std::vector<uint8_t> named(slots, 0);
+    std::vector<size_t> kept;
+    std::vector<std::pair<int64_t, std::string>> dangling;
+    std::vector<std::pair<int64_t, size_t>> dirSizes;
+    size_t duplicateNames = 0;
+    std::vector<int64_t> pending{InodeIndex::ROOT, InodeIndex::SNAPSHOTS};
+    while (!pending.empty()) {
+        int64_t dir = pending.back();
+        pending.pop_back();
+
+        size_t children = 0;
+        auto range = ranges.find(dir);
+        for (size_t i = range != ranges.end() ? range->second.first : 0;
+             range != ranges.end() && i < range->second.second; i++) {
+            const Entry &entry = entries[i];
+            bool repeated = i + 1 < range->second.second && entries[i + 1].name == entry.name;
+            if (i > range->second.first && entries[i - 1].name == entry.name) {
+                duplicateNames++;
+                continue;
+            }
+
+            // Una entrada a un inodo libre, o a uno que ya tiene nombre, se borra (si el nombre es unico)
+            int64_t slot = slotOf(entry.offset);
+            if (slot == -1 || kinds[slot] == 0 || named[slot]) {
+                if (!repeated) dangling.push_back({dir, entry.name});
+                continue;
+            }
+
+            named[slot] = 1;
+            children++;
+            kept.push_back(i);
+            if (kinds[slot] == 2) pending.push_back(entry.offset);
+        }
+        if (dir != InodeIndex::ROOT && dir != InodeIndex::SNAPSHOTS) dirSizes.push_back({dir, children});
+    }
+
+    for (const auto &[dir, name] : dangling) directories.erase(directoryRoot(dir), name);
+
+    size_t dirFixes = 0;
+    for (const auto &[dir, children] : dirSizes) {
+        Inodo inode = readInode(dir);
+        if (inode.size == children) continue;
+        inode.size = children;
+        writeInode(dir, inode);
+        dirFixes++;
+    }
+
+    // Inodos sin nombre: sus bloques dejan de contar. Con un directorio o una parte de la tabla
+    // ilegible no se sabe que es huerfano, asi que no se libera nada
+    bool intact = damaged == 0;
+    size_t orphans = 0;
+    for (size_t slot = 0; slot < slots; slot++) {
+        if (kinds[slot] == 0 || named[slot]) continue;
+
+        orphans++;
+        if (!intact) continue;
+        int64_t offset = inodeOffsetOf(slot);
+        Inodo inode = readInode(offset);
+        fsckClaim(state, inode, -1);
+        inode.free = true;
+        writeInode(offset, inode);
+        inodeMap.markFree(slot, 1);
+        kinds[slot] = 0;
+    }
+
+    size_t inodeMapFixes = 0;
+    for (size_t slot = 0; slot < getInodeSlots(); slot++) {
+        bool used = slot < slots && kinds[slot] != 0;
+        if (used == !inodeMap.isFree(slot)) continue;
+        if (used) inodeMap.markUsed(slot, 1);
+        else inodeMap.markFree(slot, 1);
+        inodeMapFixes++;
+    }
+
+    // El mapa de bloques sale de las cuentas; lo usado por dos archivos pasa a compartido
+    std::vector<DedupIndex::SharedRun> shared;
+    std::vector<Extent> leaked;
+    std::vector<size_t> conflicts;
+    size_t leakedBlocks = 0, unownedBlocks = 0, missingBlocks = 0, sharedFixes = 0, fixedRegion = 0;
+    bool sharedFeature = superblock.features & Superblock::SHARED_BLOCKS;
+    for (size_t block = 0; block < count; block++) {
+        bool free = freeBlockMap.isFree(block);
+        if (block < superblock.initialBlock) {
+            if (free) {
+                freeBlockMap.markUsed(block, 1);
+                fixedRegion++;
+            }
+            continue;
+        }
+
+        uint32_t data = state.dataRefs[block].load(std::memory_order_relaxed);
+        uint32_t meta = state.metaRefs[block].load(std::memory_order_relaxed);
+        if (meta > 1 || (meta != 0 && data != 0)) conflicts.push_back(block);
+        if (data > 1) {
+            if (!sharedFeature) sharedFixes++;
+            if (!shared.empty() && shared.back().first + shared.back().count == block && shared.back().refs == data) {
+                shared.back().count++;
+            } else {
+                shared.push_back({block, 1, data});
+            }
+        }
+
+        if (data + meta == 0 && !free) {
+            // Nada lo referencia ni lo uso un inodo sin nombre: puede tener datos de writeBlock
+            if (!state.orphaned[block] && !freeUnowned) {
+                unownedBlocks++;
+                continue;
+            }
+            leakedBlocks++;
+            if (!intact) continue;
+            if (!leaked.empty() && static_cast<size_t>(leaked.back().start) + leaked.back().length == block) {
+                leaked.back().length++;
+            } else {
+                leaked.push_back({static_cast<int64_t>(block), 1});
+            }
+        } else if (data + meta != 0 && free) {
+            freeBlockMap.markUsed(block, 1);
+            missingBlocks++;
+        }
+    }
+
+    dedupIndex.setRefs(shared);
+    if (sharedFixes != 0) markSharedBlocks();
+    // Los perdidos se liberan con el commit, como los de un remove (y sus huellas se olvidan)
+    releaseExtents(leaked, true);
+
+    index.clear();
+    for (size_t i : kept) index.insert(entries[i].dir, entries[i].name, entries[i].offset);
+
+    saveBitmap();
+    saveInodeMap();
+    bool committed = commitLocked();
+
+    consoleOut() << "Fsck: " << slots << " inodos y " << count << " bloques revisados con " << threads << " hilos\n";
+    auto report = [](const char *what, size_t n) {
+        if (n != 0) consoleOut() << "  " << what << ": " << n << "\n";
+    };
+    report(intact ? "Inodos sin nombre liberados" : "Inodos sin nombre (no se liberan)", orphans);
+    report("Entradas sin inodo borradas", dangling.size());
+    report("Tamanos de directorio corregidos", dirFixes);
+    report("Inodos corregidos en el mapa", inodeMapFixes);
+    report(intact ? "Bloques perdidos recuperados" : "Bloques perdidos (no se liberan)", leakedBlocks);
+    report("Bloques en uso sin dueno, quizas de write <bloque> (se conservan; fsck liberar los libera)",
+           unownedBlocks);
+    report("Bloques en uso que el mapa daba libres", missingBlocks + fixedRegion);
+    report("Bloques de dos archivos pasados a compartidos", sharedFixes);
+    report("Nombres repetidos (sin reparar)", duplicateNames);
+    report("Inodos con referencias fuera de rango o ilegibles (sin reparar)", damaged.load());
+    report("Archivos con menos bloques que su tamano (sin reparar)", state.shortFiles.load());
+    report("Bloques de metadatos con mas de un dueno (sin reparar)", conflicts.size());
+    constexpr size_t MAX_LISTED = 16;
+    for (size_t i = 0; i < conflicts.size() && i < MAX_LISTED; i++) consoleOut() << "    Bloque " << conflicts[i] << "\n";
+    if (conflicts.size() > MAX_LISTED) consoleOut() << "    ... y " << conflicts.size() - MAX_LISTED << " mas\n";
+
+    return committed && duplicateNames == 0 && damaged == 0 && state.shortFiles == 0 && conflicts.empty();
+}
@@ -6,83 +6,531 @@
 #include <fstream>
 #include <vector>
 #include <iomanip>
+#include <algorithm>
 #include <cstdint>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
 
+#include "BlockCache.hpp"
+#include "StorageBackend.hpp"
+#include "InodeIndex.hpp"
+#include "BlockAllocator.hpp"
+#include "AsyncIO.hpp"
+#include "Journal.hpp"
+#include "Stats.hpp"
+#include "DirectoryTree.hpp"
+#include "DedupIndex.hpp"
+#include "Checksum.hpp"
+
+// Tramo de bloques contiguos de un archivo
+struct Extent
+{
+    int64_t start;   // Primer bloque del tramo, -1 si no se usa
+    uint64_t length; // Cantidad de bloques
+} __attribute__((packed));
+
+// Un directorio usa extents[0].start como raiz de su arbol de entradas y size como
+// cantidad de entradas. Un archivo de hasta INLINE_BYTES guarda sus datos en lugar
+// de los extents y los punteros indirectos; uno comprimido guarda en sus bloques
+// trozos comprimidos por separado. name tenia 64 bytes con el ultimo
+// siempre en cero: las imagenes anteriores leen type como archivo
 struct Inodo
 {
-    char name[64];
-    int64_t offset[8];
+    static constexpr int DIRECT_EXTENTS = 4;
+    static constexpr uint8_t FILE_TYPE = 0;
+    static constexpr uint8_t DIRECTORY_TYPE = 1;
+    static constexpr uint8_t INLINE_TYPE = 2;
+    static constexpr uint8_t COMPRESSED_TYPE = 3;
+
+    char name[63];
+    uint8_t type;
+    Extent extents[DIRECT_EXTENTS];
+    int64_t indirect;       // Bloque lleno de Extents, -1 si no hay
+    int64_t doubleIndirect; // Bloque de punteros a bloques de Extents, -1 si no hay
     size_t size;
     bool free;
 
-    Inodo(const std::string &filename = "", bool _f = true) : free(_f)
+    // Los datos en linea ocupan extents, indirect y doubleIndirect, que estan seguidos
+    static constexpr size_t INLINE_BYTES = sizeof(extents) + sizeof(indirect) + sizeof(doubleIndirect);
+
+    Inodo(const std::string &filename = "", bool _f = true) : type(FILE_TYPE), free(_f)
     {
         std::strncpy(name, filename.c_str(), sizeof(name) - 1);
         name[sizeof(name) - 1] = '\0'; // Asegurar terminación de cadena
-        for (int i = 0; i < 8; i++)
+        for (int i = 0; i < DIRECT_EXTENTS; i++)
         {
-            offset[i] = -1;
+            extents[i].start = -1;
+            extents[i].length = 0;
         }
+        indirect = -1;
+        doubleIndirect = -1;
         size = 0;
     }
+
+    bool isDirectory() const { return type == DIRECTORY_TYPE; }
+    bool isInline() const { return type == INLINE_TYPE; }
+    bool isCompressed() const { return type == COMPRESSED_TYPE; }
+    char *inlineData() { return reinterpret_cast<char *>(extents); }
+    const char *inlineData() const { return reinterpret_cast<const char *>(extents); }
 } __attribute__((packed));
 
+
+// Los campos nuevos se agregan al final: una imagen anterior los lee en cero.
+// Desde la version 1 el superbloque lleva magic y version y describe toda la geometria
 struct Superblock
 {
+    static constexpr char MAGIC[8] = {'S', 'B', 'D', 'E', 'V', 'I', 'C', 'E'};
+    static constexpr uint32_t VERSION = 5;
+    // Puede haber bloques de datos con mas de una referencia: liberar exige contarlas
+    static constexpr uint32_t SHARED_BLOCKS = 1;
+
     uint64_t initialBlock;          // Bloque donde comienzan los datos
     uint64_t byteMapPos;            // Bloque donde comienza el mapa de bloques libres
     uint64_t inodesInitialBlockPos; // Bloque donde comienzan los inodos
     uint64_t inodesPerBlock;        // Cantidad de inodos por bloque
+    uint64_t journalStart;          // Bloque donde comienza el journal
+    uint64_t journalBlocks;         // Bloques del journal, 0 en imagenes sin journal
+    uint64_t blockSize;             // Tamaño de bloque con que se creo la imagen
+    uint64_t inodeBlocksReady;      // Bloques de inodos ya inicializados; 0 (imagen vieja) = toda la tabla
+    uint64_t blockCount;            // Bloques del device
+    uint64_t inodeTableBlocks;      // Largo de la tabla de inodos en bloques
+    char magic[8];                  // MAGIC desde la version 1
+    uint32_t version;
+    uint32_t features;              // Banderas como SHARED_BLOCKS (version 4), en cero antes
+    uint64_t inodeMapPos;           // Mapa de inodos libres (version 2), un bit por inodo de la tabla
+    uint64_t inodeMapBlocks;        // 0 en imagenes anteriores: el mapa se arma al abrir
+    uint64_t rootDirBlock;          // Raiz del arbol del directorio raiz (version 3); 0 = se arma al abrir
+    uint64_t checksumPos;           // Tabla de sumas CRC32C (version 5), una por bloque
+    uint64_t checksumBlocks;        // 0 en imagenes anteriores: se usan sin verificar
+    uint64_t snapshotDirBlock;      // Raiz del arbol de instantaneas (nombre -> directorio); 0 = ninguna
+
+    bool hasMagic() const { return std::memcmp(magic, MAGIC, sizeof(magic)) == 0; }
 
     Superblock()
         : initialBlock(0),
           byteMapPos(0),
           inodesInitialBlockPos(0),
-          inodesPerBlock(0) {}
+          inodesPerBlock(0),
+          journalStart(0),
+          journalBlocks(0),
+          blockSize(0),
+          inodeBlocksReady(0),
+          blockCount(0),
+          inodeTableBlocks(0),
+          magic{},
+          version(0),
+          features(0),
+          inodeMapPos(0),
+          inodeMapBlocks(0),
+          rootDirBlock(0),
+          checksumPos(0),
+          checksumBlocks(0),
+          snapshotDirBlock(0) {}
 
     Superblock(uint64_t _inodesPerBlock, uint64_t _inodesInitialBlockPos)
-        : byteMapPos(1),
-          inodesPerBlock(_inodesPerBlock),
+        : initialBlock(_inodesInitialBlockPos + 1),
+          byteMapPos(1),
           inodesInitialBlockPos(_inodesInitialBlockPos),
-          initialBlock(_inodesInitialBlockPos + 1) {}
+          inodesPerBlock(_inodesPerBlock),
+          journalStart(0),
+          journalBlocks(0),
+          blockSize(0),
+          inodeBlocksReady(0),
+          blockCount(0),
+          inodeTableBlocks(1),
+          magic{},
+          version(0),
+          features(0),
+          inodeMapPos(0),
+          inodeMapBlocks(0),
+          rootDirBlock(0),
+          checksumPos(0),
+          checksumBlocks(0),
+          snapshotDirBlock(0) {}
 };
 
 class BlockDevice
 {
 private:
-    std::fstream file;
+    std::unique_ptr<StorageBackend> storage;
+    std::function<std::unique_ptr<StorageBackend>(BackendType)> backendFactory;
     Superblock superblock;
-    std::vector<bool> freeBlockMap;
-    size_t blockSize;
+    BlockAllocator freeBlockMap;
+    // Un bit por inodo de la tabla; se asigna y libera con el candado de nombres en exclusivo
+    BlockAllocator inodeMap;
+    // Geometria en memoria, tomada del superbloque al abrir: nunca se le pregunta al backend
+    size_t blockSize = 0;
+    size_t deviceBlocks = 0;
+
+    BlockCache cache;
+    size_t cacheCapacity = 256;
+    EvictionPolicy cachePolicy = EvictionPolicy::LRU;
+    size_t cacheShards = 1;
+
+    // Orden de los candados: device -> transacciones -> nombres -> inodo. Un hilo nunca toma dos inodos.
+    // device: exclusivo para open/close/format, compartido para todo lo demas
+    std::shared_mutex deviceMutex;
+    // transacciones: las operaciones que modifican lo toman compartido; el commit, exclusivo
+    std::shared_mutex commitMutex;
+    // nombres: protege el indice, los arboles de directorios y la busqueda de inodos libres
+    std::shared_mutex namespaceMutex;
+    // inodos: lectores comparten, quien reescribe o borra el archivo lo toma exclusivo
+    static constexpr size_t INODE_LOCKS = 64;
+    std::shared_mutex inodeLocks[INODE_LOCKS];
+    std::shared_mutex &inodeLock(int64_t offset) { return inodeLocks[offset / sizeof(Inodo) % INODE_LOCKS]; }
+    // Serializa la copia del mapa a la cache para que un trozo viejo no pise uno nuevo
+    std::mutex bitmapMutex;
+
+    InodeIndex index;
+    std::string imagePath;
+    bool persistIndex = false;
 
     size_t getBlockCount();
     size_t getBlockSize() { return blockSize; };
     int getEstado(size_t index);
 
+    // Resuelve una ruta ("a/b/c", con o sin '/' inicial) componente por componente.
+    // "@nombre/..." empieza en la instantanea nombre
     int64_t buscarInodo(const std::string &filename);
+    // Busca el archivo y deja su inodo bloqueado para lectura; -1 si no existe o es un directorio
+    int64_t lookupShared(const std::string &filename, std::shared_lock<std::shared_mutex> &inodeGuard);
+    void dropReservation(const std::string &filename, int64_t offset);
+    void rebuildIndex();
     Inodo readInode(int64_t offset);
     void writeInode(int64_t offset, const Inodo &inode);
 
     size_t buscarInodoLibre();
-    size_t getSizeMapBlocks();
+    size_t getSizeMapBlocks(size_t blockCount);
     void initializeSuperblock(size_t blockSize, size_t blockCount);
+    // Revisa que el superbloque leido describa una imagen valida de imageSize bytes
+    bool validateSuperblock(uint64_t imageSize);
+    // El superbloque va por la cache para que sus cambios entren en el journal
+    void writeSuperblock();
+
+    // La tabla de inodos se inicializa de a un bloque, al necesitarlo. Los bloques
+    // pasados el final nunca se leen; se recorren con el candado de nombres tomado
+    size_t inodeBlocksEnd() const;
+    std::vector<char> emptyInodeBlock();
+    bool growInodeTable();
+
+    size_t getInodeSlots() const;
+    int64_t inodeOffsetOf(size_t slot);
+    size_t inodeSlotOf(int64_t offset);
+    // true si el bloque de la tabla tiene algun inodo en uso
+    bool inodeBlockUsed(size_t block);
+    void releaseInode(int64_t offset);
+    bool loadInodeMap();
+    void saveInodeMap();
+
+    // Directorios: cada uno guarda sus entradas en un arbol B+; el indice en memoria
+    // hace de cache (directorio, nombre) -> inodo. Todo con el candado de nombres tomado
+    DirectoryTree directories;
+    static bool splitPath(const std::string &path, std::vector<std::string> &parts);
+    // Las rutas dentro de una instantanea no se modifican; avisa por cerr
+    static bool isSnapshotPath(const std::string &path);
+    // Directorio que contiene la ruta (InodeIndex::ROOT o su inodo) y el ultimo componente; -1 si no
+    // existe o esta en una instantanea
+    int64_t resolveParent(const std::string &path, std::string &leaf);
+    // Bloque raiz del arbol del directorio, -1 si dir no es un directorio
+    int64_t directoryRoot(int64_t dir);
+    bool addEntry(int64_t dir, const std::string &name, int64_t offset);
+    void removeEntry(int64_t dir, const std::string &name);
+    // Imagenes anteriores a la version 3: arma el directorio raiz con los archivos de la tabla
+    bool createRootDirectory();
+    bool makeDirectory(const std::string &path);
+    bool removeDirectory(const std::string &path);
+
+    // Instantaneas y clones: se copian los inodos y los arboles de directorios, y los bloques
+    // de datos quedan compartidos con una referencia mas. Como toda escritura de un archivo va
+    // a bloques nuevos, la copia no ve los cambios del original ni al reves.
+    // Requieren la barrera de transacciones en exclusivo y los nombres tomados
+    int64_t cloneInode(int64_t source, const std::string &name);
+    // Libera un directorio o archivo copiado, con todo lo que cuelga de el
+    void releaseTree(int64_t offset);
+
+    // Desfragmentacion por pasos. Primero, con la barrera en exclusivo, se liberan los inodos y
+    // bloques que ningun directorio alcanza y se bajan los inodos del final de la tabla a los
+    // huecos del principio; despues se reubica de a un archivo por vez, con solo ese inodo
+    // bloqueado: uno fragmentado va a un tramo contiguo y uno de un solo tramo baja al primer
+    // hueco donde entre, asi el espacio libre se junta al final. Si a un archivo fragmentado le
+    // falto lugar, se hace una segunda vuelta. Los archivos con bloques compartidos no se mueven
+    enum class DefragPhase
+    {
+        METADATA,
+        RELOCATE,
+        DONE
+    };
+    struct DefragProgress
+    {
+        size_t reclaimedBlocks = 0;
+        size_t reclaimedInodes = 0;
+        size_t unownedBlocks = 0; // En uso sin que nada los referencie: no se liberan
+        size_t unreadableFiles = 0; // Con bloques de tramos ilegibles: no se reubican
+        size_t movedInodes = 0;
+        size_t files = 0;
+        size_t blocks = 0;
+        size_t steps = 0;
+        bool failed = false;
+    };
+    // Inodo alcanzado -> directorio que lo nombra y con que nombre
+    using ParentMap = std::unordered_map<int64_t, std::pair<int64_t, std::string>>;
+    static constexpr size_t DEFRAG_SLICE_MS = 20;
+    std::mutex defragMutex;
+    DefragPhase defragPhase = DefragPhase::DONE;
+    size_t defragCursor = 0;
+    size_t defragRound = 0;
+    bool defragSkipped = false;
+    DefragProgress defragProgress;
+    // finished queda en false si se acabo el tiempo antes de compactar toda la tabla
+    bool defragMetadata(std::chrono::steady_clock::time_point deadline, bool &finished);
+    void moveInode(int64_t from, int64_t to, ParentMap &parents);
+    // Bloques movidos; 0 si el archivo no hacia falta o no se pudo mover
+    size_t relocateFile(int64_t offset);
 
+    // fsck: cuantas veces se usa cada bloque, contado por varios hilos a la vez
+    struct FsckState
+    {
+        std::vector<std::atomic<uint32_t>> dataRefs; // Archivos que lo tienen entre sus datos
+        std::vector<std::atomic<uint32_t>> metaRefs; // Nodos de directorio y bloques de extents
+        std::atomic<size_t> shortFiles{0};
+        std::vector<uint8_t> orphaned; // Bloques que se descontaron de inodos sin nombre
+    };
+    // Cuenta (o descuenta, con delta -1) los bloques del inodo; false si alguna referencia
+    // cae fuera del area de datos o no se pudo leer
+    bool fsckClaim(FsckState &state, const Inodo &inode, int delta);
+
+    // Un inodo por cada BLOCKS_PER_INODE bloques del device
+    static constexpr size_t BLOCKS_PER_INODE = 4;
+
+    size_t getBitmapChunkSize() { return getBlockSize() / sizeof(uint64_t) * sizeof(uint64_t); }
+    bool loadBitmap();
+    void saveBitmap();
+    // deferred: con journal, los bloques no se reutilizan hasta el proximo commit.
+    // false si la lista de tramos no se pudo leer entera: entonces no se libera nada
+    bool releaseBlocks(const Inodo &inode, bool deferred = false);
+    void releaseExtents(const std::vector<Extent> &extents, bool deferred);
+
+    bool allocateExtents(size_t blockCount, std::vector<Extent> &extents);
+    bool readExtents(const Inodo &inode, std::vector<Extent> &extents);
+    bool writeExtents(Inodo &inode, const std::vector<Extent> &extents);
+    bool readExtentBlock(int64_t block, std::vector<Extent> &extents, bool &more);
+    size_t writeExtentBlock(int64_t block, const std::vector<Extent> &extents, size_t first);
+
+    // E/S de tramos contiguos: una sola operacion sobre el backend por tramo
+    bool readRun(size_t firstBlock, size_t blockCount, char *dst);
+    bool writeRun(size_t firstBlock, const char *src, size_t len);
+    // Copia sobre dst lo que la cache o el journal tengan mas nuevo que el disco
+    void overlayNewer(size_t firstBlock, size_t blockCount, char *dst);
+
+    // Varios tramos de bloques completos de una misma operacion. Con E/S asincrona
+    // se parten en peticiones de ASYNC_REQUEST_BYTES y van todas en un solo lote
+    struct RunIO
+    {
+        size_t firstBlock;
+        size_t blockCount;
+        char *data;
+    };
+    bool readRuns(const std::vector<RunIO> &runs);
+    bool writeRuns(const std::vector<RunIO> &runs);
+    bool submitRuns(const std::vector<RunIO> &runs, bool write);
+
+    // Solo con backends que exponen un descriptor (pread)
+    std::unique_ptr<AsyncEngine> engine;
+    bool asyncIO = false;
+    static constexpr unsigned ASYNC_DEPTH = 64;
+    static constexpr size_t ASYNC_REQUEST_BYTES = 128 * 1024;
+
+    // copyIn/copyOut/cat pasan por un buffer fijo reutilizable: la memoria no depende del archivo
+    static constexpr size_t STREAM_BUFFER_BYTES = 1 << 20;
+    // El buffer es por hilo: varias lecturas en paralelo no lo comparten
+    std::vector<char> &getStreamBuffer();
+
+    // Compresion: el archivo se parte en trozos de COMPRESSION_CHUNK_BYTES que se guardan uno
+    // detras de otro, cada uno con su largo (4 bytes) delante. Un trozo que no baja va tal cual.
+    // Leer los primeros bytes solo descomprime los trozos que los contienen. No hay tabla de
+    // trozos: llegar a un offset obliga a leer todos los trozos anteriores, asi que este formato
+    // no sirve para lecturas al azar (hoy todas las lecturas empiezan en el byte 0)
+    static constexpr size_t COMPRESSION_CHUNK_BYTES = 64 * 1024;
+    // Si el comienzo de un trozo no comprime, no se intenta con el resto
+    static constexpr size_t COMPRESSION_SAMPLE_BYTES = 4096;
+    bool compression = false;
+    size_t getCompressionChunk() { return std::max(COMPRESSION_CHUNK_BYTES, getBlockSize()); }
+    // Bloques que puede ocupar un archivo comprimido de size bytes en el peor caso
+    size_t getCompressedBlocks(size_t size);
+    bool worthCompressing(const char *src, size_t len);
+    size_t compressChunk(const char *src, size_t len, char *dst);
+    bool writeCompressed(const std::vector<Extent> &extents, size_t size,
+                         const std::function<bool(char *, size_t)> &fill, size_t &usedBlocks);
+    bool readCompressed(const Inodo &inode, size_t limit, const std::function<bool(const char *, size_t)> &sink);
+
+    // Deduplicacion: cada bloque de un archivo se busca por su huella y, si el device ya
+    // tiene esos mismos bytes, se referencia ese bloque en vez de escribir uno nuevo.
+    // Las referencias se cuentan siempre; las huellas se persisten junto a la imagen al cerrar
+    bool deduplication = false;
+    DedupIndex dedupIndex;
+    std::atomic<uint64_t> dedupHits{0};
+    void markSharedBlocks();
+    // Tras un cierre sucio: cuenta las referencias recorriendo los extents de todos los archivos
+    void rebuildReferences();
+    // Arma en extents los bloques del archivo, nuevos o compartidos, con una referencia tomada cada uno
+    bool writeDeduped(size_t size, const std::function<bool(char *, size_t)> &fill, std::vector<Extent> &extents);
+
+    // Sumas de verificacion: se actualizan al escribir cada bloque y se revisan al leerlo
+    // del disco. La tabla entra en el mismo commit que los bloques que describe.
+    // Sus trozos van por una cache aparte: la de los bloques verifica al cargar con el
+    // candado de su shard tomado, y ahi no puede volver a entrar a buscar la suma
+    ChecksumTable checksums;
+    BlockCache checksumCache;
+    static constexpr size_t CHECKSUM_CACHE_BLOCKS = 64;
+    std::atomic<uint64_t> checksumErrors{0};
+    size_t getChecksumBlocks(size_t blockCount);
+    void configureChecksums();
+    // Pasa los trozos de la tabla que cambiaron a la transaccion en curso; los bloques que el
+    // grupo libera quedan sin suma, porque despues se leen en ceros
+    void stageChecksums(const std::vector<Extent> &released);
+    // Al formatear: la tabla vuelve a ser un agujero, o ceros si el sistema de archivos no los hace
+    bool clearChecksumTable();
+    // cached: el llamador reemplaza lo leido con la cache y el journal, que pueden tener
+    // ya otra version del bloque
+    bool verifyBlocks(size_t firstBlock, size_t blockCount, const char *data, bool cached = false);
+    void updateBlocks(size_t firstBlock, size_t blockCount, const char *data);
+
+    bool writeStream(const std::string &file, size_t size, const std::function<bool(char *, size_t)> &fill);
+    bool readStream(const Inodo &inode, const std::function<bool(const char *, size_t)> &sink);
+    bool readData(const Inodo &inode, char *dst, size_t len, size_t &bytesRead);
+
+    // Versiones sin candado del device, para usar dentro de operaciones que ya lo tienen
+    BlockRef pinBlock(size_t blockNumber);
+    bool flush();
+
+    void configureCache();
+    bool loadBlock(size_t blockNumber, char *dst);
+    bool storeBlock(size_t blockNumber, const char *src);
+
+    DeviceStats stats;
+
+    // Journal: lo que la cache tiene sucio (mas lo desalojado) forma la transaccion del grupo.
+    // Se confirma cada JOURNAL_GROUP_OPS operaciones, cuando llena medio journal, o en sync/close
+    Journal journal;
+    static constexpr size_t JOURNAL_GROUP_OPS = 64;
+    std::atomic<size_t> opsSinceCommit{0};
+    std::atomic<bool> checkpointing{false};
+    // Modo lote: los grupos no se cortan por cantidad de operaciones y sus commits no esperan
+    // al disco; el fsync que falta se hace una sola vez en sync() o close()
+    std::atomic<bool> syncAtEnd{false};
+    std::atomic<bool> unsynced{false};
+    std::mutex pendingMutex;
+    std::vector<Extent> pendingFrees;
+    std::atomic<size_t> pendingFreeBlocks{0};
+    std::vector<uint64_t> commitTargets;
+    std::vector<char> commitImages;
+
+    // Agujeros: el espacio de los bloques liberados vuelve al sistema de archivos del host.
+    // Se hace despues del commit que los libera, con los extents del grupo ordenados y juntos
+    // en tramos, asi muchas bajas cuestan pocas llamadas. Si el host no lo permite se deja de
+    // intentar hasta el proximo trim
+    std::atomic<bool> holePunching{true};
+    std::atomic<bool> punchSupported{true};
+    std::atomic<uint64_t> holesPunched{0};
+    std::atomic<uint64_t> punchedBlocks{0};
+    // Nadie puede volver a tomar los bloques mientras tanto; devuelve la cantidad de tramos
+    size_t punchExtents(std::vector<Extent> extents);
+
+    size_t getJournalBlocks(size_t blockCount);
+    void endOperation();
+    bool commitJournal();
+    // Requiere el device o la barrera de transacciones en exclusivo
+    bool commitLocked();
+    // Reserva blocks bloques libres (que no sean de released) para desbordar la transaccion
+    bool reserveSpill(const std::vector<Extent> &released, size_t blocks, std::vector<SpillRun> &spill);
+    bool removeFile(const std::string &file);
 
 public:
-    bool create(const std::string &filename, size_t blockSize, size_t blockCount);
-    bool open(const std::string &filename);
+    // Todas las operaciones publicas se pueden llamar desde varios hilos a la vez
+    ~BlockDevice() { close(); }
+
+    // Potencia de dos donde entran el superbloque y un inodo: lo que open acepta
+    static bool isValidBlockSize(size_t blockSize);
+    static size_t minBlockSize();
+    bool create(const std::string &filename, size_t blockSize, size_t blockCount,
+                BackendType backend = BackendType::FSTREAM);
+    bool open(const std::string &filename, BackendType backend = BackendType::FSTREAM);
+    bool isOpen() const { return storage && storage->isOpen(); }
     bool close();
+    bool sync();
+    // shards > 1 reparte la cache para que varios hilos la usen sin esperarse
+    void setCacheOptions(size_t capacity, EvictionPolicy policy, size_t shards = 1);
+    // Guarda el indice de nombres junto a la imagen al cerrar y lo reutiliza al abrir
+    void setPersistIndex(bool persist) { persistIndex = persist; }
+    // Usa io_uring (o un grupo de hilos) para las lecturas y escrituras de archivos; se aplica al abrir
+    void setAsyncIO(bool enabled) { asyncIO = enabled; }
+    // Los archivos que se escriban desde ahora (write, copyIn) se guardan comprimidos;
+    // la lectura descomprime sola segun cada archivo
+    void setCompression(bool enabled) { compression = enabled; }
+    // Los archivos sin comprimir que se escriban desde ahora comparten los bloques repetidos
+    void setDeduplication(bool enabled) { deduplication = enabled; }
+    // Para armar imagenes en lote: un corte antes del sync final puede dejar la imagen a medias
+    void setSyncAtEnd(bool enabled) { syncAtEnd = enabled; }
+    // remove, format y los demas que liberan bloques tambien achican lo que ocupa la imagen
+    void setHolePunching(bool enabled) { holePunching = enabled; }
+    // Para pruebas de fallos: create y open arman el almacenamiento con factory en vez de makeBackend
+    void setBackendFactory(std::function<std::unique_ptr<StorageBackend>(BackendType)> factory) {
+        backendFactory = std::move(factory);
+    }
+    uint64_t getCacheHits() const { return cache.getHits(); }
+    uint64_t getCacheMisses() const { return cache.getMisses(); }
+    // Contadores e histogramas de latencia; quedan encendidos salvo que se apaguen con setEnabled
+    DeviceStats &getStats() { return stats; }
+    void printStats(std::ostream &out, StatsFormat format = StatsFormat::TEXT);
+    void resetStats();
     bool writeBlock(size_t blockNumber, const std::vector<char> &data);
     std::vector<char> readBlock(size_t blockNumber);
     std::vector<char> read(const std::string &filename);
+
+    // Lectura sin copias intermedias: llenan el buffer del llamador o devuelven
+    // una vista fijada del bloque (cache o proyeccion mmap)
+    bool readBlock(size_t blockNumber, char *dst, size_t len);
+    BlockRef viewBlock(size_t blockNumber);
+    bool read(const std::string &filename, char *dst, size_t len, size_t &bytesRead);
+    int64_t fileSize(const std::string &filename);
     void info();
 
     bool format();
-    void listFiles();
+    // Lista en orden las entradas del directorio (la raiz si dir esta vacio) que empiezan con prefix
+    void listFiles(const std::string &dir = "", const std::string &prefix = "");
+    bool mkdir(const std::string &path);
+    bool rmdir(const std::string &path);
     void cat(const std::string &file);
     void hexdump(const std::string &file);
     bool write(const std::string &file, const std::string &text);
     bool copyOut(const std::string &file1, const std::string &file2);
     bool copyIn(const std::string &file1, const std::string &file2);
     bool remove(const std::string &file);
+    // Instantanea de solo lectura de todo el device, que se lee como "@nombre/ruta" y se lista
+    // con listFiles("@"). Cuesta lo que ocupan los inodos y directorios, no los datos
+    bool snapshot(const std::string &name);
+    bool deleteSnapshot(const std::string &name);
+    // Copia escribible de un archivo o directorio (tambien de una instantanea) que comparte sus bloques
+    bool clone(const std::string &source, const std::string &target);
+    // Reubica los archivos fragmentados en tramos contiguos, recupera los inodos que nada nombra
+    // con sus bloques y compacta la tabla de inodos. Los bloques en uso que no son de ningun
+    // inodo (como los escritos con writeBlock) se informan y se dejan. Cada paso trabaja unos sliceMillis y devuelve true si queda trabajo; entre pasos
+    // las demas operaciones siguen. defrag hace una pasada entera
+    bool defragStep(size_t sliceMillis = DEFRAG_SLICE_MS);
+    bool defrag(size_t sliceMillis = DEFRAG_SLICE_MS);
+    // Relee todos los bloques en uso y compara sus sumas; threads = 0 usa un hilo por nucleo
+    bool scrub(size_t threads = 0);
+    // Revisa la imagen entera repartiendo la tabla de inodos entre threads hilos (0: uno por
+    // nucleo): bloques perdidos, con dos duenos o fuera de rango, inodos sin nombre, entradas
+    // sin inodo y nombres repetidos. Rehace los mapas de bloques e inodos, las referencias
+    // compartidas y el indice de nombres; false si queda algo que no sabe reparar. Los bloques
+    // en uso sin dueno (los de writeBlock, por ejemplo) solo se liberan con freeUnowned
+    bool fsck(size_t threads = 0, bool freeUnowned = false);
+    // Devuelve al host el espacio de todos los bloques libres, tambien los liberados antes de
+    // usar agujeros o con el permiso apagado
+    bool trim();
 };
\ No newline at end of file
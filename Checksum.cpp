@@ -0,0 +1,261 @@
+#include "Checksum.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace {
+constexpr uint32_t POLY = 0x82f63b78; // Castagnoli, reflejado
+
+// Largo de cada flujo en el camino por hardware: los tres avanzan juntos y al final se
+// combinan corriendo el CRC de los primeros sobre los ceros que ocupan los siguientes.
+// Tres flujos largos cubren un bloque de 4 KiB (o 8 KiB en dos vueltas) casi entero
+constexpr size_t LONG_STREAM = 1360;
+constexpr size_t SHORT_STREAM = 168;
+
+uint64_t read64(const unsigned char *p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+struct SoftwareTables
+{
+    uint32_t table[8][256];
+
+    SoftwareTables() {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t crc = n;
+            for (int k = 0; k < 8; k++) crc = crc & 1 ? (crc >> 1) ^ POLY : crc >> 1;
+            table[0][n] = crc;
+        }
+        for (uint32_t n = 0; n < 256; n++) {
+            for (int k = 1; k < 8; k++) table[k][n] = (table[k - 1][n] >> 8) ^ table[0][table[k - 1][n] & 0xff];
+        }
+    }
+};
+
+const SoftwareTables &softwareTables() {
+    static const SoftwareTables tables;
+    return tables;
+}
+
+uint32_t crcSoftware(uint32_t crc, const unsigned char *p, size_t len) {
+    const auto &t = softwareTables().table;
+    crc = ~crc;
+
+    // Ocho bytes por vuelta; el formato del disco ya asume little endian
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t word = read64(p) ^ crc;
+        crc = t[7][word & 0xff] ^ t[6][(word >> 8) & 0xff] ^ t[5][(word >> 16) & 0xff] ^ t[4][(word >> 24) & 0xff] ^
+              t[3][(word >> 32) & 0xff] ^ t[2][(word >> 40) & 0xff] ^ t[1][(word >> 48) & 0xff] ^ t[0][word >> 56];
+    }
+    for (; len > 0; p++, len--) crc = t[0][(crc ^ *p) & 0xff] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+#if defined(__x86_64__)
+// Operadores en GF(2) como matrices de 32 columnas
+uint32_t matrixTimes(const uint32_t *matrix, uint32_t vector) {
+    uint32_t sum = 0;
+    for (; vector != 0; vector >>= 1, matrix++) {
+        if (vector & 1) sum ^= *matrix;
+    }
+    return sum;
+}
+
+void matrixSquare(uint32_t *square, const uint32_t *matrix) {
+    for (int n = 0; n < 32; n++) square[n] = matrixTimes(matrix, matrix[n]);
+}
+
+// Tabla que aplica len bytes en cero a un CRC, de a un byte por fila
+struct ZerosTable
+{
+    uint32_t table[4][256];
+
+    explicit ZerosTable(size_t len) {
+        uint32_t op[32], square[32], result[32], product[32];
+
+        // Un bit en cero; tres cuadrados llevan a un byte
+        op[0] = POLY;
+        for (int n = 1; n < 32; n++) op[n] = 1u << (n - 1);
+        for (int i = 0; i < 3; i++) {
+            matrixSquare(square, op);
+            std::memcpy(op, square, sizeof(op));
+        }
+
+        // Potencia len del operador de un byte, por cuadrados sucesivos
+        for (int n = 0; n < 32; n++) result[n] = 1u << n;
+        for (; len != 0; len >>= 1) {
+            if (len & 1) {
+                for (int n = 0; n < 32; n++) product[n] = matrixTimes(op, result[n]);
+                std::memcpy(result, product, sizeof(result));
+            }
+            matrixSquare(square, op);
+            std::memcpy(op, square, sizeof(op));
+        }
+
+        for (uint32_t n = 0; n < 256; n++) {
+            for (int k = 0; k < 4; k++) table[k][n] = matrixTimes(result, n << (8 * k));
+        }
+    }
+
+    uint32_t shift(uint32_t crc) const {
+        return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff] ^ table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+    }
+};
+
+// Tres CRC independientes ocultan la latencia de la instruccion
+__attribute__((target("sse4.2"))) uint64_t crcStreams(uint64_t crc0, const unsigned char *&p, size_t &len,
+                                                      size_t stream, const ZerosTable &zeros) {
+    while (len >= 3 * stream) {
+        uint64_t crc1 = 0, crc2 = 0;
+        const unsigned char *end = p + stream;
+        for (; p < end; p += 8) {
+            crc0 = _mm_crc32_u64(crc0, read64(p));
+            crc1 = _mm_crc32_u64(crc1, read64(p + stream));
+            crc2 = _mm_crc32_u64(crc2, read64(p + 2 * stream));
+        }
+        crc0 = zeros.shift(static_cast<uint32_t>(crc0)) ^ crc1;
+        crc0 = zeros.shift(static_cast<uint32_t>(crc0)) ^ crc2;
+        p += 2 * stream;
+        len -= 3 * stream;
+    }
+    return crc0;
+}
+
+__attribute__((target("sse4.2"))) uint32_t crcHardware(uint32_t crc, const unsigned char *p, size_t len) {
+    static const ZerosTable longZeros(LONG_STREAM);
+    static const ZerosTable shortZeros(SHORT_STREAM);
+
+    uint64_t crc0 = ~crc;
+    crc0 = crcStreams(crc0, p, len, LONG_STREAM, longZeros);
+    crc0 = crcStreams(crc0, p, len, SHORT_STREAM, shortZeros);
+
+    for (; len >= 8; p += 8, len -= 8) crc0 = _mm_crc32_u64(crc0, read64(p));
+    for (; len > 0; p++, len--) crc0 = _mm_crc32_u8(static_cast<uint32_t>(crc0), *p);
+
+    return ~static_cast<uint32_t>(crc0);
+}
+#endif
+}
+
+bool crc32cHardware() {
+#if defined(__x86_64__)
+    static const bool supported = __builtin_cpu_supports("sse4.2");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+uint32_t crc32c(const char *data, size_t len) {
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+#if defined(__x86_64__)
+    if (crc32cHardware()) return crcHardware(0, p, len);
+#endif
+    return crcSoftware(0, p, len);
+}
+
+uint32_t ChecksumTable::blockSum(const char *data) const {
+    // El cero queda para "sin registrar"
+    uint32_t sum = crc32c(data, perChunk * sizeof(uint32_t));
+    return sum != 0 ? sum : 1;
+}
+
+void ChecksumTable::configure(size_t blockCount, size_t blockSize, size_t tableStart, size_t tableBlocks,
+                              bool trackVerified, Pinner pinner, Writer writer) {
+    this->blockCount = blockCount;
+    this->perChunk = blockSize / sizeof(uint32_t);
+    this->tableStart = tableStart;
+    this->tableBlocks = tableBlocks;
+    this->pinner = std::move(pinner);
+    this->writer = std::move(writer);
+    enabled = tableBlocks != 0;
+
+    zeros.assign(enabled ? blockSize : 0, 0);
+    verified.reset();
+    if (enabled && trackVerified) verified.reset(new std::atomic<uint64_t>[(blockCount + 63) / 64]());
+}
+
+void ChecksumTable::disable() {
+    enabled = false;
+    tableBlocks = 0;
+    pinner = nullptr;
+    writer = nullptr;
+    zeros.clear();
+    zeros.shrink_to_fit();
+    verified.reset();
+}
+
+uint32_t ChecksumTable::storedSum(size_t block) const {
+    BlockRef chunk = pinner(tableStart + block / perChunk);
+    if (!chunk) return 0;
+
+    uint32_t sum;
+    std::memcpy(&sum, chunk.data() + block % perChunk * sizeof(uint32_t), sizeof(sum));
+    return sum;
+}
+
+bool ChecksumTable::update(size_t block, const char *data) {
+    if (!enabled || block >= blockCount || inTable(block)) return true;
+
+    uint32_t sum = blockSum(data);
+    if (!writer(tableStart + block / perChunk, reinterpret_cast<const char *>(&sum), sizeof(sum),
+                block % perChunk * sizeof(uint32_t))) {
+        return false;
+    }
+    // Lo escrito es justo lo que se sumo
+    setVerified(block, true);
+    return true;
+}
+
+void ChecksumTable::clear(size_t first, size_t count) {
+    if (!enabled) return;
+
+    size_t end = std::min(first + count, blockCount);
+    for (size_t block = first; block < end;) {
+        size_t chunk = block / perChunk;
+        size_t stop = std::min(end, (chunk + 1) * perChunk);
+        size_t offset = block % perChunk * sizeof(uint32_t);
+        size_t len = (stop - block) * sizeof(uint32_t);
+        for (size_t b = block; b < stop; b++) setVerified(b, false);
+
+        // Lo que ya esta en cero no se reescribe: un trozo que es un agujero sigue siendolo
+        BlockRef current = pinner(tableStart + chunk);
+        if (!current || std::memcmp(current.data() + offset, zeros.data(), len) != 0) {
+            current.release();
+            writer(tableStart + chunk, zeros.data(), len, offset);
+        }
+        block = stop;
+    }
+}
+
+bool ChecksumTable::verify(size_t block, const char *data) const {
+    if (!enabled || block >= blockCount || inTable(block)) return true;
+
+    uint32_t expected = storedSum(block);
+    return expected == 0 || blockSum(data) == expected;
+}
+
+bool ChecksumTable::hasChecksum(size_t block) const {
+    return enabled && block < blockCount && !inTable(block) && storedSum(block) != 0;
+}
+
+bool ChecksumTable::isVerified(size_t block) const {
+    return verified && (verified[block / 64].load(std::memory_order_relaxed) >> (block % 64) & 1) != 0;
+}
+
+void ChecksumTable::markVerified(size_t block) { setVerified(block, true); }
+
+void ChecksumTable::setVerified(size_t block, bool value) {
+    if (!verified) return;
+
+    uint64_t bit = uint64_t(1) << (block % 64);
+    if (value) verified[block / 64].fetch_or(bit, std::memory_order_relaxed);
+    else verified[block / 64].fetch_and(~bit, std::memory_order_relaxed);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "BlockCache.hpp"
+
+// CRC32C (Castagnoli). Usa la instruccion crc32 de SSE4.2 con tres flujos en paralelo
+// cuando el procesador la tiene, y tablas (slicing-by-8) en otro caso
+uint32_t crc32c(const char *data, size_t len);
+bool crc32cHardware();
+
+// Suma de cada bloque del device, un uint32 por bloque en su tabla del disco. Los trozos
+// de la tabla se leen y escriben por las funciones que da el device (su cache y el
+// journal): en memoria solo esta lo que se esta usando.
+// Una suma en cero significa "sin registrar" (bloques nunca escritos, el journal):
+// esos bloques no se verifican. Un trozo que es un agujero no registra nada, asi que
+// al crear o formatear la tabla queda dispersa. Los bloques de la propia tabla tampoco.
+class ChecksumTable
+{
+public:
+    using Pinner = std::function<BlockRef(size_t)>;
+    // Escribe len bytes a partir de offset dentro del bloque
+    using Writer = std::function<bool(size_t, const char *, size_t, size_t)>;
+
+    // trackVerified: recordar que bloques ya se verificaron (para mmap, un bit cada uno)
+    void configure(size_t blockCount, size_t blockSize, size_t tableStart, size_t tableBlocks, bool trackVerified,
+                   Pinner pinner, Writer writer);
+    void disable();
+    bool isEnabled() const { return enabled; }
+
+    // Registra lo que se acaba de escribir en el bloque
+    bool update(size_t block, const char *data);
+    // Los bloques quedan sin suma, como los nunca escritos (al liberarlos con un agujero)
+    void clear(size_t first, size_t count);
+    // false solo si el bloque tiene suma y no coincide con data
+    bool verify(size_t block, const char *data) const;
+    bool hasChecksum(size_t block) const;
+    bool inTable(size_t block) const { return block >= tableStart && block < tableStart + tableBlocks; }
+
+    // Con mmap los bloques limpios se leen de la proyeccion: basta verificarlos una vez
+    bool isVerified(size_t block) const;
+    void markVerified(size_t block);
+
+private:
+    bool enabled = false;
+    size_t blockCount = 0;
+    size_t perChunk = 0;
+    size_t tableStart = 0;
+    size_t tableBlocks = 0;
+    Pinner pinner;
+    Writer writer;
+    std::vector<char> zeros;
+    std::unique_ptr<std::atomic<uint64_t>[]> verified;
+
+    uint32_t blockSum(const char *data) const;
+    // Suma guardada del bloque; 0 tambien si no se pudo leer su trozo
+    uint32_t storedSum(size_t block) const;
+    void setVerified(size_t block, bool value);
+};
@@ -0,0 +1,163 @@
+#include "Compression.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+namespace {
+constexpr size_t MIN_MATCH = 4;
+// Los ultimos bytes siempre van como literales: la busqueda lee de a 4 sin pasarse
+constexpr size_t LAST_LITERALS = 5;
+constexpr size_t MATCH_LIMIT = 12;
+constexpr size_t MAX_OFFSET = 65535;
+constexpr unsigned HASH_BITS = 12;
+// Cada 2^SKIP_TRIGGER fallos seguidos el paso de busqueda crece en uno
+constexpr unsigned SKIP_TRIGGER = 6;
+
+uint32_t read32(const uint8_t *p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint32_t hashOf(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Bytes que ocupa un largo de n en la codificacion (nibble + extensiones de 255)
+size_t lengthBytes(size_t n) {
+    return n < 15 ? 0 : (n - 15) / 255 + 1;
+}
+
+uint8_t *putLength(uint8_t *out, size_t n) {
+    if (n < 15) return out;
+    n -= 15;
+    while (n >= 255) {
+        *out++ = 255;
+        n -= 255;
+    }
+    *out++ = static_cast<uint8_t>(n);
+    return out;
+}
+
+bool getLength(const uint8_t *src, size_t len, size_t &ip, size_t &n) {
+    if (n != 15) return true;
+    uint8_t byte;
+    do {
+        if (ip >= len) return false;
+        byte = src[ip++];
+        n += byte;
+    } while (byte == 255);
+    return true;
+}
+}
+
+size_t lzCompress(const char *source, size_t len, char *dest, size_t cap) {
+    const uint8_t *src = reinterpret_cast<const uint8_t *>(source);
+    uint8_t *out = reinterpret_cast<uint8_t *>(dest);
+    uint8_t *outEnd = out + cap;
+
+    uint32_t table[1u << HASH_BITS] = {};
+    size_t anchor = 0;
+
+    if (len > MATCH_LIMIT) {
+        size_t limit = len - MATCH_LIMIT;
+        size_t matchEnd = len - LAST_LITERALS;
+        size_t ip = 0;
+        unsigned misses = 0;
+
+        while (ip < limit) {
+            uint32_t sequence = read32(src + ip);
+            uint32_t h = hashOf(sequence);
+            size_t ref = table[h];
+            table[h] = static_cast<uint32_t>(ip);
+
+            if (ref >= ip || ip - ref > MAX_OFFSET || read32(src + ref) != sequence) {
+                ip += 1 + (misses++ >> SKIP_TRIGGER);
+                continue;
+            }
+            misses = 0;
+
+            // La coincidencia se extiende hacia atras sobre los literales pendientes y hacia adelante
+            while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+                ip--;
+                ref--;
+            }
+            size_t matchLen = MIN_MATCH;
+            while (ip + matchLen < matchEnd && src[ip + matchLen] == src[ref + matchLen]) matchLen++;
+
+            size_t literals = ip - anchor;
+            size_t needed = 1 + lengthBytes(literals) + literals + 2 + lengthBytes(matchLen - MIN_MATCH);
+            if (needed > static_cast<size_t>(outEnd - out)) return 0;
+
+            uint8_t *token = out++;
+            *token = static_cast<uint8_t>((literals < 15 ? literals : 15) << 4);
+            out = putLength(out, literals);
+            std::memcpy(out, src + anchor, literals);
+            out += literals;
+
+            size_t offset = ip - ref;
+            *out++ = static_cast<uint8_t>(offset & 0xff);
+            *out++ = static_cast<uint8_t>(offset >> 8);
+
+            size_t extra = matchLen - MIN_MATCH;
+            *token |= static_cast<uint8_t>(extra < 15 ? extra : 15);
+            out = putLength(out, extra);
+
+            ip += matchLen;
+            anchor = ip;
+            if (ip - 2 < limit) table[hashOf(read32(src + ip - 2))] = static_cast<uint32_t>(ip - 2);
+        }
+    }
+
+    // La ultima secuencia solo lleva literales
+    size_t literals = len - anchor;
+    size_t needed = 1 + lengthBytes(literals) + literals;
+    if (needed > static_cast<size_t>(outEnd - out)) return 0;
+
+    *out++ = static_cast<uint8_t>((literals < 15 ? literals : 15) << 4);
+    out = putLength(out, literals);
+    std::memcpy(out, src + anchor, literals);
+    out += literals;
+
+    return out - reinterpret_cast<uint8_t *>(dest);
+}
+
+bool lzDecompress(const char *source, size_t len, char *dest, size_t outLen) {
+    const uint8_t *src = reinterpret_cast<const uint8_t *>(source);
+    uint8_t *dst = reinterpret_cast<uint8_t *>(dest);
+    size_t ip = 0, op = 0;
+
+    while (ip < len) {
+        uint8_t token = src[ip++];
+
+        size_t literals = token >> 4;
+        if (!getLength(src, len, ip, literals)) return false;
+        if (literals > len - ip || literals > outLen - op) return false;
+        std::memcpy(dst + op, src + ip, literals);
+        ip += literals;
+        op += literals;
+
+        if (ip == len) break;
+
+        if (len - ip < 2) return false;
+        size_t offset = src[ip] | static_cast<size_t>(src[ip + 1]) << 8;
+        ip += 2;
+        if (offset == 0 || offset > op) return false;
+
+        size_t matchLen = token & 15;
+        if (!getLength(src, len, ip, matchLen)) return false;
+        matchLen += MIN_MATCH;
+        if (matchLen > outLen - op) return false;
+
+        // Con offset menor que el largo la copia se solapa y tiene que ir de a byte
+        const uint8_t *ref = dst + op - offset;
+        if (offset >= matchLen) {
+            std::memcpy(dst + op, ref, matchLen);
+        } else {
+            for (size_t i = 0; i < matchLen; i++) dst[op + i] = ref[i];
+        }
+        op += matchLen;
+    }
+
+    return op == outLen;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+
+// Compresor LZ de la familia LZ4, sin dependencias: secuencias de literales y
+// copias con desplazamiento de 16 bits. Esta pensado para trozos de hasta 64 KiB.
+// Cuando no encuentra coincidencias avanza cada vez mas rapido, asi que los datos
+// que no comprimen se recorren casi sin costo.
+
+// Comprime len bytes de src en dst. Devuelve los bytes escritos, o 0 si la salida
+// no entra en cap: el llamador guarda los datos tal cual
+size_t lzCompress(const char *src, size_t len, char *dst, size_t cap);
+
+// Descomprime exactamente outLen bytes; false si los datos no son validos
+bool lzDecompress(const char *src, size_t len, char *dst, size_t outLen);
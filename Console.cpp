@@ -0,0 +1,27 @@
+#include "Console.hpp"
+
+#include <iostream>
+
+namespace {
+thread_local std::ostream *currentOut = nullptr;
+thread_local std::ostream *currentErr = nullptr;
+}
+
+std::ostream &consoleOut() {
+    return currentOut ? *currentOut : std::cout;
+}
+
+std::ostream &consoleErr() {
+    return currentErr ? *currentErr : std::cerr;
+}
+
+ConsoleRedirect::ConsoleRedirect(std::ostream &out, std::ostream &err)
+    : previousOut(currentOut), previousErr(currentErr) {
+    currentOut = &out;
+    currentErr = &err;
+}
+
+ConsoleRedirect::~ConsoleRedirect() {
+    currentOut = previousOut;
+    currentErr = previousErr;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <ostream>
+
+// Salida de los mensajes del device. Por defecto son std::cout y std::cerr; mientras un
+// ConsoleRedirect este vivo, los del hilo que lo creo van a los streams que recibio.
+// Asi el lote con varios hilos junta los mensajes de cada comando con su salida
+std::ostream &consoleOut();
+std::ostream &consoleErr();
+
+class ConsoleRedirect
+{
+public:
+    ConsoleRedirect(std::ostream &out, std::ostream &err);
+    ~ConsoleRedirect();
+
+    ConsoleRedirect(const ConsoleRedirect &) = delete;
+    ConsoleRedirect &operator=(const ConsoleRedirect &) = delete;
+
+private:
+    std::ostream *previousOut;
+    std::ostream *previousErr;
+};
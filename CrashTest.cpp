@@ -0,0 +1,405 @@
+#include "BlockDevice.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Prueba de cortes del journal: repite cada operacion cortando la escritura en cada
+// paso (cada writeAt, fsync o punchHole) y, del lado del disco, perdiendo lo que no
+// llego a un fsync. Despues reabre la imagen, deja que replay aplique lo confirmado
+// y exige que los metadatos sean los de antes o los de despues de la operacion, y
+// que fsck no encuentre nada que reparar.
+// Ademas rompe en el disco el bloque de tramos de un archivo fragmentado y exige que
+// defrag no lo reubique ni libere sus bloques.
+//
+// Uso: SimuladorDeBloques_AndreaQuin_crash [--image ruta] [--stride N]
+
+namespace {
+// Que pasa con las escrituras que no llegaron a un fsync cuando se corta
+enum class LossMode
+{
+    NONE,      // Llegaron todas al disco: solo se pierde lo que sigue al corte
+    ALL,       // No llego ninguna
+    ALTERNATE, // Llego una si y una no: el disco las reordeno
+    FIRST,     // Se perdio solo la primera
+    LAST,      // Se perdio solo la ultima
+};
+
+const char *modeName(LossMode mode) {
+    if (mode == LossMode::ALL) return "todo";
+    if (mode == LossMode::ALTERNATE) return "alternado";
+    if (mode == LossMode::FIRST) return "primera";
+    if (mode == LossMode::LAST) return "ultima";
+    return "nada";
+}
+
+// Backend que muere en el paso crashAt. Guarda lo que pisa cada escritura desde el
+// ultimo fsync para poder deshacerla como si el disco no la hubiera guardado
+class FaultyBackend : public StorageBackend
+{
+private:
+    struct Pending
+    {
+        uint64_t offset;
+        std::vector<char> previous;
+    };
+
+    std::unique_ptr<StorageBackend> inner = makeBackend(BackendType::PREAD);
+    uint64_t crashAt;
+    LossMode mode;
+    uint64_t &steps;
+    bool crashed = false;
+    std::vector<Pending> pending;
+
+    // false si el proceso ya murio en este paso o antes
+    bool step() {
+        if (crashed) return false;
+        if (steps++ < crashAt) return true;
+
+        crashed = true;
+        for (size_t i = pending.size(); i-- > 0;) {
+            if (mode == LossMode::NONE || (mode == LossMode::ALTERNATE && i % 2 == 0)) continue;
+            if (mode == LossMode::FIRST && i != 0) continue;
+            if (mode == LossMode::LAST && i + 1 != pending.size()) continue;
+            inner->writeAt(pending[i].offset, pending[i].previous.data(), pending[i].previous.size());
+        }
+        inner->fsync();
+        pending.clear();
+        return false;
+    }
+
+    void remember(uint64_t offset, size_t len) {
+        Pending entry{offset, std::vector<char>(len, 0)};
+        uint64_t size = inner->size();
+        if (offset < size) inner->readAt(offset, entry.previous.data(), std::min<uint64_t>(len, size - offset));
+        pending.push_back(std::move(entry));
+    }
+
+public:
+    FaultyBackend(uint64_t crashAt, LossMode mode, uint64_t &steps) : crashAt(crashAt), mode(mode), steps(steps) {}
+
+    bool open(const std::string &path, bool truncate) override { return inner->open(path, truncate); }
+    void close() override { inner->close(); }
+    bool isOpen() const override { return inner->isOpen(); }
+
+    bool readAt(uint64_t offset, char *dst, size_t len) override { return inner->readAt(offset, dst, len); }
+    bool writeAt(uint64_t offset, const char *src, size_t len) override {
+        if (!step()) return false;
+        remember(offset, len);
+        return inner->writeAt(offset, src, len);
+    }
+    uint64_t size() override { return inner->size(); }
+    bool sync() override { return !crashed && inner->sync(); }
+    bool fsync() override {
+        if (!step()) return false;
+        pending.clear();
+        return inner->fsync();
+    }
+    bool resize(uint64_t size) override { return !crashed && inner->resize(size); }
+    bool punchHole(uint64_t offset, uint64_t len) override {
+        if (!step()) return false;
+        remember(offset, len);
+        return inner->punchHole(offset, len);
+    }
+
+    BackendType type() const override { return BackendType::PREAD; }
+};
+
+struct Options
+{
+    std::string image = "crash.img";
+    size_t stride = 1; // Cada cuantos pasos se corta
+};
+
+struct Scenario
+{
+    const char *name;
+    std::function<bool(BlockDevice &)> run;
+};
+
+std::string content(size_t seed, size_t length) {
+    std::string text(length, ' ');
+    for (size_t i = 0; i < length; i++) text[i] = static_cast<char>('a' + (seed * 31 + i * 7) % 26);
+    return text;
+}
+
+const size_t SUBDIRS = 120;
+
+// Lo que se compara: los listados y el contenido de cada archivo que puede existir
+std::string captureState(BlockDevice &device) {
+    std::ostringstream out;
+    std::streambuf *cout = std::cout.rdbuf(out.rdbuf());
+    std::streambuf *cerr = std::cerr.rdbuf(out.rdbuf());
+
+    device.listFiles();
+    device.listFiles("d");
+    device.listFiles("@");
+    std::vector<std::string> files = {"grande", "chico", "d/nuevo"};
+    for (size_t i = 0; i < SUBDIRS; i++) files.push_back("d/s" + std::to_string(i) + "/f");
+    for (const std::string &file : files) {
+        std::vector<char> data = device.read(file);
+        out << file << ":" << std::string(data.begin(), data.end()) << "\n";
+    }
+
+    std::cout.rdbuf(cout);
+    std::cerr.rdbuf(cerr);
+    return out.str();
+}
+
+// Salida de fsck; limpia es solo la linea del resumen
+std::string runFsck(BlockDevice &device) {
+    std::ostringstream out;
+    std::streambuf *cout = std::cout.rdbuf(out.rdbuf());
+    std::streambuf *cerr = std::cerr.rdbuf(out.rdbuf());
+    bool ok = device.fsck(1);
+    std::cout.rdbuf(cout);
+    std::cerr.rdbuf(cerr);
+
+    std::string text = out.str();
+    size_t lines = std::count(text.begin(), text.end(), '\n');
+    return ok && lines == 1 ? "" : text;
+}
+
+bool copyFile(const std::string &from, const std::string &to) {
+    std::ifstream in(from, std::ios::binary);
+    std::ofstream out(to, std::ios::binary | std::ios::trunc);
+    out << in.rdbuf();
+    return in && out;
+}
+
+bool buildBase(const std::string &path) {
+    BlockDevice device;
+    std::remove(path.c_str());
+    if (!device.create(path, 1024, 4096, BackendType::PREAD) || !device.open(path, BackendType::PREAD)) return false;
+
+    bool ok = device.mkdir("d");
+    for (size_t i = 0; i < SUBDIRS && ok; i++) {
+        std::string dir = "d/s" + std::to_string(i);
+        ok = device.mkdir(dir) && device.write(dir + "/f", content(i, 1500));
+    }
+    ok = ok && device.write("grande", content(7, 40 * 1024)) && device.write("chico", content(9, 300));
+    return device.close() && ok;
+}
+
+// Abre sin mostrar lo que recupera el journal
+bool openImage(BlockDevice &device, const std::string &path) {
+    std::ostringstream discard;
+    std::streambuf *cout = std::cout.rdbuf(discard.rdbuf());
+    bool ok = device.open(path, BackendType::PREAD);
+    std::cout.rdbuf(cout);
+    return ok;
+}
+
+// Corre el escenario sobre una copia de la base; crashAt = -1 no corta. Devuelve los pasos dados
+uint64_t runScenario(const Options &options, const Scenario &scenario, uint64_t crashAt, LossMode mode) {
+    uint64_t steps = 0;
+    copyFile(options.image + ".base", options.image);
+
+    BlockDevice device;
+    device.setBackendFactory([&](BackendType) { return std::make_unique<FaultyBackend>(crashAt, mode, steps); });
+    std::ostringstream discard;
+    std::streambuf *cerr = std::cerr.rdbuf(discard.rdbuf());
+    if (device.open(options.image, BackendType::PREAD)) {
+        scenario.run(device);
+        device.close();
+    }
+    std::cerr.rdbuf(cerr);
+    return steps;
+}
+
+bool checkScenario(const Options &options, const Scenario &scenario) {
+    std::string before, after;
+    {
+        copyFile(options.image + ".base", options.image);
+        BlockDevice device;
+        openImage(device, options.image);
+        before = captureState(device);
+    }
+
+    uint64_t total = runScenario(options, scenario, static_cast<uint64_t>(-1), LossMode::NONE);
+    {
+        BlockDevice device;
+        openImage(device, options.image);
+        after = captureState(device);
+        std::string report = runFsck(device);
+        if (before == after || !report.empty()) {
+            std::cout << scenario.name << ": la operacion sin cortes no cambio nada o dejo la imagen mal\n" << report;
+            return false;
+        }
+    }
+
+    size_t cuts = 0, failures = 0, olds = 0;
+    for (uint64_t crashAt = 0; crashAt < total; crashAt += options.stride) {
+        for (LossMode mode : {LossMode::NONE, LossMode::ALL, LossMode::ALTERNATE, LossMode::FIRST, LossMode::LAST}) {
+            runScenario(options, scenario, crashAt, mode);
+            cuts++;
+
+            BlockDevice device;
+            if (!openImage(device, options.image)) {
+                std::cout << "  " << scenario.name << ": paso " << crashAt << " (" << modeName(mode)
+                          << "): la imagen no abre\n";
+                failures++;
+                continue;
+            }
+
+            std::string state = captureState(device);
+            std::string report = runFsck(device);
+            if (state == before) olds++;
+            if ((state != before && state != after) || !report.empty()) {
+                std::cout << "  " << scenario.name << ": paso " << crashAt << " (" << modeName(mode) << "): "
+                          << (state != before && state != after ? "estado a medias" : "fsck repara") << "\n"
+                          << report;
+                failures++;
+            }
+        }
+    }
+
+    std::cout << std::left << std::setw(10) << scenario.name << std::right << std::setw(6) << total
+              << " pasos " << std::setw(6) << cuts << " cortes " << std::setw(6) << olds << " antes "
+              << std::setw(6) << cuts - olds - failures << " despues " << std::setw(4) << failures << " fallos\n";
+    return failures == 0;
+}
+
+// Ultimo bloque que empieza con un tramo cuyo primer bloque es de data: el de tramos
+// del archivo (antes quedan las copias del journal)
+size_t findExtentBlock(BlockDevice &device, size_t blockSize, size_t blockCount, const std::string &data) {
+    size_t found = 0;
+    for (size_t block = 1; block < blockCount; block++) {
+        std::vector<char> raw = device.readBlock(block);
+        int64_t start, length;
+        std::memcpy(&start, raw.data(), sizeof(start));
+        std::memcpy(&length, raw.data() + sizeof(start), sizeof(length));
+        if (start <= 0 || static_cast<size_t>(start) >= blockCount || length <= 0) continue;
+
+        std::vector<char> first = device.readBlock(start);
+        for (size_t pos = 0; pos + blockSize <= data.size(); pos += blockSize) {
+            if (std::equal(first.begin(), first.end(), data.begin() + pos)) found = block;
+        }
+    }
+    return found;
+}
+
+bool checkUnreadableExtents(const Options &options) {
+    const size_t blockSize = 512, blockCount = 2048;
+    std::string path = options.image + ".ext";
+    std::string data = content(5, 40 * blockSize);
+    size_t extentBlock = 0;
+    {
+        // Se llena el device de a cuatro bloques (hay un inodo cada cuatro) y se borra uno si y
+        // uno no: el archivo queda en diez tramos, mas de los que entran en el inodo
+        BlockDevice device;
+        std::remove(path.c_str());
+        if (!device.create(path, blockSize, blockCount, BackendType::PREAD) ||
+            !device.open(path, BackendType::PREAD)) {
+            return false;
+        }
+        std::ostringstream discard;
+        std::streambuf *cerr = std::cerr.rdbuf(discard.rdbuf());
+        size_t fillers = 0;
+        while (device.write("h" + std::to_string(fillers), content(fillers, 4 * blockSize))) fillers++;
+        for (size_t i = 0; i < fillers; i += 2) device.remove("h" + std::to_string(i));
+        std::cerr.rdbuf(cerr);
+        if (!device.sync() || !device.write("frag", data) || !device.sync()) return false;
+        extentBlock = findExtentBlock(device, blockSize, blockCount, data);
+        device.close();
+    }
+    if (extentBlock == 0) {
+        std::cout << "tramos: no se encontro el bloque de tramos del archivo\n";
+        return false;
+    }
+
+    // Se rompe en el disco; la suma ya no coincide
+    std::vector<char> original(blockSize);
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekg(extentBlock * blockSize);
+        file.read(original.data(), blockSize);
+        std::vector<char> garbage(blockSize, 0x5a);
+        file.seekp(extentBlock * blockSize);
+        file.write(garbage.data(), blockSize);
+    }
+
+    bool refused;
+    {
+        BlockDevice device;
+        std::ostringstream discard;
+        std::streambuf *cout = std::cout.rdbuf(discard.rdbuf());
+        std::streambuf *cerr = std::cerr.rdbuf(discard.rdbuf());
+        refused = device.open(path, BackendType::PREAD) && !device.defrag() && device.read("frag").empty();
+        device.close();
+        std::cout.rdbuf(cout);
+        std::cerr.rdbuf(cerr);
+    }
+
+    // Con el bloque devuelto, el archivo tiene que seguir entero
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(extentBlock * blockSize);
+        file.write(original.data(), blockSize);
+    }
+    BlockDevice device;
+    bool intact = openImage(device, path);
+    std::vector<char> read = intact ? device.read("frag") : std::vector<char>();
+    intact = intact && std::string(read.begin(), read.end()) == data;
+    std::string report = intact ? runFsck(device) : "";
+    device.close();
+    std::remove(path.c_str());
+    std::remove((path + ".dedup").c_str());
+
+    std::cout << "tramos: bloque " << extentBlock << (refused ? " defrag no reubico" : " defrag reubico")
+              << (intact && report.empty() ? ", archivo entero\n" : ", archivo perdido\n") << report;
+    return refused && intact && report.empty();
+}
+
+bool parseOptions(int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--image" && i + 1 < argc) {
+            options.image = argv[++i];
+        } else if (arg == "--stride" && i + 1 < argc) {
+            options.stride = std::stoul(argv[++i]);
+            if (options.stride == 0) return false;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Uso: " << argv[0] << " [--image ruta] [--stride N]\n";
+        return 1;
+    }
+
+    if (!buildBase(options.image + ".base")) {
+        std::cerr << "Error: No se pudo armar la imagen base.\n";
+        return 1;
+    }
+
+    // La instantanea no cabe en el journal de esta imagen: se confirma desbordada
+    std::vector<Scenario> scenarios = {
+        {"write", [](BlockDevice &device) { return device.write("d/nuevo", content(3, 30 * 1024)); }},
+        {"overwrite", [](BlockDevice &device) { return device.write("chico", content(4, 5000)); }},
+        {"remove", [](BlockDevice &device) { return device.remove("grande"); }},
+        {"mkdir", [](BlockDevice &device) { return device.mkdir("d/s999"); }},
+        {"snapshot", [](BlockDevice &device) { return device.snapshot("s"); }},
+    };
+
+    bool ok = true;
+    for (const Scenario &scenario : scenarios) ok = checkScenario(options, scenario) && ok;
+    ok = checkUnreadableExtents(options) && ok;
+
+    for (const char *suffix : {"", ".base", ".dedup", ".base.dedup"}) std::remove((options.image + suffix).c_str());
+    return ok ? 0 : 1;
+}
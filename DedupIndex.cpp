@@ -0,0 +1,311 @@
+#include "DedupIndex.hpp"
+
+#include <cstring>
+#include <fstream>
+
+namespace {
+const char DEDUP_MAGIC[8] = {'S', 'B', 'D', 'U', 'P', '0', '0', '2'};
+
+struct DedupHeader
+{
+    char magic[8];
+    uint64_t imageSize;
+    uint64_t fingerprints;
+    uint64_t shared;
+};
+
+struct FingerprintEntry
+{
+    uint64_t hash;
+    uint64_t block;
+};
+
+struct RefEntry
+{
+    uint64_t first;
+    uint64_t count;
+    uint64_t refs;
+};
+
+constexpr uint64_t PRIME1 = 11400714785074694791ull;
+constexpr uint64_t PRIME2 = 14029467366897019727ull;
+constexpr uint64_t PRIME3 = 1609587929392839161ull;
+constexpr uint64_t PRIME4 = 9650029242287828579ull;
+constexpr uint64_t PRIME5 = 2870177450012600261ull;
+
+uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+uint64_t read64(const char *p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint64_t mix(uint64_t acc, uint64_t input) {
+    acc += input * PRIME2;
+    return rotl(acc, 31) * PRIME1;
+}
+
+uint64_t mergeLane(uint64_t acc, uint64_t lane) {
+    acc ^= mix(0, lane);
+    return acc * PRIME1 + PRIME4;
+}
+}
+
+uint64_t DedupIndex::fingerprint(const char *data, size_t len) {
+    const char *p = data;
+    const char *end = data + len;
+    uint64_t hash;
+
+    // Cuatro acumuladores independientes: el procesador los avanza en paralelo
+    if (len >= 32) {
+        uint64_t v1 = PRIME1 + PRIME2, v2 = PRIME2, v3 = 0, v4 = 0 - PRIME1;
+        for (; p + 32 <= end; p += 32) {
+            v1 = mix(v1, read64(p));
+            v2 = mix(v2, read64(p + 8));
+            v3 = mix(v3, read64(p + 16));
+            v4 = mix(v4, read64(p + 24));
+        }
+        hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        hash = mergeLane(hash, v1);
+        hash = mergeLane(hash, v2);
+        hash = mergeLane(hash, v3);
+        hash = mergeLane(hash, v4);
+    } else {
+        hash = PRIME5;
+    }
+    hash += len;
+
+    for (; p + 8 <= end; p += 8) hash = rotl(hash ^ mix(0, read64(p)), 27) * PRIME1 + PRIME4;
+    for (; p < end; p++) hash = rotl(hash ^ (static_cast<unsigned char>(*p) * PRIME5), 11) * PRIME1;
+
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+void DedupIndex::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    byHash.clear();
+    byBlock.clear();
+    refs.clear();
+}
+
+bool DedupIndex::empty() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return byHash.empty() && refs.empty();
+}
+
+int64_t DedupIndex::acquire(uint64_t hash) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = byHash.find(hash);
+    if (it == byHash.end()) return -1;
+
+    // La referencia se toma aca para que nadie libere el bloque mientras se compara
+    addRefLocked(it->second, 1);
+    return it->second;
+}
+
+void DedupIndex::insert(uint64_t hash, size_t block) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (byHash.emplace(hash, block).second) byBlock[block] = hash;
+}
+
+void DedupIndex::addRef(size_t first, size_t count) {
+    std::lock_guard<std::mutex> lock(mutex);
+    addRefLocked(first, count);
+}
+
+void DedupIndex::splitAt(size_t block) {
+    auto it = refs.upper_bound(block);
+    if (it == refs.begin()) return;
+    --it;
+    if (it->first < block && it->second.first > block) {
+        refs.emplace_hint(std::next(it), block, it->second);
+        it->second.first = block;
+    }
+}
+
+void DedupIndex::mergeAt(size_t block) {
+    auto next = refs.find(block);
+    if (next == refs.end() || next == refs.begin()) return;
+    auto prev = std::prev(next);
+    if (prev->second.first == block && prev->second.second == next->second.second) {
+        prev->second.first = next->second.first;
+        refs.erase(next);
+    }
+}
+
+void DedupIndex::addRefLocked(size_t first, size_t count) {
+    size_t end = first + count;
+    splitAt(first);
+    splitAt(end);
+
+    // Los tramos ya compartidos suben uno; los huecos tenian una referencia y pasan a dos
+    auto it = refs.lower_bound(first);
+    for (size_t pos = first; pos < end;) {
+        if (it != refs.end() && it->first == pos) {
+            it->second.second++;
+            pos = it->second.first;
+            ++it;
+            continue;
+        }
+        size_t gapEnd = it != refs.end() && it->first < end ? it->first : end;
+        it = std::next(refs.emplace_hint(it, pos, std::make_pair(gapEnd, 2u)));
+        pos = gapEnd;
+    }
+
+    // Adentro las cuentas siguen distintas entre vecinos; solo los bordes pueden juntarse
+    mergeAt(first);
+    mergeAt(end);
+}
+
+void DedupIndex::release(size_t first, size_t count, Runs &freed) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t end = first + count;
+    size_t runStart = first;
+
+    auto closeRun = [&](size_t upTo) {
+        if (upTo <= runStart) return;
+        freed.push_back({runStart, upTo - runStart});
+        if (byBlock.empty()) return;
+
+        // Con pocas huellas conviene recorrerlas a ellas en vez del tramo
+        if (byBlock.size() < upTo - runStart) {
+            for (auto it = byBlock.begin(); it != byBlock.end();) {
+                auto next = std::next(it);
+                if (it->first >= runStart && it->first < upTo) forgetLocked(it->first);
+                it = next;
+            }
+        } else {
+            for (size_t block = runStart; block < upTo; block++) forgetLocked(block);
+        }
+    };
+
+    splitAt(first);
+    splitAt(end);
+    for (auto it = refs.lower_bound(first); it != refs.end() && it->first < end;) {
+        closeRun(it->first);
+        runStart = it->second.first;
+        if (--it->second.second <= 1) it = refs.erase(it);
+        else ++it;
+    }
+    closeRun(end);
+    mergeAt(first);
+    mergeAt(end);
+}
+
+void DedupIndex::forget(size_t block) {
+    std::lock_guard<std::mutex> lock(mutex);
+    forgetLocked(block);
+}
+
+void DedupIndex::forgetLocked(size_t block) {
+    auto it = byBlock.find(block);
+    if (it == byBlock.end()) return;
+
+    auto owner = byHash.find(it->second);
+    if (owner != byHash.end() && owner->second == block) byHash.erase(owner);
+    byBlock.erase(it);
+}
+
+void DedupIndex::setRefs(const std::vector<SharedRun> &runs) {
+    std::lock_guard<std::mutex> lock(mutex);
+    refs.clear();
+    for (const SharedRun &run : runs) refs.emplace_hint(refs.end(), run.first, std::make_pair(run.first + run.count, run.refs));
+}
+
+uint32_t DedupIndex::refCount(size_t block) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = refs.upper_bound(block);
+    if (it == refs.begin()) return 1;
+    --it;
+    return block < it->second.first ? it->second.second : 1;
+}
+
+bool DedupIndex::isShared(size_t first, size_t count) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = refs.upper_bound(first);
+    if (it != refs.begin() && std::prev(it)->second.first > first) return true;
+    return it != refs.end() && it->first < first + count;
+}
+
+size_t DedupIndex::fingerprints() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return byHash.size();
+}
+
+size_t DedupIndex::sharedBlocks() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t blocks = 0;
+    for (const auto &[first, run] : refs) blocks += run.first - first;
+    return blocks;
+}
+
+bool DedupIndex::save(const std::string &path, uint64_t imageSize) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) return false;
+
+    DedupHeader header;
+    std::memcpy(header.magic, DEDUP_MAGIC, sizeof(header.magic));
+    header.imageSize = imageSize;
+    header.fingerprints = byHash.size();
+    header.shared = refs.size();
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    for (const auto &[hash, block] : byHash) {
+        FingerprintEntry entry{hash, block};
+        out.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+    }
+    for (const auto &[first, run] : refs) {
+        RefEntry entry{first, run.first - first, run.second};
+        out.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+    }
+
+    return !out.fail();
+}
+
+bool DedupIndex::load(const std::string &path, uint64_t imageSize) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) return false;
+
+    DedupHeader header;
+    in.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (in.fail() || std::memcmp(header.magic, DEDUP_MAGIC, sizeof(header.magic)) != 0 ||
+        header.imageSize != imageSize) {
+        return false;
+    }
+
+    clear();
+    std::lock_guard<std::mutex> lock(mutex);
+    byHash.reserve(header.fingerprints);
+    byBlock.reserve(header.fingerprints);
+
+    for (uint64_t i = 0; i < header.fingerprints; i++) {
+        FingerprintEntry entry;
+        in.read(reinterpret_cast<char *>(&entry), sizeof(entry));
+        if (in.fail()) break;
+        byHash[entry.hash] = entry.block;
+        byBlock[entry.block] = entry.hash;
+    }
+    for (uint64_t i = 0; i < header.shared && !in.fail(); i++) {
+        RefEntry entry;
+        in.read(reinterpret_cast<char *>(&entry), sizeof(entry));
+        if (!in.fail()) refs[entry.first] = {entry.first + entry.count, static_cast<uint32_t>(entry.refs)};
+    }
+
+    // Un archivo cortado no sirve: los contadores tienen que estar todos
+    if (in.fail()) {
+        byHash.clear();
+        byBlock.clear();
+        refs.clear();
+        return false;
+    }
+    return true;
+}
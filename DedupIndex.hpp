@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+// Deduplicacion de bloques de datos: huella de contenido -> bloque que lo guarda, y
+// cuantas referencias tiene cada bloque compartido. Los contadores van por tramos de
+// bloques seguidos con la misma cuenta (una instantanea comparte extents enteros) y un
+// bloque fuera de ellos tiene una sola referencia, asi que los archivos sin duplicados
+// no ocupan memoria. Las huellas son solo pistas: quien encuentra un candidato compara
+// los bytes.
+class DedupIndex
+{
+public:
+    using Runs = std::vector<std::pair<size_t, size_t>>;
+
+    struct SharedRun
+    {
+        size_t first;
+        size_t count;
+        uint32_t refs;
+    };
+
+    // Huella de 64 bits de un bloque (mismo esquema que xxHash64)
+    static uint64_t fingerprint(const char *data, size_t len);
+
+    void clear();
+    bool empty() const;
+
+    // Bloque con esa huella, con una referencia mas ya tomada; -1 si no hay
+    int64_t acquire(uint64_t hash);
+    // Registra un bloque recien escrito; si la huella ya tenia bloque se deja el anterior
+    void insert(uint64_t hash, size_t block);
+    // Una referencia mas a cada bloque del tramo
+    void addRef(size_t first, size_t count = 1);
+    // Quita una referencia a cada bloque del tramo y agrega a freed los que quedaron sin
+    // ninguna; sus huellas se olvidan en el mismo paso
+    void release(size_t first, size_t count, Runs &freed);
+    // El bloque se piso por fuera de los archivos: su huella ya no describe el contenido
+    void forget(size_t block);
+    // Reemplaza los contadores, al recontarlos desde los inodos; runs va ordenado y sin solapes
+    void setRefs(const std::vector<SharedRun> &runs);
+    uint32_t refCount(size_t block) const;
+    // true si algun bloque del tramo tiene mas de una referencia
+    bool isShared(size_t first, size_t count) const;
+
+    size_t fingerprints() const;
+    size_t sharedBlocks() const;
+
+    // Forma persistida; imageSize identifica la imagen a la que pertenece
+    bool save(const std::string &path, uint64_t imageSize) const;
+    bool load(const std::string &path, uint64_t imageSize);
+
+private:
+    mutable std::mutex mutex;
+    std::unordered_map<uint64_t, size_t> byHash;
+    std::unordered_map<size_t, uint64_t> byBlock;
+    // Tramos con dos o mas referencias: primer bloque -> (fin, referencias)
+    std::map<size_t, std::pair<size_t, uint32_t>> refs;
+
+    void forgetLocked(size_t block);
+    void addRefLocked(size_t first, size_t count);
+    // Corta el tramo que contiene block para que uno empiece justo ahi
+    void splitAt(size_t block);
+    // Junta los tramos que se tocan en block si quedaron con la misma cuenta
+    void mergeAt(size_t block);
+};
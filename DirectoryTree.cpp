@@ -0,0 +1,294 @@
+#include "DirectoryTree.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
+namespace {
+// Un arbol mas alto que esto solo puede salir de un ciclo en bloques dañados
+constexpr size_t MAX_DEPTH = 32;
+}
+
+void DirectoryTree::configure(size_t blockSize, Pinner pinner, Writer writer, Allocator allocator, Releaser releaser) {
+    this->blockSize = blockSize;
+    this->capacity = fanout(blockSize);
+    this->pinner = std::move(pinner);
+    this->writer = std::move(writer);
+    this->allocator = std::move(allocator);
+    this->releaser = std::move(releaser);
+}
+
+size_t DirectoryTree::fanout(size_t blockSize) {
+    if (blockSize < sizeof(NodeHeader)) return 0;
+    return std::min<size_t>((blockSize - sizeof(NodeHeader)) / sizeof(NodeEntry), UINT16_MAX);
+}
+
+void DirectoryTree::initNode(char *node, size_t blockSize) {
+    std::memset(node, 0, blockSize);
+    NodeHeader *h = header(node);
+    std::memcpy(h->magic, NODE_MAGIC, sizeof(h->magic));
+    h->leaf = 1;
+    h->count = 0;
+    h->link = -1;
+}
+
+int DirectoryTree::compare(const NodeEntry &entry, const std::string &name) {
+    return std::strncmp(entry.name, name.c_str(), NAME_BYTES);
+}
+
+bool DirectoryTree::valid(const char *node) const {
+    const NodeHeader *h = header(node);
+    return std::memcmp(h->magic, NODE_MAGIC, sizeof(h->magic)) == 0 && h->count <= capacity;
+}
+
+size_t DirectoryTree::lowerBound(const char *node, const std::string &name) const {
+    const NodeEntry *e = entries(node);
+    size_t low = 0, high = header(node)->count;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (compare(e[mid], name) < 0) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+size_t DirectoryTree::childIndex(const char *node, const std::string &name) const {
+    // Cantidad de separadores <= name: el hijo 0 es link, el i es entries[i - 1]
+    const NodeEntry *e = entries(node);
+    size_t low = 0, high = header(node)->count;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (compare(e[mid], name) <= 0) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+int64_t DirectoryTree::childAt(const char *node, size_t index) {
+    return index == 0 ? header(node)->link : entries(node)[index - 1].value;
+}
+
+bool DirectoryTree::descend(size_t root, const std::string &name, std::vector<Step> &path) const {
+    path.clear();
+    size_t block = root;
+
+    while (path.size() < MAX_DEPTH) {
+        BlockRef ref = pinner(block);
+        if (!ref || !valid(ref.data())) return false;
+
+        if (header(ref.data())->leaf) {
+            path.push_back({block, 0});
+            return true;
+        }
+
+        size_t child = childIndex(ref.data(), name);
+        path.push_back({block, child});
+        int64_t next = childAt(ref.data(), child);
+        if (next < 0) return false;
+        block = next;
+    }
+    return false;
+}
+
+int64_t DirectoryTree::find(size_t root, const std::string &name) const {
+    if (name.empty() || name.size() >= NAME_BYTES) return -1;
+
+    size_t block = root;
+    for (size_t depth = 0; depth < MAX_DEPTH; depth++) {
+        BlockRef ref = pinner(block);
+        if (!ref || !valid(ref.data())) return -1;
+
+        const char *node = ref.data();
+        if (header(node)->leaf) {
+            size_t pos = lowerBound(node, name);
+            if (pos < header(node)->count && compare(entries(node)[pos], name) == 0) return entries(node)[pos].value;
+            return -1;
+        }
+
+        int64_t next = childAt(node, childIndex(node, name));
+        if (next < 0) return -1;
+        block = next;
+    }
+    return -1;
+}
+
+bool DirectoryTree::insert(size_t root, const std::string &name, int64_t value) {
+    if (name.empty() || name.size() >= NAME_BYTES) return false;
+
+    std::vector<Step> path;
+    if (!descend(root, name, path)) return false;
+
+    // Se copian la hoja y los nodos llenos de arriba, que son los que se van a tocar: despues
+    // de reservar bloques ya no queda ninguna lectura que pueda fallar a mitad de la particion
+    std::vector<std::vector<char>> nodes;
+    size_t full = 0;
+    for (size_t level = path.size(); level-- > 0;) {
+        BlockRef ref = pinner(path[level].block);
+        if (!ref) return false;
+        nodes.emplace_back(ref.data(), ref.data() + blockSize);
+        if (header(ref.data())->count < capacity) break;
+        full++;
+    }
+    size_t pos = lowerBound(nodes[0].data(), name);
+    if (pos < header(nodes[0].data())->count && compare(entries(nodes[0].data())[pos], name) == 0) return false;
+
+    // Los bloques de una particion en cascada se reservan antes de tocar nada: un
+    // fallo a mitad de camino dejaria una hoja nueva sin separador que la alcance
+    size_t need = full == path.size() ? full + 1 : full;
+
+    std::vector<int64_t> reserve;
+    for (size_t i = 0; i < need; i++) {
+        int64_t block = allocator();
+        if (block < 0) {
+            for (int64_t taken : reserve) releaser(taken);
+            return false;
+        }
+        reserve.push_back(block);
+    }
+
+    NodeEntry carry{};
+    std::memcpy(carry.name, name.data(), name.size());
+    carry.value = value;
+
+    std::vector<char> right(blockSize);
+    std::vector<NodeEntry> all;
+    bool ok = true;
+
+    for (size_t level = path.size(); level-- > 0;) {
+        size_t block = path[level].block;
+        std::vector<char> &node = nodes[path.size() - 1 - level];
+
+        NodeHeader *h = header(node.data());
+        NodeEntry *e = entries(node.data());
+        size_t at = h->leaf ? pos : path[level].child;
+
+        if (h->count < capacity) {
+            std::memmove(e + at + 1, e + at, (h->count - at) * sizeof(NodeEntry));
+            e[at] = carry;
+            h->count++;
+            return writer(block, node.data()) && ok;
+        }
+
+        // Nodo lleno: se parte en dos mitades y el separador sube al padre
+        all.assign(e, e + h->count);
+        all.insert(all.begin() + at, carry);
+        size_t mid = all.size() / 2;
+
+        int64_t rightBlock = reserve.back();
+        reserve.pop_back();
+        initNode(right.data(), blockSize);
+        NodeHeader *rh = header(right.data());
+        rh->leaf = h->leaf;
+
+        NodeEntry separator = all[mid];
+        separator.value = rightBlock;
+
+        size_t firstRight = mid;
+        if (h->leaf) {
+            rh->link = h->link;
+            h->link = rightBlock;
+        } else {
+            // El separador de un nodo interno sube y su hijo pasa a ser el primero de la derecha
+            rh->link = all[mid].value;
+            firstRight = mid + 1;
+        }
+        h->count = mid;
+        std::memcpy(e, all.data(), mid * sizeof(NodeEntry));
+        std::memset(e + mid, 0, (capacity - mid) * sizeof(NodeEntry));
+        rh->count = all.size() - firstRight;
+        std::memcpy(entries(right.data()), all.data() + firstRight, rh->count * sizeof(NodeEntry));
+        ok = writer(rightBlock, right.data()) && ok;
+
+        if (level == 0) {
+            // La raiz se queda en su bloque: la mitad izquierda se muda y la raiz apunta a ambas
+            int64_t leftBlock = reserve.back();
+            reserve.pop_back();
+            ok = writer(leftBlock, node.data()) && ok;
+
+            initNode(node.data(), blockSize);
+            header(node.data())->leaf = 0;
+            header(node.data())->link = leftBlock;
+            header(node.data())->count = 1;
+            entries(node.data())[0] = separator;
+            return writer(block, node.data()) && ok;
+        }
+
+        ok = writer(block, node.data()) && ok;
+        carry = separator;
+    }
+    return ok;
+}
+
+bool DirectoryTree::erase(size_t root, const std::string &name) {
+    if (name.empty() || name.size() >= NAME_BYTES) return false;
+
+    std::vector<Step> path;
+    if (!descend(root, name, path)) return false;
+
+    std::vector<char> node(blockSize);
+    {
+        BlockRef ref = pinner(path.back().block);
+        if (!ref) return false;
+        std::memcpy(node.data(), ref.data(), blockSize);
+    }
+
+    NodeHeader *h = header(node.data());
+    NodeEntry *e = entries(node.data());
+    size_t pos = lowerBound(node.data(), name);
+    if (pos >= h->count || compare(e[pos], name) != 0) return false;
+
+    std::memmove(e + pos, e + pos + 1, (h->count - pos - 1) * sizeof(NodeEntry));
+    h->count--;
+    std::memset(e + h->count, 0, sizeof(NodeEntry));
+    return writer(path.back().block, node.data());
+}
+
+bool DirectoryTree::scan(size_t root, const std::string &from, const Visitor &visit) const {
+    std::vector<Step> path;
+    if (!descend(root, from, path)) return false;
+
+    int64_t block = path.back().block;
+    size_t pos = std::string::npos;
+    // Una cadena de hojas danada podria volver sobre si misma
+    std::unordered_set<int64_t> visited;
+
+    while (block >= 0) {
+        if (!visited.insert(block).second) return false;
+        BlockRef ref = pinner(block);
+        if (!ref || !valid(ref.data()) || !header(ref.data())->leaf) return false;
+
+        const char *node = ref.data();
+        if (pos == std::string::npos) pos = lowerBound(node, from);
+
+        for (size_t i = pos; i < header(node)->count; i++) {
+            if (!visit(entries(node)[i].name, entries(node)[i].value)) return true;
+        }
+
+        block = header(node)->link;
+        pos = 0;
+    }
+    return true;
+}
+
+bool DirectoryTree::collectNodes(size_t root, std::vector<int64_t> &blocks) const {
+    std::vector<std::pair<int64_t, size_t>> pending{{static_cast<int64_t>(root), 0}};
+
+    while (!pending.empty()) {
+        auto [block, depth] = pending.back();
+        pending.pop_back();
+        if (depth >= MAX_DEPTH) return false;
+
+        BlockRef ref = pinner(block);
+        if (!ref || !valid(ref.data())) return false;
+        if (static_cast<size_t>(block) != root) blocks.push_back(block);
+
+        const char *node = ref.data();
+        if (header(node)->leaf) continue;
+        for (size_t i = 0; i <= header(node)->count; i++) {
+            int64_t child = childAt(node, i);
+            if (child < 0) return false;
+            pending.push_back({child, depth + 1});
+        }
+    }
+    return true;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+#include "BlockCache.hpp"
+
+// Arbol B+ con las entradas de un directorio: nombre -> offset del inodo.
+// Cada nodo ocupa un bloque del device y se lee y escribe por las funciones que
+// da el device (cache y journal). Las hojas estan ordenadas y encadenadas, asi
+// que listar en orden o desde un prefijo solo lee las hojas del rango.
+// La raiz nunca cambia de bloque: al llenarse, su contenido baja a dos hijos nuevos.
+// Al borrar no se fusionan nodos; una hoja puede quedar vacia hasta que se reutilice.
+class DirectoryTree
+{
+public:
+    static constexpr size_t NAME_BYTES = 64;
+    // Con menos entradas por nodo una particion no deja dos mitades utiles
+    static constexpr size_t MIN_FANOUT = 3;
+
+    using Pinner = std::function<BlockRef(size_t)>;
+    using Writer = std::function<bool(size_t, const char *)>;
+    using Allocator = std::function<int64_t()>;
+    using Releaser = std::function<void(size_t)>;
+    // Recibe nombre y valor en orden; devuelve false para cortar el recorrido
+    using Visitor = std::function<bool(const char *, int64_t)>;
+
+    void configure(size_t blockSize, Pinner pinner, Writer writer, Allocator allocator, Releaser releaser);
+
+    // Entradas por nodo con bloques de blockSize bytes
+    static size_t fanout(size_t blockSize);
+    // Deja en node (blockSize bytes) una hoja vacia, para crear raices fuera de la cache
+    static void initNode(char *node, size_t blockSize);
+
+    int64_t find(size_t root, const std::string &name) const;
+    // false si el nombre ya estaba, no entra en una entrada o no hubo bloques para partir
+    bool insert(size_t root, const std::string &name, int64_t value);
+    bool erase(size_t root, const std::string &name);
+    // Recorre en orden las entradas desde la primera >= from
+    bool scan(size_t root, const std::string &from, const Visitor &visit) const;
+    // Agrega a blocks los nodos del arbol salvo la raiz, para liberarlos
+    bool collectNodes(size_t root, std::vector<int64_t> &blocks) const;
+
+private:
+    struct NodeHeader
+    {
+        char magic[4];
+        uint16_t leaf;
+        uint16_t count;
+        int64_t link; // Hoja: siguiente hoja (-1 al final). Interno: hijo de mas a la izquierda
+    } __attribute__((packed));
+
+    struct NodeEntry
+    {
+        char name[NAME_BYTES];
+        int64_t value; // Hoja: offset del inodo. Interno: hijo con los nombres >= name
+    } __attribute__((packed));
+
+    static constexpr char NODE_MAGIC[4] = {'D', 'I', 'R', 'N'};
+
+    size_t blockSize = 0;
+    size_t capacity = 0;
+    Pinner pinner;
+    Writer writer;
+    Allocator allocator;
+    Releaser releaser;
+
+    static NodeHeader *header(char *node) { return reinterpret_cast<NodeHeader *>(node); }
+    static const NodeHeader *header(const char *node) { return reinterpret_cast<const NodeHeader *>(node); }
+    static NodeEntry *entries(char *node) { return reinterpret_cast<NodeEntry *>(node + sizeof(NodeHeader)); }
+    static const NodeEntry *entries(const char *node) {
+        return reinterpret_cast<const NodeEntry *>(node + sizeof(NodeHeader));
+    }
+    static int compare(const NodeEntry &entry, const std::string &name);
+
+    bool valid(const char *node) const;
+    // Primera entrada >= name (hoja) o hijo que cubre name (interno)
+    size_t lowerBound(const char *node, const std::string &name) const;
+    size_t childIndex(const char *node, const std::string &name) const;
+    static int64_t childAt(const char *node, size_t index);
+
+    // Camino de la raiz a la hoja que cubre name: bloque e hijo tomado en cada nivel
+    struct Step
+    {
+        size_t block;
+        size_t child;
+    };
+    bool descend(size_t root, const std::string &name, std::vector<Step> &path) const;
+};
@@ -0,0 +1,178 @@
+#include "InodeIndex.hpp"
+
+#include <cstring>
+#include <fstream>
+
+namespace {
+const char INDEX_MAGIC[8] = {'S', 'B', 'I', 'D', 'X', '0', '0', '2'};
+
+struct IndexHeader
+{
+    char magic[8];
+    uint64_t imageSize;
+    uint64_t entries;
+};
+
+struct IndexEntry
+{
+    int64_t parent;
+    char name[64];
+    int64_t offset;
+};
+}
+
+void InodeIndex::clear() {
+    slots.assign(64, Slot{});
+    count = 0;
+    deleted = 0;
+}
+
+uint64_t InodeIndex::hashName(int64_t parent, const char *name, size_t len) {
+    // FNV-1a de 64 bits sobre el directorio y el nombre
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < sizeof(parent); i++) {
+        hash ^= static_cast<uint64_t>(parent) >> (i * 8) & 0xff;
+        hash *= 1099511628211ull;
+    }
+    for (size_t i = 0; i < len; i++) {
+        hash ^= static_cast<unsigned char>(name[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+size_t InodeIndex::findSlot(int64_t parent, const char *name, size_t len, uint64_t hash, size_t *probes) const {
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        if (probes) (*probes)++;
+        const Slot &slot = slots[i];
+        if (slot.state == EMPTY) return static_cast<size_t>(-1);
+        if (slot.state == USED && slot.hash == hash && slot.parent == parent &&
+            std::strncmp(slot.name, name, sizeof(slot.name)) == 0 && slot.name[len] == '\0') {
+            return i;
+        }
+    }
+}
+
+void InodeIndex::insert(int64_t parent, const std::string &name, int64_t offset) {
+    if (name.empty() || name.size() >= sizeof(Slot::name)) return;
+
+    if ((count + deleted + 1) * 10 > slots.size() * 7) {
+        grow(count * 2 >= slots.size() / 2 ? slots.size() * 2 : slots.size());
+    }
+
+    uint64_t hash = hashName(parent, name.data(), name.size());
+    size_t existing = findSlot(parent, name.data(), name.size(), hash);
+    if (existing != static_cast<size_t>(-1)) {
+        slots[existing].offset = offset;
+        return;
+    }
+
+    size_t mask = slots.size() - 1;
+    size_t i = hash & mask;
+    while (slots[i].state == USED) i = (i + 1) & mask;
+
+    if (slots[i].state == DELETED) deleted--;
+
+    Slot &slot = slots[i];
+    slot.hash = hash;
+    slot.parent = parent;
+    slot.offset = offset;
+    std::memset(slot.name, 0, sizeof(slot.name));
+    std::memcpy(slot.name, name.data(), name.size());
+    slot.state = USED;
+    count++;
+}
+
+int64_t InodeIndex::find(int64_t parent, const std::string &name, size_t *probes) const {
+    if (name.empty() || name.size() >= sizeof(Slot::name)) return -1;
+
+    size_t i = findSlot(parent, name.data(), name.size(), hashName(parent, name.data(), name.size()), probes);
+    if (i == static_cast<size_t>(-1)) return -1;
+    return slots[i].offset;
+}
+
+bool InodeIndex::erase(int64_t parent, const std::string &name) {
+    if (name.empty() || name.size() >= sizeof(Slot::name)) return false;
+
+    size_t i = findSlot(parent, name.data(), name.size(), hashName(parent, name.data(), name.size()));
+    if (i == static_cast<size_t>(-1)) return false;
+
+    slots[i].state = DELETED;
+    count--;
+    deleted++;
+    return true;
+}
+
+void InodeIndex::grow(size_t capacity) {
+    std::vector<Slot> old;
+    old.swap(slots);
+
+    slots.assign(capacity, Slot{});
+    count = 0;
+    deleted = 0;
+
+    size_t mask = capacity - 1;
+    for (const Slot &slot : old) {
+        if (slot.state != USED) continue;
+
+        size_t i = slot.hash & mask;
+        while (slots[i].state == USED) i = (i + 1) & mask;
+        slots[i] = slot;
+        count++;
+    }
+}
+
+bool InodeIndex::save(const std::string &path, uint64_t imageSize) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) return false;
+
+    IndexHeader header;
+    std::memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.imageSize = imageSize;
+    header.entries = count;
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    for (const Slot &slot : slots) {
+        if (slot.state != USED) continue;
+
+        IndexEntry entry;
+        entry.parent = slot.parent;
+        std::memcpy(entry.name, slot.name, sizeof(entry.name));
+        entry.offset = slot.offset;
+        out.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+    }
+
+    return !out.fail();
+}
+
+bool InodeIndex::load(const std::string &path, uint64_t imageSize) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) return false;
+
+    IndexHeader header;
+    in.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (in.fail() || std::memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+        header.imageSize != imageSize) {
+        return false;
+    }
+
+    clear();
+    size_t capacity = slots.size();
+    while (capacity * 7 < header.entries * 10) capacity *= 2;
+    grow(capacity);
+
+    for (uint64_t i = 0; i < header.entries; i++) {
+        IndexEntry entry;
+        in.read(reinterpret_cast<char *>(&entry), sizeof(entry));
+        if (in.fail()) {
+            clear();
+            return false;
+        }
+
+        entry.name[sizeof(entry.name) - 1] = '\0';
+        insert(entry.parent, entry.name, entry.offset);
+    }
+
+    return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Indice en memoria (directorio, nombre) -> offset del inodo, con direccionamiento
+// abierto (sondeo lineal). El directorio es el offset de su inodo (ROOT para la raiz,
+// SNAPSHOTS para la lista de instantaneas) y los nombres se guardan igual que en Inodo::name.
+class InodeIndex
+{
+public:
+    static constexpr int64_t ROOT = 0;
+    // Ningun inodo cae en el bloque 0, que es el superbloque
+    static constexpr int64_t SNAPSHOTS = 1;
+
+    InodeIndex() { clear(); }
+
+    void clear();
+    void insert(int64_t parent, const std::string &name, int64_t offset);
+    // probes (opcional) recibe cuantas ranuras se revisaron
+    int64_t find(int64_t parent, const std::string &name, size_t *probes = nullptr) const;
+    bool erase(int64_t parent, const std::string &name);
+    size_t size() const { return count; }
+
+    // Forma persistida opcional; imageSize identifica la imagen a la que pertenece
+    bool save(const std::string &path, uint64_t imageSize) const;
+    bool load(const std::string &path, uint64_t imageSize);
+
+private:
+    enum SlotState : uint8_t
+    {
+        EMPTY,
+        USED,
+        DELETED
+    };
+
+    struct Slot
+    {
+        uint64_t hash;
+        int64_t parent;
+        int64_t offset;
+        char name[64];
+        SlotState state;
+    };
+
+    std::vector<Slot> slots;
+    size_t count = 0;
+    size_t deleted = 0;
+
+    static uint64_t hashName(int64_t parent, const char *name, size_t len);
+    size_t findSlot(int64_t parent, const char *name, size_t len, uint64_t hash, size_t *probes = nullptr) const;
+    void grow(size_t capacity);
+};
@@ -0,0 +1,278 @@
+#include "Journal.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+const char JOURNAL_MAGIC[8] = {'S', 'B', 'J', 'R', 'N', 'L', '0', '1'};
+
+struct JournalHeader
+{
+    char magic[8];
+    uint64_t sequence;
+    uint64_t blocks;   // Bloques de la transaccion, 0 = journal vacio
+    uint64_t checksum; // FNV-1a de la secuencia, los destinos, las imagenes y los tramos
+    uint64_t spillRuns; // Tramos de desborde, 0 = la transaccion esta en la region
+};
+
+// FNV-1a de 64 bits, continuable
+uint64_t fnv(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+}
+
+void Journal::attach(StorageBackend *storage, size_t blockSize, uint64_t firstBlock, uint64_t blockCount) {
+    this->storage = storage;
+    this->blockSize = blockSize;
+    this->firstBlock = firstBlock;
+    this->blockCount = blockCount;
+    sequence = 0;
+    commits = 0;
+    clearStaged();
+}
+
+void Journal::detach() {
+    storage = nullptr;
+    blockCount = 0;
+    clearStaged();
+}
+
+size_t Journal::descriptorBlocks(size_t count) const {
+    size_t perBlock = blockSize / sizeof(uint64_t);
+    return (count + perBlock - 1) / perBlock;
+}
+
+size_t Journal::getCapacity() const {
+    if (!isEnabled()) return 0;
+
+    // count + descriptorBlocks(count) tiene que caber detras de la cabecera
+    size_t perBlock = blockSize / sizeof(uint64_t);
+    return (blockCount - 1) * perBlock / (perBlock + 1);
+}
+
+size_t Journal::getSpillCapacity() const {
+    if (!isEnabled()) return 0;
+    return (blockCount - 1) * blockSize / sizeof(SpillRun);
+}
+
+uint64_t Journal::checksum(uint64_t sequence, const uint64_t *targets, size_t count, const char *images,
+                           const std::vector<SpillRun> &spill) const {
+    uint64_t hash = fnv(14695981039346656037ull, &sequence, sizeof(sequence));
+    hash = fnv(hash, targets, count * sizeof(uint64_t));
+    hash = fnv(hash, images, count * blockSize);
+    return fnv(hash, spill.data(), spill.size() * sizeof(SpillRun));
+}
+
+bool Journal::writeArea(const std::vector<SpillRun> &spill, size_t offset, const char *src, size_t blocks) {
+    if (spill.empty()) return storage->writeAt((firstBlock + 1 + offset) * blockSize, src, blocks * blockSize);
+
+    bool ok = true;
+    for (const SpillRun &run : spill) {
+        if (blocks == 0) break;
+        if (offset >= run.length) {
+            offset -= run.length;
+            continue;
+        }
+
+        size_t n = std::min<size_t>(run.length - offset, blocks);
+        ok = storage->writeAt((run.start + offset) * blockSize, src, n * blockSize) && ok;
+        src += n * blockSize;
+        blocks -= n;
+        offset = 0;
+    }
+    return ok && blocks == 0;
+}
+
+bool Journal::readArea(const std::vector<SpillRun> &spill, size_t offset, char *dst, size_t blocks) {
+    if (spill.empty()) return storage->readAt((firstBlock + 1 + offset) * blockSize, dst, blocks * blockSize);
+
+    for (const SpillRun &run : spill) {
+        if (blocks == 0) break;
+        if (offset >= run.length) {
+            offset -= run.length;
+            continue;
+        }
+
+        size_t n = std::min<size_t>(run.length - offset, blocks);
+        if (!storage->readAt((run.start + offset) * blockSize, dst, n * blockSize)) return false;
+        dst += n * blockSize;
+        blocks -= n;
+        offset = 0;
+    }
+    return blocks == 0;
+}
+
+bool Journal::commit(const uint64_t *targets, size_t count, const char *images, bool durable,
+                     const std::vector<SpillRun> &spill) {
+    if (!isEnabled() || count == 0) return true;
+
+    size_t descriptors = descriptorBlocks(count);
+    if (spill.empty() && count > getCapacity()) return false;
+    if (spill.size() > getSpillCapacity()) return false;
+
+    std::vector<char> raw(std::max(descriptors, static_cast<size_t>(1)) * blockSize, 0);
+    std::memcpy(raw.data(), targets, count * sizeof(uint64_t));
+
+    bool ok = writeArea(spill, 0, raw.data(), descriptors);
+    ok = ok && writeArea(spill, descriptors, images, count);
+    if (ok && !spill.empty()) {
+        size_t listBlocks = (spill.size() * sizeof(SpillRun) + blockSize - 1) / blockSize;
+        std::vector<char> list(listBlocks * blockSize, 0);
+        std::memcpy(list.data(), spill.data(), spill.size() * sizeof(SpillRun));
+        ok = storage->writeAt((firstBlock + 1) * blockSize, list.data(), list.size());
+    }
+
+    // Primera fase: las imagenes (y los datos escritos antes) llegan al disco antes que
+    // la cabecera, asi una cabecera valida nunca confirma bloques que no se escribieron
+    ok = ok && (!durable || storage->fsync());
+    if (!ok) return false;
+
+    JournalHeader header;
+    std::memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+    header.sequence = ++sequence;
+    header.blocks = count;
+    header.checksum = checksum(header.sequence, targets, count, images, spill);
+    header.spillRuns = spill.size();
+
+    std::fill(raw.begin(), raw.begin() + blockSize, 0);
+    std::memcpy(raw.data(), &header, sizeof(header));
+    ok = storage->writeAt(firstBlock * blockSize, raw.data(), blockSize);
+
+    // Segunda fase: la cabecera confirma la transaccion
+    ok = ok && (!durable || storage->fsync());
+    if (ok) commits++;
+    return ok;
+}
+
+bool Journal::clear() {
+    if (!isEnabled()) return true;
+
+    std::vector<char> raw(blockSize, 0);
+    JournalHeader header;
+    std::memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+    header.sequence = sequence;
+    header.blocks = 0;
+    header.checksum = 0;
+    header.spillRuns = 0;
+    std::memcpy(raw.data(), &header, sizeof(header));
+
+    // No hace falta fsync: volver a aplicar una transaccion ya copiada no cambia nada
+    return storage->writeAt(firstBlock * blockSize, raw.data(), raw.size());
+}
+
+bool Journal::replay(size_t &applied) {
+    applied = 0;
+    if (!isEnabled()) return true;
+
+    std::vector<char> raw(blockSize);
+    if (!storage->readAt(firstBlock * blockSize, raw.data(), raw.size())) return false;
+
+    JournalHeader header;
+    std::memcpy(&header, raw.data(), sizeof(header));
+    if (std::memcmp(header.magic, JOURNAL_MAGIC, sizeof(header.magic)) != 0) return true;
+
+    sequence = header.sequence;
+    if (header.blocks == 0) return true;
+    if (header.spillRuns == 0 && header.blocks > getCapacity()) return true;
+    if (header.spillRuns > getSpillCapacity()) return true;
+
+    // Tramos de desborde: si no alcanzan o se salen de la imagen, la cabecera no es de este journal
+    std::vector<SpillRun> spill(header.spillRuns);
+    if (!spill.empty()) {
+        size_t listBlocks = (spill.size() * sizeof(SpillRun) + blockSize - 1) / blockSize;
+        std::vector<char> list(listBlocks * blockSize);
+        if (!storage->readAt((firstBlock + 1) * blockSize, list.data(), list.size())) return false;
+        std::memcpy(spill.data(), list.data(), spill.size() * sizeof(SpillRun));
+
+        uint64_t total = 0;
+        uint64_t deviceBlocks = storage->size() / blockSize;
+        for (const SpillRun &run : spill) {
+            if (run.length > deviceBlocks || run.start > deviceBlocks - run.length) return true;
+            total += run.length;
+        }
+        if (header.blocks > deviceBlocks || total < spillBlocks(header.blocks)) return true;
+    }
+
+    size_t count = header.blocks;
+    size_t descriptors = descriptorBlocks(count);
+    std::vector<uint64_t> targets(descriptors * blockSize / sizeof(uint64_t));
+    std::vector<char> images(count * blockSize);
+
+    if (!readArea(spill, 0, reinterpret_cast<char *>(targets.data()), descriptors) ||
+        !readArea(spill, descriptors, images.data(), count)) {
+        return false;
+    }
+
+    // Una transaccion que no termino de escribirse nunca se confirmo: se ignora
+    if (checksum(header.sequence, targets.data(), count, images.data(), spill) != header.checksum) return true;
+
+    bool ok = true;
+    for (size_t i = 0; i < count; i++) {
+        if (targets[i] >= firstBlock && targets[i] < firstBlock + blockCount) continue;
+        ok = storage->writeAt(targets[i] * blockSize, images.data() + i * blockSize, blockSize) && ok;
+    }
+
+    ok = ok && storage->fsync() && clear();
+    if (ok) applied = count;
+    return ok;
+}
+
+void Journal::stage(uint64_t block, const char *data) {
+    std::lock_guard<std::mutex> lock(stagedMutex);
+
+    std::vector<char> &image = staged[block];
+    image.assign(data, data + blockSize);
+    stagedCount.store(staged.size(), std::memory_order_relaxed);
+}
+
+bool Journal::lookupStaged(uint64_t block, char *dst) {
+    if (getStagedCount() == 0) return false;
+
+    std::lock_guard<std::mutex> lock(stagedMutex);
+    auto it = staged.find(block);
+    if (it == staged.end()) return false;
+
+    std::memcpy(dst, it->second.data(), blockSize);
+    return true;
+}
+
+bool Journal::isStaged(uint64_t block) {
+    if (getStagedCount() == 0) return false;
+
+    std::lock_guard<std::mutex> lock(stagedMutex);
+    return staged.count(block) != 0;
+}
+
+void Journal::overlayStaged(uint64_t first, size_t count, char *dst, const std::vector<bool> *skip) {
+    if (getStagedCount() == 0) return;
+
+    std::lock_guard<std::mutex> lock(stagedMutex);
+    for (const auto &entry : staged) {
+        if (entry.first >= first && entry.first < first + count) {
+            if (skip && (*skip)[entry.first - first]) continue;
+            std::memcpy(dst + (entry.first - first) * blockSize, entry.second.data(), blockSize);
+        }
+    }
+}
+
+void Journal::copyStaged(std::vector<uint64_t> &targets, std::vector<char> &images, uint64_t first,
+                         uint64_t count) {
+    std::lock_guard<std::mutex> lock(stagedMutex);
+
+    for (const auto &entry : staged) {
+        if (entry.first < first || entry.first - first >= count) continue;
+        targets.push_back(entry.first);
+        images.insert(images.end(), entry.second.begin(), entry.second.end());
+    }
+}
+
+void Journal::clearStaged() {
+    std::lock_guard<std::mutex> lock(stagedMutex);
+    staged.clear();
+    stagedCount.store(0, std::memory_order_relaxed);
+}
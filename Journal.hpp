@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+#include "StorageBackend.hpp"
+
+// Tramo de bloques libres del device donde se desborda una transaccion
+struct SpillRun
+{
+    uint64_t start;
+    uint64_t length;
+};
+
+// Journal de metadatos por bloques completos (write-ahead). Una transaccion son
+// imagenes de bloques con su destino: se escriben en la region del journal, un
+// fsync las hace durables, despues se escribe la cabecera con checksum y un
+// segundo fsync la confirma; recien entonces se copian en su lugar. Si el proceso
+// muere antes de copiarlas, replay() las aplica al abrir.
+//
+// Region: [cabecera][descriptores: destinos uint64][imagenes]
+// Una transaccion que no cabe se escribe entera (descriptores e imagenes) en
+// tramos de bloques libres, y la region guarda solo la lista de esos tramos:
+// [cabecera][SpillRun...]. Asi una operacion nunca se confirma a medias.
+class Journal
+{
+public:
+    void attach(StorageBackend *storage, size_t blockSize, uint64_t firstBlock, uint64_t blockCount);
+    void detach();
+    bool isEnabled() const { return storage != nullptr && blockCount > 1; }
+
+    uint64_t getFirstBlock() const { return firstBlock; }
+    uint64_t getBlockCount() const { return blockCount; }
+    // Bloques que caben en una transaccion
+    size_t getCapacity() const;
+    // Tramos de desborde que caben en la region, y bloques que ocupa una transaccion fuera de ella
+    size_t getSpillCapacity() const;
+    size_t spillBlocks(size_t count) const { return descriptorBlocks(count) + count; }
+    uint64_t getCommits() const { return commits; }
+
+    // Aplica la ultima transaccion confirmada, si la hay; applied = bloques recuperados
+    bool replay(size_t &applied);
+    // Escribe la transaccion y la hace durable; images tiene count bloques seguidos.
+    // Sin durable no se espera al disco: vale recien con el proximo fsync.
+    // spill son los tramos libres a usar si count supera getCapacity()
+    bool commit(const uint64_t *targets, size_t count, const char *images, bool durable = true,
+                const std::vector<SpillRun> &spill = {});
+    // Deja el journal vacio (la transaccion ya esta en su lugar)
+    bool clear();
+
+    // Bloques que la cache desaloja antes de que su transaccion se confirme:
+    // no pueden ir a su lugar todavia, se guardan aqui hasta el commit
+    void stage(uint64_t block, const char *data);
+    bool lookupStaged(uint64_t block, char *dst);
+    bool isStaged(uint64_t block);
+    // Copia sobre dst los bloques del rango que esten guardados
+    void overlayStaged(uint64_t first, size_t count, char *dst, const std::vector<bool> *skip = nullptr);
+    size_t getStagedCount() const { return stagedCount.load(std::memory_order_relaxed); }
+    // Sin rango copia todos; con rango, solo los bloques de [first, first + count)
+    void copyStaged(std::vector<uint64_t> &targets, std::vector<char> &images, uint64_t first = 0,
+                    uint64_t count = UINT64_MAX);
+    void clearStaged();
+
+private:
+    StorageBackend *storage = nullptr;
+    size_t blockSize = 0;
+    uint64_t firstBlock = 0;
+    uint64_t blockCount = 0;
+    uint64_t sequence = 0;
+    uint64_t commits = 0;
+
+    std::mutex stagedMutex;
+    std::unordered_map<uint64_t, std::vector<char>> staged;
+    std::atomic<size_t> stagedCount{0};
+
+    size_t descriptorBlocks(size_t count) const;
+    uint64_t checksum(uint64_t sequence, const uint64_t *targets, size_t count, const char *images,
+                      const std::vector<SpillRun> &spill) const;
+    // E/S sobre el area de la transaccion: la region despues de la cabecera, o los tramos de desborde
+    bool writeArea(const std::vector<SpillRun> &spill, size_t offset, const char *src, size_t blocks);
+    bool readArea(const std::vector<SpillRun> &spill, size_t offset, char *dst, size_t blocks);
+};
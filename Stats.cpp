@@ -0,0 +1,163 @@
+#include "Stats.hpp"
+
+#include <iomanip>
+
+void LatencyHistogram::record(uint64_t nanoseconds) {
+    size_t bucket = nanoseconds == 0 ? 0 : 64 - __builtin_clzll(nanoseconds);
+    if (bucket >= BUCKETS) bucket = BUCKETS - 1;
+
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::reset() {
+    for (std::atomic<uint64_t> &bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+    count.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    // Se suman las cubetas en vez de usar count: los hilos pueden estar registrando mientras tanto
+    uint64_t total = 0;
+    for (size_t i = 0; i < BUCKETS; i++) total += getBucket(i);
+    if (total == 0) return 0;
+
+    uint64_t rank = static_cast<uint64_t>(p * total);
+    if (rank >= total) rank = total - 1;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += getBucket(i);
+        if (seen > rank) return bucketBound(i);
+    }
+    return bucketBound(BUCKETS - 1);
+}
+
+void DeviceStats::noteAccess(uint64_t offset, uint64_t len) {
+    // Entre hilos el "anterior" es aproximado, que es lo que ve el disco de todos modos
+    uint64_t previous = lastEnd.exchange(offset + len, std::memory_order_relaxed);
+    if (previous != offset) add(StatCounter::SEEKS);
+}
+
+void DeviceStats::noteRead(uint64_t offset, uint64_t len, size_t blockSize) {
+    if (!isEnabled()) return;
+
+    add(StatCounter::BLOCKS_READ, (len + blockSize - 1) / blockSize);
+    add(StatCounter::BYTES_READ, len);
+    noteAccess(offset, len);
+}
+
+void DeviceStats::noteWrite(uint64_t offset, uint64_t len, size_t blockSize) {
+    if (!isEnabled()) return;
+
+    add(StatCounter::BLOCKS_WRITTEN, (len + blockSize - 1) / blockSize);
+    add(StatCounter::BYTES_WRITTEN, len);
+    noteAccess(offset, len);
+}
+
+void DeviceStats::reset() {
+    for (PaddedCounter &counter : counters) counter.value.store(0, std::memory_order_relaxed);
+    for (LatencyHistogram &histogram : histograms) histogram.reset();
+    lastEnd.store(0, std::memory_order_relaxed);
+}
+
+const char *DeviceStats::counterName(StatCounter counter) {
+    switch (counter) {
+    case StatCounter::BLOCKS_READ: return "blocks_read";
+    case StatCounter::BLOCKS_WRITTEN: return "blocks_written";
+    case StatCounter::BYTES_READ: return "bytes_read";
+    case StatCounter::BYTES_WRITTEN: return "bytes_written";
+    case StatCounter::SEEKS: return "seeks";
+    case StatCounter::INODE_LOOKUPS: return "inode_lookups";
+    case StatCounter::INODE_PROBES: return "inode_lookup_probes";
+    case StatCounter::INODE_ALLOCS: return "inode_allocs";
+    default: return "unknown";
+    }
+}
+
+const char *DeviceStats::opName(StatOp op) {
+    switch (op) {
+    case StatOp::READ: return "read";
+    case StatOp::WRITE: return "write";
+    case StatOp::READ_BLOCK: return "read_block";
+    case StatOp::WRITE_BLOCK: return "write_block";
+    default: return "unknown";
+    }
+}
+
+void DeviceStats::dump(std::ostream &out, StatsFormat format, const Metrics &extra) const {
+    const size_t counterCount = static_cast<size_t>(StatCounter::COUNT);
+    const size_t opCount = static_cast<size_t>(StatOp::COUNT);
+
+    if (format == StatsFormat::JSON) {
+        out << "{\n  \"counters\": {";
+        for (size_t i = 0; i < counterCount; i++) {
+            StatCounter counter = static_cast<StatCounter>(i);
+            out << (i ? ", " : "") << "\"" << counterName(counter) << "\": " << get(counter);
+        }
+        for (const Metric &metric : extra) out << ", \"" << metric.name << "\": " << metric.value;
+
+        out << "},\n  \"latency_ns\": {";
+        for (size_t i = 0; i < opCount; i++) {
+            const LatencyHistogram &h = histograms[i];
+            out << (i ? "," : "") << "\n    \"" << opName(static_cast<StatOp>(i)) << "\": {\"count\": " << h.getCount()
+                << ", \"sum\": " << h.getSum() << ", \"p50\": " << h.percentile(0.50)
+                << ", \"p99\": " << h.percentile(0.99) << ", \"buckets\": [";
+            for (size_t b = 0; b < LatencyHistogram::BUCKETS; b++) out << (b ? ", " : "") << h.getBucket(b);
+            out << "]}";
+        }
+        out << "\n  }\n}\n";
+        return;
+    }
+
+    if (format == StatsFormat::PROMETHEUS) {
+        for (size_t i = 0; i < counterCount; i++) {
+            StatCounter counter = static_cast<StatCounter>(i);
+            out << "# TYPE blockdevice_" << counterName(counter) << "_total counter\n"
+                << "blockdevice_" << counterName(counter) << "_total " << get(counter) << "\n";
+        }
+        for (const Metric &metric : extra) {
+            std::string name = "blockdevice_" + metric.name + (metric.counter ? "_total" : "");
+            out << "# TYPE " << name << (metric.counter ? " counter\n" : " gauge\n") << name << " " << metric.value << "\n";
+        }
+
+        // Histograma acumulado con las cotas en segundos, como espera Prometheus
+        std::streamsize precision = out.precision(10);
+        out << "# TYPE blockdevice_op_latency_seconds histogram\n";
+        for (size_t i = 0; i < opCount; i++) {
+            const LatencyHistogram &h = histograms[i];
+            const char *op = opName(static_cast<StatOp>(i));
+            uint64_t cumulative = 0;
+
+            for (size_t b = 0; b + 1 < LatencyHistogram::BUCKETS; b++) {
+                cumulative += h.getBucket(b);
+                out << "blockdevice_op_latency_seconds_bucket{op=\"" << op << "\",le=\""
+                    << LatencyHistogram::bucketBound(b) / 1e9 << "\"} " << cumulative << "\n";
+            }
+            cumulative += h.getBucket(LatencyHistogram::BUCKETS - 1);
+            out << "blockdevice_op_latency_seconds_bucket{op=\"" << op << "\",le=\"+Inf\"} " << cumulative << "\n"
+                << "blockdevice_op_latency_seconds_sum{op=\"" << op << "\"} " << h.getSum() / 1e9 << "\n"
+                << "blockdevice_op_latency_seconds_count{op=\"" << op << "\"} " << cumulative << "\n";
+        }
+        out.precision(precision);
+        return;
+    }
+
+    out << "Stats:\n";
+    for (size_t i = 0; i < counterCount; i++) {
+        StatCounter counter = static_cast<StatCounter>(i);
+        out << "  " << std::left << std::setw(22) << counterName(counter) << std::right << get(counter) << "\n";
+    }
+    for (const Metric &metric : extra) {
+        out << "  " << std::left << std::setw(22) << metric.name << std::right << metric.value << "\n";
+    }
+
+    out << "  Latencias (us):         count       p50       p99\n";
+    for (size_t i = 0; i < opCount; i++) {
+        const LatencyHistogram &h = histograms[i];
+        out << "  " << std::left << std::setw(20) << opName(static_cast<StatOp>(i)) << std::right << std::setw(10)
+            << h.getCount() << std::setw(10) << h.percentile(0.50) / 1000.0 << std::setw(10)
+            << h.percentile(0.99) / 1000.0 << "\n";
+    }
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Histograma de latencias en nanosegundos con cubetas de potencias de 2.
+// record() es un par de incrementos atomicos relajados: no toma candados.
+class LatencyHistogram
+{
+public:
+    // La cubeta i cuenta latencias en [2^(i-1), 2^i); la ultima se queda con el resto
+    static constexpr size_t BUCKETS = 40;
+
+    void record(uint64_t nanoseconds);
+    void reset();
+
+    uint64_t getCount() const { return count.load(std::memory_order_relaxed); }
+    uint64_t getSum() const { return sum.load(std::memory_order_relaxed); }
+    uint64_t getBucket(size_t i) const { return buckets[i].load(std::memory_order_relaxed); }
+    static uint64_t bucketBound(size_t i) { return 1ull << i; }
+
+    // Cota superior de la cubeta donde cae el percentil p (0..1)
+    uint64_t percentile(double p) const;
+
+private:
+    std::atomic<uint64_t> buckets[BUCKETS] = {};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum{0};
+};
+
+enum class StatCounter
+{
+    BLOCKS_READ,
+    BLOCKS_WRITTEN,
+    BYTES_READ,
+    BYTES_WRITTEN,
+    SEEKS,              // Accesos al disco que no empiezan donde termino el anterior
+    INODE_LOOKUPS,
+    INODE_PROBES,       // Sondeos del indice en buscarInodo
+    INODE_ALLOCS,       // Inodos asignados por buscarInodoLibre
+    COUNT
+};
+
+enum class StatOp
+{
+    READ,
+    WRITE,
+    READ_BLOCK,
+    WRITE_BLOCK,
+    COUNT
+};
+
+enum class StatsFormat
+{
+    TEXT,
+    JSON,
+    PROMETHEUS
+};
+
+// Contadores e histogramas del device. Todo es atomico y relajado, pensado para
+// quedar encendido: cada contador vive en su propia linea de cache.
+class DeviceStats
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    // Valores que se toman de otros componentes al volcar (cache, journal, asignador);
+    // counter indica si solo crece, para exportarlo con el tipo correcto
+    struct Metric
+    {
+        std::string name;
+        uint64_t value;
+        bool counter;
+    };
+    using Metrics = std::vector<Metric>;
+
+    void setEnabled(bool enabled) { this->enabled.store(enabled, std::memory_order_relaxed); }
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    void add(StatCounter counter, uint64_t n = 1) {
+        if (isEnabled()) counters[static_cast<size_t>(counter)].value.fetch_add(n, std::memory_order_relaxed);
+    }
+    uint64_t get(StatCounter counter) const {
+        return counters[static_cast<size_t>(counter)].value.load(std::memory_order_relaxed);
+    }
+
+    // Cuenta un acceso al disco de len bytes en offset (bloques, bytes y seeks)
+    void noteRead(uint64_t offset, uint64_t len, size_t blockSize);
+    void noteWrite(uint64_t offset, uint64_t len, size_t blockSize);
+
+    LatencyHistogram &latency(StatOp op) { return histograms[static_cast<size_t>(op)]; }
+    const LatencyHistogram &latency(StatOp op) const { return histograms[static_cast<size_t>(op)]; }
+
+    void reset();
+    void dump(std::ostream &out, StatsFormat format, const Metrics &extra) const;
+
+    static const char *counterName(StatCounter counter);
+    static const char *opName(StatOp op);
+
+private:
+    struct alignas(64) PaddedCounter
+    {
+        std::atomic<uint64_t> value{0};
+    };
+
+    std::atomic<bool> enabled{true};
+    PaddedCounter counters[static_cast<size_t>(StatCounter::COUNT)];
+    alignas(64) std::atomic<uint64_t> lastEnd{0};
+    LatencyHistogram histograms[static_cast<size_t>(StatOp::COUNT)];
+
+    void noteAccess(uint64_t offset, uint64_t len);
+};
+
+// Mide la duracion de su alcance y la registra en el histograma de op
+class ScopedLatency
+{
+public:
+    ScopedLatency(DeviceStats &stats, StatOp op)
+        : histogram(stats.isEnabled() ? &stats.latency(op) : nullptr) {
+        if (histogram) start = DeviceStats::Clock::now();
+    }
+    ~ScopedLatency() {
+        if (!histogram) return;
+        auto elapsed = DeviceStats::Clock::now() - start;
+        histogram->record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+    ScopedLatency(const ScopedLatency &) = delete;
+    ScopedLatency &operator=(const ScopedLatency &) = delete;
+
+private:
+    LatencyHistogram *histogram;
+    DeviceStats::Clock::time_point start;
+};
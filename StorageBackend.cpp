@@ -0,0 +1,263 @@
+#include "StorageBackend.hpp"
+
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+bool punchFile(int fd, uint64_t offset, uint64_t len) {
+#if defined(FALLOC_FL_PUNCH_HOLE)
+    // KEEP_SIZE: el archivo no se achica, solo deja de ocupar esos bloques
+    return fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, len) == 0;
+#else
+    return false;
+#endif
+}
+}
+
+bool FstreamBackend::open(const std::string &path, bool truncate) {
+    this->path = path;
+    if (truncate) {
+        file.open(path, std::ios::out | std::ios::binary);
+        if (file.is_open()) {
+            // Se reabre en lectura/escritura para que el mismo stream sirva en ambos sentidos
+            file.close();
+            file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+        }
+    } else {
+        file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+    }
+    return file.is_open();
+}
+
+void FstreamBackend::close() {
+    if (file.is_open()) file.close();
+}
+
+bool FstreamBackend::readAt(uint64_t offset, char *dst, size_t len) {
+    std::lock_guard<std::mutex> lock(mutex);
+    file.clear();
+    file.seekg(offset, std::ios::beg);
+    file.read(dst, len);
+    return !file.fail();
+}
+
+bool FstreamBackend::writeAt(uint64_t offset, const char *src, size_t len) {
+    std::lock_guard<std::mutex> lock(mutex);
+    file.clear();
+    file.seekp(offset, std::ios::beg);
+    file.write(src, len);
+    return !file.fail();
+}
+
+uint64_t FstreamBackend::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    file.clear();
+    file.seekg(0, std::ios::end);
+    return file.tellg();
+}
+
+bool FstreamBackend::sync() {
+    std::lock_guard<std::mutex> lock(mutex);
+    file.flush();
+    return !file.fail();
+}
+
+bool FstreamBackend::fsync() {
+    std::lock_guard<std::mutex> lock(mutex);
+    file.flush();
+    if (file.fail()) return false;
+
+    // fsync sobre cualquier descriptor del archivo baja todas sus paginas sucias
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) return false;
+    bool ok = ::fdatasync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+bool FstreamBackend::punchHole(uint64_t offset, uint64_t len) {
+    std::lock_guard<std::mutex> lock(mutex);
+    file.flush();
+    if (file.fail()) return false;
+
+    int fd = ::open(path.c_str(), O_WRONLY);
+    if (fd == -1) return false;
+    bool ok = punchFile(fd, offset, len);
+    ::close(fd);
+    return ok;
+}
+
+bool FstreamBackend::resize(uint64_t size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    file.flush();
+    if (file.fail()) return false;
+    return ::truncate(path.c_str(), size) == 0;
+}
+
+bool MmapBackend::open(const std::string &path, bool truncate) {
+    int flags = O_RDWR | (truncate ? O_CREAT | O_TRUNC : 0);
+    fd = ::open(path.c_str(), flags, 0644);
+    if (fd == -1) return false;
+
+    // Un archivo recien creado se llena con pwrite; solo se proyecta al abrirlo
+    if (truncate) return true;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        close();
+        return false;
+    }
+
+    void *addr = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        close();
+        return false;
+    }
+
+    mapping = static_cast<char *>(addr);
+    mappedSize = st.st_size;
+    return true;
+}
+
+void MmapBackend::close() {
+    if (mapping) {
+        munmap(mapping, mappedSize);
+        mapping = nullptr;
+        mappedSize = 0;
+    }
+    if (fd != -1) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool MmapBackend::readAt(uint64_t offset, char *dst, size_t len) {
+    if (mapping && offset + len <= mappedSize) {
+        std::memcpy(dst, mapping + offset, len);
+        return true;
+    }
+    return pread(fd, dst, len, offset) == static_cast<ssize_t>(len);
+}
+
+bool MmapBackend::writeAt(uint64_t offset, const char *src, size_t len) {
+    if (mapping && offset + len <= mappedSize) {
+        std::memcpy(mapping + offset, src, len);
+        return true;
+    }
+    return pwrite(fd, src, len, offset) == static_cast<ssize_t>(len);
+}
+
+uint64_t MmapBackend::size() {
+    if (mapping) return mappedSize;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) return 0;
+    return st.st_size;
+}
+
+bool MmapBackend::sync() {
+    // Las paginas de un MAP_SHARED ya son visibles para el resto del sistema
+    if (mapping) return msync(mapping, mappedSize, MS_ASYNC) == 0;
+    return true;
+}
+
+bool MmapBackend::fsync() {
+    // Lo escrito fuera de la proyeccion fue con pwrite y lo cubre fdatasync
+    if (mapping && msync(mapping, mappedSize, MS_SYNC) != 0) return false;
+    return fd != -1 && ::fdatasync(fd) == 0;
+}
+
+bool MmapBackend::resize(uint64_t size) {
+    if (ftruncate(fd, size) != 0) return false;
+    if (!mapping) return true;
+
+    // La proyeccion tiene que seguir al archivo
+    munmap(mapping, mappedSize);
+    mapping = nullptr;
+    mappedSize = 0;
+    if (size == 0) return true;
+
+    void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) return false;
+    mapping = static_cast<char *>(addr);
+    mappedSize = size;
+    return true;
+}
+
+bool MmapBackend::punchHole(uint64_t offset, uint64_t len) {
+    // Las paginas proyectadas del rango pasan a leerse en ceros
+    return fd != -1 && punchFile(fd, offset, len);
+}
+
+const char *MmapBackend::view(uint64_t offset, size_t len) {
+    if (!mapping || offset + len > mappedSize) return nullptr;
+    return mapping + offset;
+}
+
+bool PosixBackend::open(const std::string &path, bool truncate) {
+    int flags = O_RDWR | (truncate ? O_CREAT | O_TRUNC : 0);
+    fd = ::open(path.c_str(), flags, 0644);
+    return fd != -1;
+}
+
+void PosixBackend::close() {
+    if (fd != -1) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool PosixBackend::readAt(uint64_t offset, char *dst, size_t len) {
+    // pread puede devolver menos bytes de los pedidos; se insiste hasta completar
+    while (len > 0) {
+        ssize_t n = pread(fd, dst, len, offset);
+        if (n <= 0) return false;
+        dst += n;
+        offset += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool PosixBackend::writeAt(uint64_t offset, const char *src, size_t len) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, src, len, offset);
+        if (n <= 0) return false;
+        src += n;
+        offset += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool PosixBackend::fsync() {
+    return fd != -1 && ::fdatasync(fd) == 0;
+}
+
+bool PosixBackend::punchHole(uint64_t offset, uint64_t len) {
+    return fd != -1 && punchFile(fd, offset, len);
+}
+
+bool PosixBackend::resize(uint64_t size) {
+    return fd != -1 && ftruncate(fd, size) == 0;
+}
+
+uint64_t PosixBackend::size() {
+    struct stat st;
+    if (fstat(fd, &st) == -1) return 0;
+    return st.st_size;
+}
+
+bool PosixBackend::sync() {
+    // Cada pwrite ya llego al kernel; no hay buffer propio que vaciar
+    return fd != -1;
+}
+
+std::unique_ptr<StorageBackend> makeBackend(BackendType type) {
+    if (type == BackendType::MMAP) return std::make_unique<MmapBackend>();
+    if (type == BackendType::PREAD) return std::make_unique<PosixBackend>();
+    return std::make_unique<FstreamBackend>();
+}
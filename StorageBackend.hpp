@@ -0,0 +1,124 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+enum class BackendType
+{
+    FSTREAM,
+    MMAP,
+    PREAD
+};
+
+// Almacenamiento subyacente del device: lecturas y escrituras por offset absoluto.
+// Todas las implementaciones se pueden usar desde varios hilos a la vez.
+class StorageBackend
+{
+public:
+    virtual ~StorageBackend() = default;
+
+    // truncate = true crea el archivo vacio (usado por BlockDevice::create)
+    virtual bool open(const std::string &path, bool truncate) = 0;
+    virtual void close() = 0;
+    virtual bool isOpen() const = 0;
+
+    virtual bool readAt(uint64_t offset, char *dst, size_t len) = 0;
+    virtual bool writeAt(uint64_t offset, const char *src, size_t len) = 0;
+    virtual uint64_t size() = 0;
+    virtual bool sync() = 0;
+    // Como sync(), pero no vuelve hasta que los datos esten en el medio fisico
+    virtual bool fsync() = 0;
+    // Fija el tamaño del archivo; lo que crece queda disperso (sin bloques reservados)
+    virtual bool resize(uint64_t size) = 0;
+    // Devuelve al sistema de archivos el espacio del rango, que despues se lee en ceros;
+    // false si el sistema de archivos no lo permite
+    virtual bool punchHole(uint64_t offset, uint64_t len) = 0;
+
+    // Puntero directo a los datos si el backend los tiene en memoria, nullptr si no
+    virtual const char *view(uint64_t, size_t) { return nullptr; }
+    // Descriptor para E/S asincrona por offset, -1 si el backend no lo expone
+    virtual int handle() const { return -1; }
+    virtual BackendType type() const = 0;
+};
+
+// El stream tiene una sola posicion de lectura/escritura, asi que cada acceso se serializa
+class FstreamBackend : public StorageBackend
+{
+private:
+    std::fstream file;
+    std::string path; // El stream no expone su descriptor; fsync abre uno propio
+    std::mutex mutex;
+
+public:
+    bool open(const std::string &path, bool truncate) override;
+    void close() override;
+    bool isOpen() const override { return file.is_open(); }
+
+    bool readAt(uint64_t offset, char *dst, size_t len) override;
+    bool writeAt(uint64_t offset, const char *src, size_t len) override;
+    uint64_t size() override;
+    bool sync() override;
+    bool fsync() override;
+    bool resize(uint64_t size) override;
+    bool punchHole(uint64_t offset, uint64_t len) override;
+
+    BackendType type() const override { return BackendType::FSTREAM; }
+};
+
+// Proyecta la imagen completa en memoria; las lecturas no hacen syscalls ni copias.
+class MmapBackend : public StorageBackend
+{
+private:
+    int fd = -1;
+    char *mapping = nullptr;
+    uint64_t mappedSize = 0;
+
+public:
+    ~MmapBackend() override { close(); }
+
+    bool open(const std::string &path, bool truncate) override;
+    void close() override;
+    bool isOpen() const override { return fd != -1; }
+
+    bool readAt(uint64_t offset, char *dst, size_t len) override;
+    bool writeAt(uint64_t offset, const char *src, size_t len) override;
+    uint64_t size() override;
+    bool sync() override;
+    bool fsync() override;
+    bool resize(uint64_t size) override;
+    bool punchHole(uint64_t offset, uint64_t len) override;
+
+    const char *view(uint64_t offset, size_t len) override;
+    BackendType type() const override { return BackendType::MMAP; }
+};
+
+// pread/pwrite sobre un descriptor: no comparte posicion, los hilos no se esperan entre si
+class PosixBackend : public StorageBackend
+{
+private:
+    int fd = -1;
+
+public:
+    ~PosixBackend() override { close(); }
+
+    bool open(const std::string &path, bool truncate) override;
+    void close() override;
+    bool isOpen() const override { return fd != -1; }
+
+    bool readAt(uint64_t offset, char *dst, size_t len) override;
+    bool writeAt(uint64_t offset, const char *src, size_t len) override;
+    uint64_t size() override;
+    bool sync() override;
+    bool fsync() override;
+    bool resize(uint64_t size) override;
+    bool punchHole(uint64_t offset, uint64_t len) override;
+
+    int handle() const override { return fd; }
+    BackendType type() const override { return BackendType::PREAD; }
+};
+
+std::unique_ptr<StorageBackend> makeBackend(BackendType type);
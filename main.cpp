@@ -1,223 +1,501 @@
 #include <iostream>
 #include <vector>
 #include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
 #include "BlockDevice.hpp"
-
-void help() {
-    std::cout << "Commands:\n";
-    std::cout << "  create <filename> <block_size> <block_count> - Crea un nuevo sistema de bloques\n";
-    std::cout << "  open <filename> - Abre un bloque\n";
-    std::cout << "  close - Cierra el bloque actualmente abierto\n";
-    std::cout << "  write <block_number> <data> - Escribe data al bloque seleccionado\n";
-    std::cout << "  read <block_number> <size> - Lee data desde el bloque seleccionado\n";
-    std::cout << "  info - Muestra informacion actual del bloque\n";
-    std::cout << "  exit - Termina el programa\n";
-
-    std::cout << "\n-- ls - Lista los archivos\n";
-    std::cout << "\n-- format - Formate el Device\n";
-    std::cout << "\n-- wr <filename> <text> - Escribe texto en un archivo especificado \n";
-    std::cout << "\n-- cat <filename> - Lee texto en el archivo especificado\n";
-    std::cout << "\n-- hexdump <filename> - Lee texto de manera hexadecimal\n";
-    std::cout << "\n-- copy_out <filename1> <filename2> - Copia FILENAME1 para pegar en el FILENAME2\n";
-    std::cout << "\n-- copy_in <filename1> <filename2> - Copia FILENAME2 para pegar en el FILENAME1\\n";
-    std::cout << "\n-- rm <filename> - Elimina el archivo\n";
-    std::cout << "\n-- blocks - Imprime los bloques actuales\n";
+#include "BatchRunner.hpp"
+#include "Console.hpp"
+
+void help(std::ostream &out) {
+    out << "Commands:\n";
+    out << "  create <filename> <block_size> <block_count> - Crea un nuevo sistema de bloques\n";
+    out << "  open <filename> [cache_blocks] [lru|clock] [fstream|mmap|pread] [idx] [concurrent] [async] [compress] [dedup] - Abre un bloque\n";
+    out << "  close - Cierra el bloque actualmente abierto\n";
+    out << "  sync - Confirma el journal y escribe al disco los bloques sucios de la cache\n";
+    out << "  write <block_number> <data> - Escribe data al bloque seleccionado\n";
+    out << "  read <block_number> <size> - Lee data desde el bloque seleccionado\n";
+    out << "  info - Muestra informacion actual del bloque\n";
+    out << "  stats [json|prometheus] [reset] - Muestra contadores y latencias (reset los reinicia)\n";
+    out << "  scrub [hilos] - Relee los bloques en uso y revisa sus sumas de verificacion\n";
+    out << "  fsck [hilos] [liberar] - Revisa la imagen y rehace los mapas de bloques e inodos y el indice de nombres (liberar tambien suelta los bloques de write <bloque>)\n";
+    out << "  trim - Devuelve al sistema de archivos el espacio de todos los bloques libres de la imagen\n";
+    out << "  defrag [ms] - Junta los archivos fragmentados y recupera el espacio de los inodos sin nombre, de a pasos de ms\n";
+    out << "  exit - Termina el programa\n";
+
+    out << "\n-- ls [directorio] [prefijo] - Lista en orden los archivos y directorios\n";
+    out << "\n-- mkdir <directorio> - Crea un directorio (las rutas usan /)\n";
+    out << "\n-- rmdir <directorio> - Elimina un directorio vacio\n";
+    out << "\n-- format - Formate el Device\n";
+    out << "\n-- wr <filename> <text> - Escribe texto en un archivo especificado \n";
+    out << "\n-- cat <filename> - Lee texto en el archivo especificado\n";
+    out << "\n-- hexdump <filename> - Lee texto de manera hexadecimal\n";
+    out << "\n-- copy_out <filename1> <filename2> - Copia FILENAME1 para pegar en el FILENAME2\n";
+    out << "\n-- copy_in <filename1> <filename2> - Copia FILENAME2 para pegar en el FILENAME1\\n";
+    out << "\n-- rm <filename> - Elimina el archivo\n";
+    out << "\n-- blocks - Imprime los bloques actuales\n";
+    out << "\n-- snapshot <nombre> - Guarda una instantanea de solo lectura; se lee como @nombre/ruta\n";
+    out << "\n-- snapshot_rm <nombre> - Elimina la instantanea (ls @ las lista)\n";
+    out << "\n-- clone <origen> <destino> - Copia escribible que comparte los bloques del origen\n";
+
+    out << "\nModo lote: SimuladorDeBloques --script <archivo|-> [--jobs N] [--fsync-at-end]\n";
+    out << "  Ejecuta los comandos del archivo (o de la entrada estandar con -) sin prompt.\n";
+    out << "  --jobs N reparte wr, rm, copy_in y copy_out sobre archivos distintos entre N hilos;\n";
+    out << "  --fsync-at-end confirma los grupos sin esperar al disco y hace un solo fsync al final\n";
 }
 
 
-int main() {
-    BlockDevice device;
-    std::string comando;
+// Ejecuta una linea de comandos; false si pide terminar (exit). Lo que imprime va a out y err,
+// que en modo lote pueden ser buffers propios del comando
+bool ejecutarComando(BlockDevice &device, const std::string &comando, std::ostream &out, std::ostream &err) {
+    // Los mensajes del propio device tambien van a out y err
+    ConsoleRedirect consola(out, err);
+    std::istringstream iss(comando);
+    std::string cmd;
+    iss >> cmd;
 
-    while (true) {
-        std::cout << "> ";
-        std::getline(std::cin, comando);
+    if (cmd == "create") {
+        std::string filename;
+        std::size_t block_size, block_count;
 
-        std::istringstream iss(comando);
-        std::string cmd;
-        iss >> cmd;
+        if (!(iss >> filename >> block_size >> block_count)) {
+            err << "Error: Faltan Argumentos. Uso: create <filename> <block_size> <block_count>\n";
+            return true;
+        }
 
-        if (cmd == "create") {
-            std::string filename;
-            std::size_t block_size, block_count;
+        if (block_size == 0 || block_count == 0) {
+            err << "Error: BLOCK_SIZE o BLOCK_COUNT no valido.\n";
+            return true;
+        }
 
-            if (!(iss >> filename >> block_size >> block_count)) {
-                std::cerr << "Error: Faltan Argumentos. Uso: create <filename> <block_size> <block_count>" << std::endl;
-                continue;
-            }
+        if (!BlockDevice::isValidBlockSize(block_size)) {
+            err << "Error: BLOCK_SIZE tiene que ser una potencia de dos de al menos "
+                << BlockDevice::minBlockSize() << " bytes.\n";
+            return true;
+        }
 
-            if (block_size == 0 || block_count == 0) {
-                std::cerr << "Error: BLOCK_SIZE o BLOCK_COUNT no valido." << std::endl;
-                continue;
-            }
+        if (block_count < sizeof(Inodo)) {
+            err << "Error: Un numero menor al tamaño del inodo ocasionara un crash.\n";
+            return true;
+        }
 
-            if (block_size < 137 || block_count < 137) {
-                std::cerr << "Error: Un numero menor al tamaño del inodo ocasionara un crash." << std::endl;
-                continue;
-            }
+        if (!device.create(filename, block_size, block_count)) {
+            err << "Hubo un error al crear el device.\n";
+        }
 
-            if (!device.create(filename, block_size, block_count)) {
-                std::cerr << "Hubo un error al crear el device.\n";
-            }
+    } else if (cmd == "open") {
+        std::string filename;
 
-        } else if (cmd == "open") {
-            std::string filename;
+        if (!(iss >> filename)) {
+            err << "Error: Faltan Argumentos. Uso: open <filename> [cache_blocks] [lru|clock] [fstream|mmap|pread] [idx] [concurrent] [async] [compress] [dedup]\n";
+            return true;
+        }
 
-            if (!(iss >> filename)) {
-                std::cerr << "Error: Faltan Argumentos. Uso: open <filename>" << std::endl;
-                continue;
+        std::size_t cache_blocks = 0;
+        std::string policy, backend, opcion;
+        bool valido = true, concurrente = false, asincrono = false, comprimir = false, deduplicar = false;
+
+        while (iss >> opcion) {
+            if (opcion == "lru" || opcion == "clock") {
+                policy = opcion;
+            } else if (opcion == "fstream" || opcion == "mmap" || opcion == "pread") {
+                backend = opcion;
+            } else if (opcion == "idx") {
+                device.setPersistIndex(true);
+            } else if (opcion == "concurrent") {
+                concurrente = true;
+            } else if (opcion == "async") {
+                asincrono = true;
+            } else if (opcion == "compress") {
+                comprimir = true;
+            } else if (opcion == "dedup") {
+                deduplicar = true;
+            } else if (std::all_of(opcion.begin(), opcion.end(), ::isdigit) && std::stoul(opcion) > 0) {
+                cache_blocks = std::stoul(opcion);
+            } else {
+                valido = false;
             }
+        }
 
-            if(device.open(filename)) {
-                std::cout << "Archivo abierto de manera exitosa." << std::endl;
-            }
+        if (!valido) {
+            err << "Error: Opciones de open no validas.\n";
+            return true;
+        }
 
-        } else if (cmd == "close") {
-            if(device.close()) {
-                std::cout << "Archivo cerrado de manera exitosa." << std::endl;
-            }
+        // concurrent reparte la cache en shards para que varios hilos no se esperen
+        if (cache_blocks > 0 || !policy.empty() || concurrente) {
+            device.setCacheOptions(cache_blocks > 0 ? cache_blocks : 256,
+                                   policy == "clock" ? EvictionPolicy::CLOCK : EvictionPolicy::LRU,
+                                   concurrente ? 16 : 1);
+        }
 
-        } else if (cmd == "write") {
-            std::size_t block_number;
-            std::string data;
+        // La E/S asincrona trabaja sobre el descriptor del backend pread
+        if (backend.empty()) backend = asincrono ? "pread" : "fstream";
+
+        BackendType tipo = backend == "mmap" ? BackendType::MMAP :
+                           backend == "pread" ? BackendType::PREAD : BackendType::FSTREAM;
+        device.setAsyncIO(asincrono);
+        // compress: los archivos que se escriban quedan comprimidos; los demas se leen igual
+        device.setCompression(comprimir);
+        // dedup: los bloques repetidos de los archivos nuevos se comparten en vez de copiarse
+        device.setDeduplication(deduplicar);
+        if(device.open(filename, tipo)) {
+            out << "Archivo abierto de manera exitosa.\n";
+        }
 
-            if (!(iss >> block_number)) {
-                std::cerr << "Error: Faltan Argumentos. Uso: write <block_number> <data>" << std::endl;
-                continue;
-            }
+    } else if (cmd == "close") {
+        if(device.close()) {
+            out << "Archivo cerrado de manera exitosa.\n";
+        }
 
-            std::getline(iss, data);
-            
-            if (!data.empty() && data[0] == ' ') {
-                data = data.substr(1);
-            }
+    } else if (cmd == "sync") {
+        if (device.sync()) {
+            out << "Cache sincronizada con el disco.\n";
+        } else {
+            err << "Error al sincronizar la cache.\n";
+        }
 
-            if (data.empty()) {
-                std::cerr << "Error: No se proporcionó datos para escribir." << std::endl;
-                continue;
-            }
+    } else if (cmd == "write") {
+        std::size_t block_number;
+        std::string data;
 
-            std::vector<char> dataVector(data.begin(), data.end());
-            if (device.writeBlock(block_number, dataVector)) {
-                std::cout << "Escrito de manera exitosa al bloque N° " << block_number << ".\n";
-            }
+        if (!(iss >> block_number)) {
+            err << "Error: Faltan Argumentos. Uso: write <block_number> <data>\n";
+            return true;
+        }
 
-        } else if (cmd == "read") {
-            std::size_t block_number, primer_offset, ultimo_offset;
+        std::getline(iss, data);
+        
+        if (!data.empty() && data[0] == ' ') {
+            data = data.substr(1);
+        }
 
-            if (!(iss >> block_number >> primer_offset >> ultimo_offset)) {
-                std::cerr << "Error: Faltan Argumentos. Uso: read <block_number> <primer_offset> <ultimo_offset>" << std::endl;
-                continue;
-            }
+        if (data.empty()) {
+            err << "Error: No se proporcionó datos para escribir.\n";
+            return true;
+        }
 
-            std::vector<char> data = device.readBlock(block_number);
+        std::vector<char> dataVector(data.begin(), data.end());
+        if (device.writeBlock(block_number, dataVector)) {
+            out << "Escrito de manera exitosa al bloque N° " << block_number << ".\n";
+        }
 
-            if (primer_offset >= ultimo_offset || ultimo_offset > data.size()) {
-                std::cerr << "Error: Offset inválido o excede el tamaño del bloque." << std::endl;
-                continue;
-            }
+    } else if (cmd == "read") {
+        std::size_t block_number, primer_offset, ultimo_offset;
 
-            std::cout << std::hex;
-            for (auto it = data.begin() + primer_offset; it != data.begin() + ultimo_offset; ++it) {
-                std::cout << (int)(*it) << " ";
-            }
-            std::cout << std::dec << std::endl;
-
-        } else if (cmd == "info") {
-            device.info();
-        } else if (cmd == "ls") {
-            device.listFiles();
-        } else if (cmd == "format") {
-            if (device.format()) {
-                std::cout << "Device formateado exitosamente.\n";
-            } else {
-                std::cerr << "Error al formatear el device.\n";
-            }
-        } else if (cmd == "wr") {
-            std::string filename, text;
+        if (!(iss >> block_number >> primer_offset >> ultimo_offset)) {
+            err << "Error: Faltan Argumentos. Uso: read <block_number> <primer_offset> <ultimo_offset>\n";
+            return true;
+        }
 
-            if (!(iss >> filename)) {
-                std::cerr << "Error: Faltan Argumentos. Uso: wr <filename> <text>" << std::endl;
-                continue;
-            }
+        std::vector<char> data = device.readBlock(block_number);
 
-            std::getline(iss, text);
-            if (text.empty()) {
-                std::cerr << "Error: No se proporcionó texto." << std::endl;
-                continue;
-            }
+        if (primer_offset >= ultimo_offset || ultimo_offset > data.size()) {
+            err << "Error: Offset inválido o excede el tamaño del bloque.\n";
+            return true;
+        }
 
-            if (device.write(filename, text)) {
-                std::cout << "Texto escrito en el archivo " << filename << " exitosamente.\n";
+        out << std::hex;
+        for (auto it = data.begin() + primer_offset; it != data.begin() + ultimo_offset; ++it) {
+            out << (int)(*it) << " ";
+        }
+        out << std::dec << '\n';
+
+    } else if (cmd == "info") {
+        device.info();
+    } else if (cmd == "stats") {
+        std::string opcion;
+        StatsFormat formato = StatsFormat::TEXT;
+        bool reiniciar = false;
+
+        while (iss >> opcion) {
+            if (opcion == "json") {
+                formato = StatsFormat::JSON;
+            } else if (opcion == "prometheus") {
+                formato = StatsFormat::PROMETHEUS;
+            } else if (opcion == "reset") {
+                reiniciar = true;
             } else {
-                std::cerr << "Error al escribir en el archivo.\n";
+                err << "Error: Opcion desconocida. Uso: stats [json|prometheus] [reset]\n";
             }
+        }
 
-        } else if (cmd == "cat") {
-            std::string filename;
-            if (!(iss >> filename)) {
-                std::cerr << "Error: Faltan Argumentos. Uso: cat <filename>" << std::endl;
-                continue;
-            }
+        device.printStats(out, formato);
+        if (reiniciar) device.resetStats();
+    } else if (cmd == "ls") {
+        std::string directorio, prefijo;
+        iss >> directorio >> prefijo;
+        device.listFiles(directorio, prefijo);
+    } else if (cmd == "mkdir" || cmd == "rmdir") {
+        std::string directorio;
+        if (!(iss >> directorio)) {
+            err << "Error: Faltan Argumentos. Uso: " << cmd << " <directorio>\n";
+            return true;
+        }
 
-            device.cat(filename);
-        } else if (cmd == "hexdump") {
-            std::string filename;
-            if (!(iss >> filename)) {
-                std::cerr << "Error: Faltan Argumentos. Uso: hexdump <filename>" << std::endl;
-                continue;
-            }
+        bool ok = cmd == "mkdir" ? device.mkdir(directorio) : device.rmdir(directorio);
+        if (ok) {
+            out << "Directorio " << directorio << (cmd == "mkdir" ? " creado" : " eliminado") << " exitosamente.\n";
+        }
+    } else if (cmd == "format") {
+        if (device.format()) {
+            out << "Device formateado exitosamente.\n";
+        } else {
+            err << "Error al formatear el device.\n";
+        }
+    } else if (cmd == "wr") {
+        std::string filename, text;
 
-            device.hexdump(filename);
-        } else if (cmd == "copy_out") {
-            std::string filename1, filename2;
+        if (!(iss >> filename)) {
+            err << "Error: Faltan Argumentos. Uso: wr <filename> <text>\n";
+            return true;
+        }
 
-            if (!(iss >> filename1 >> filename2)) {
-                std::cerr << "Error: Faltan Argumentos. Uso: copy_out <filename1> <filename2>" << std::endl;
-                continue;
-            }
+        std::getline(iss, text);
+        if (text.empty()) {
+            err << "Error: No se proporcionó texto.\n";
+            return true;
+        }
 
-            if (device.copyOut(filename1, filename2)) {
-                std::cout << "Archivo copiado a " << filename2 << " exitosamente.\n";
-            } else {
-                std::cerr << "Error al copiar el archivo.\n";
-            }
+        if (device.write(filename, text)) {
+            out << "Texto escrito en el archivo " << filename << " exitosamente.\n";
+        } else {
+            err << "Error al escribir en el archivo.\n";
+        }
 
-        } else if (cmd == "copy_in") {
-            std::string filename1, filename2;
+    } else if (cmd == "cat") {
+        std::string filename;
+        if (!(iss >> filename)) {
+            err << "Error: Faltan Argumentos. Uso: cat <filename>\n";
+            return true;
+        }
 
-            if (!(iss >> filename1 >> filename2)) {
-                std::cerr << "Error: Faltan Argumentos. Uso: copy_in <filename1> <filename2>" << std::endl;
-                continue;
-            }
+        device.cat(filename);
+    } else if (cmd == "hexdump") {
+        std::string filename;
+        if (!(iss >> filename)) {
+            err << "Error: Faltan Argumentos. Uso: hexdump <filename>\n";
+            return true;
+        }
 
-            if (device.copyIn(filename1, filename2)) {
-                std::cout << "Archivo copiado a " << filename1 << " exitosamente.\n";
-            } else {
-                std::cerr << "Error al copiar el archivo.\n";
-            }
+        device.hexdump(filename);
+    } else if (cmd == "copy_out") {
+        std::string filename1, filename2;
 
-        } else if (cmd == "rm") {
-            std::string filename;
-            if (!(iss >> filename)) {
-                std::cerr << "Error: Faltan Argumentos. Uso: rm <filename>" << std::endl;
-                continue;
-            }
+        if (!(iss >> filename1 >> filename2)) {
+            err << "Error: Faltan Argumentos. Uso: copy_out <filename1> <filename2>\n";
+            return true;
+        }
 
-            if (device.remove(filename)) {
-                std::cout << "Archivo " << filename << " eliminado exitosamente.\n";
-            } else {
-                std::cerr << "Error al eliminar el archivo.\n";
-            }
+        if (device.copyOut(filename1, filename2)) {
+            out << "Archivo copiado a " << filename2 << " exitosamente.\n";
+        } else {
+            err << "Error al copiar el archivo.\n";
+        }
+
+    } else if (cmd == "copy_in") {
+        std::string filename1, filename2;
+
+        if (!(iss >> filename1 >> filename2)) {
+            err << "Error: Faltan Argumentos. Uso: copy_in <filename1> <filename2>\n";
+            return true;
+        }
+
+        if (device.copyIn(filename1, filename2)) {
+            out << "Archivo copiado a " << filename1 << " exitosamente.\n";
+        } else {
+            err << "Error al copiar el archivo.\n";
+        }
+
+    } else if (cmd == "rm") {
+        std::string filename;
+        if (!(iss >> filename)) {
+            err << "Error: Faltan Argumentos. Uso: rm <filename>\n";
+            return true;
+        }
 
-        } else if (cmd == "help") {
-            help();
-        } else if (cmd == "exit") {
-            std::cout << "Terminando programa...\n";
-            break;
+        if (device.remove(filename)) {
+            out << "Archivo " << filename << " eliminado exitosamente.\n";
         } else {
-            std::cerr << "Comando desconocido. Escribe 'help' para una lista de comandos disponibles.\n";
+            err << "Error al eliminar el archivo.\n";
+        }
+
+    } else if (cmd == "snapshot" || cmd == "snapshot_rm") {
+        std::string nombre;
+        if (!(iss >> nombre)) {
+            err << "Error: Faltan Argumentos. Uso: " << cmd << " <nombre>\n";
+            return true;
+        }
+
+        bool ok = cmd == "snapshot" ? device.snapshot(nombre) : device.deleteSnapshot(nombre);
+        if (ok) {
+            out << "Instantanea " << nombre << (cmd == "snapshot" ? " creada" : " eliminada") << " exitosamente.\n";
+        }
+
+    } else if (cmd == "clone") {
+        std::string origen, destino;
+        if (!(iss >> origen >> destino)) {
+            err << "Error: Faltan Argumentos. Uso: clone <origen> <destino>\n";
+            return true;
+        }
+
+        if (device.clone(origen, destino)) {
+            out << "Copia " << destino << " creada exitosamente.\n";
+        } else {
+            err << "Error al crear la copia.\n";
+        }
+
+    } else if (cmd == "defrag") {
+        size_t ms = 0;
+        iss >> ms;
+
+        bool ok = ms != 0 ? device.defrag(ms) : device.defrag();
+        if (!ok) {
+            err << "Error al desfragmentar el device.\n";
+        }
+
+    } else if (cmd == "fsck") {
+        // fsck [hilos] [liberar]: liberar tambien suelta los bloques en uso que nada referencia
+        size_t hilos = 0;
+        bool liberar = false;
+        std::string arg;
+        while (iss >> arg) {
+            if (arg == "liberar") liberar = true;
+            else if (std::all_of(arg.begin(), arg.end(), ::isdigit)) hilos = std::stoul(arg);
+        }
+
+        if (device.fsck(hilos, liberar)) {
+            out << "La imagen quedo consistente.\n";
+        } else {
+            err << "Error: El fsck encontro problemas que no pudo reparar.\n";
+        }
+
+    } else if (cmd == "trim") {
+        if (!device.trim()) {
+            err << "Error: No se pudo liberar el espacio de la imagen.\n";
         }
+
+    } else if (cmd == "scrub") {
+        size_t hilos = 0;
+        iss >> hilos;
+
+        if (device.scrub(hilos)) {
+            out << "Todos los bloques revisados estan correctos.\n";
+        } else {
+            err << "Error: El scrub encontro problemas.\n";
+        }
+
+    } else if (cmd == "help") {
+        help(out);
+    } else if (cmd == "exit") {
+        out << "Terminando programa...\n";
+        return false;
+    } else {
+        err << "Comando desconocido. Escribe 'help' para una lista de comandos disponibles.\n";
+    }
+    return true;
+}
+
+// Modo lote: comandos que solo tocan los archivos que nombran y se pueden adelantar en otro
+// hilo. Los demas imprimen desde el device (cat, ls) o cambian todo el estado (open, format)
+bool clavesDeComando(const std::string &comando, std::vector<std::string> &claves) {
+    std::istringstream iss(comando);
+    std::string cmd, primero, segundo;
+    iss >> cmd >> primero >> segundo;
+
+    // Las rutas del device valen con o sin '/' inicial; las del host llevan otro prefijo
+    auto ruta = [](std::string r) {
+        r.erase(0, r.find_first_not_of('/'));
+        return r;
+    };
+
+    if ((cmd == "wr" || cmd == "rm") && !primero.empty()) {
+        claves = {ruta(primero)};
+        return true;
+    }
+    if (cmd == "copy_in" && !segundo.empty()) {
+        claves = {"host:" + primero, ruta(segundo)};
+        return true;
+    }
+    if (cmd == "copy_out" && !segundo.empty()) {
+        claves = {ruta(primero), "host:" + segundo};
+        return true;
+    }
+    return false;
+}
+
+int main(int argc, char *argv[]) {
+    BlockDevice device;
+    std::string script;
+    std::size_t hilos = 1;
+    bool fsyncAlFinal = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string opcion = argv[i];
+        std::string valor = i + 1 < argc ? argv[i + 1] : "";
+
+        if (opcion == "--script" && !valor.empty()) {
+            script = valor;
+            i++;
+        } else if (opcion == "--jobs" && !valor.empty() && std::all_of(valor.begin(), valor.end(), ::isdigit)) {
+            hilos = std::max<std::size_t>(1, std::stoul(valor));
+            i++;
+        } else if (opcion == "--fsync-at-end") {
+            fsyncAlFinal = true;
+        } else {
+            std::cerr << "Uso: " << argv[0] << " [--script <archivo|->] [--jobs N] [--fsync-at-end]\n";
+            return 1;
+        }
+    }
+
+    if (script.empty()) {
+        if (hilos > 1 || fsyncAlFinal) {
+            std::cerr << "Error: --jobs y --fsync-at-end son para el modo lote (--script).\n";
+            return 1;
+        }
+
+        std::string comando;
+        while (true) {
+            std::cout << "> ";
+            if (!std::getline(std::cin, comando)) break;
+            if (!ejecutarComando(device, comando, std::cout, std::cerr)) break;
+        }
+        return 0;
     }
-    return 0;
-}
\ No newline at end of file
+
+    // Sin prompt ni vaciado por comando: la salida estandar queda en buffer. Con hilos cada
+    // comando (y el device) escribe en sus propios buffers y solo este hilo imprime
+    std::ios::sync_with_stdio(false);
+    std::cin.tie(nullptr);
+
+    std::ifstream archivo;
+    std::istream *entrada = &std::cin;
+    if (script != "-") {
+        archivo.open(script);
+        if (!archivo.is_open()) {
+            std::cerr << "Error: No se pudo abrir el script " << script << ".\n";
+            return 1;
+        }
+        entrada = &archivo;
+    }
+
+    device.setSyncAtEnd(fsyncAlFinal);
+    auto inicio = std::chrono::steady_clock::now();
+
+    std::size_t comandos;
+    {
+        BatchRunner lote([&device](const std::string &linea, std::ostream &out,
+                                   std::ostream &err) { return ejecutarComando(device, linea, out, err); },
+                         clavesDeComando, hilos);
+        comandos = lote.run(*entrada, std::cout, std::cerr);
+    }
+
+    // El unico fsync del lote; si el script cerro el device, close ya lo hizo
+    bool ok = !device.isOpen() || device.sync();
+    std::cout.flush();
+
+    double segundos = std::chrono::duration<double>(std::chrono::steady_clock::now() - inicio).count();
+    std::cerr << "Lote: " << comandos << " comandos en " << segundos << " s\n";
+    return ok ? 0 : 1;
+}